@@ -0,0 +1,543 @@
+/*
+ * gst-droid
+ *
+ * Copyright (C) 2014 Mohammed Sameer <msameer@foolab.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "gstdroidadec.h"
+#include "gstdroidcodectype.h"
+#include "plugin.h"
+
+#define gst_droidadec_parent_class parent_class
+G_DEFINE_TYPE (GstDroidADec, gst_droidadec, GST_TYPE_AUDIO_DECODER);
+
+GST_DEBUG_CATEGORY_EXTERN (gst_droid_adec_debug);
+#define GST_CAT_DEFAULT gst_droid_adec_debug
+
+static GstStaticPadTemplate gst_droidadec_src_template_factory =
+GST_STATIC_PAD_TEMPLATE (GST_AUDIO_DECODER_SRC_NAME,
+    GST_PAD_SRC,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS ("audio/x-raw, "
+        "format = (string) " GST_AUDIO_NE (S16) ", "
+        "layout = (string) interleaved, "
+        "rate = (int) [ 1, MAX ], " "channels = (int) [ 1, MAX ]"));
+
+enum
+{
+  PROP_0,
+  PROP_PRIORITY,
+  PROP_ADMISSION_TIMEOUT,
+};
+
+static void gst_droidadec_loop (GstDroidADec * dec);
+
+static gboolean
+gst_droidadec_start_loop (GstDroidADec * dec)
+{
+  if (!gst_pad_start_task (GST_AUDIO_DECODER_SRC_PAD (dec),
+          (GstTaskFunction) gst_droidadec_loop, gst_object_ref (dec),
+          gst_object_unref)) {
+    GST_ERROR_OBJECT (dec, "failed to start src task");
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+static void
+gst_droidadec_stop_loop (GstAudioDecoder * decoder)
+{
+  GstDroidADec *dec = GST_DROIDADEC (decoder);
+
+  GST_DEBUG_OBJECT (dec, "stop loop");
+
+  if (!dec->comp) {
+    /* nothing to do here */
+    return;
+  }
+
+  /* This also puts the output queue in flushing mode which wakes up
+   * the task if it's waiting for a buffer */
+  gst_droid_codec_set_running (dec->comp, FALSE);
+
+  /* _loop () needs the stream lock to finish frames */
+  GST_AUDIO_DECODER_STREAM_UNLOCK (decoder);
+  GST_PAD_STREAM_LOCK (GST_AUDIO_DECODER_SRC_PAD (decoder));
+  GST_PAD_STREAM_UNLOCK (GST_AUDIO_DECODER_SRC_PAD (decoder));
+  GST_AUDIO_DECODER_STREAM_LOCK (decoder);
+
+  if (!gst_pad_stop_task (GST_AUDIO_DECODER_SRC_PAD (decoder))) {
+    GST_WARNING_OBJECT (dec, "failed to stop src pad task");
+  }
+
+  GST_DEBUG_OBJECT (dec, "stopped loop");
+}
+
+static void
+gst_droidadec_loop (GstDroidADec * dec)
+{
+  OMX_BUFFERHEADERTYPE *buff;
+  GstBuffer *buffer;
+  GstFlowReturn ret;
+
+  while (gst_droid_codec_is_running (dec->comp)) {
+    if (gst_droid_codec_has_error (dec->comp)) {
+      return;
+    }
+
+    if (!gst_droid_codec_return_output_buffers (dec->comp)) {
+      GST_WARNING_OBJECT (dec,
+          "failed to return output buffers to the decoder");
+    }
+
+    GST_DEBUG_OBJECT (dec, "trying to get a buffer");
+    buff = gst_droid_codec_ring_pop_wait (dec->comp->full);
+    GST_DEBUG_OBJECT (dec, "got buffer %p", buff);
+
+    if (!buff) {
+      GST_DEBUG_OBJECT (dec, "got no buffer");
+      /* The queue is flushing which means we are not running anymore.
+       * We will exit upon looping */
+      continue;
+    }
+
+    if (buff->nFilledLen == 0) {
+      /* Nothing decoded. Hand the buffer back to omx */
+      GST_DEBUG_OBJECT (dec, "empty output buffer %p", buff);
+      buffer = gst_omx_buffer_get_buffer (dec->comp, buff);
+      if (buffer) {
+        gst_buffer_unref (buffer);
+      }
+
+      continue;
+    }
+
+    /* Output comes in input order so the base class does the timestamps */
+    buffer = gst_droid_codec_wrap_output_buffer (dec->comp, buff);
+
+    ret = gst_audio_decoder_finish_frame (GST_AUDIO_DECODER (dec), buffer, 1);
+    if (ret != GST_FLOW_OK) {
+      GST_DEBUG_OBJECT (dec, "finish frame returned %s",
+          gst_flow_get_name (ret));
+    }
+  }
+
+  if (!gst_droid_codec_is_running (dec->comp)) {
+    GST_DEBUG_OBJECT (dec, "stopping task");
+
+    if (!gst_pad_pause_task (GST_AUDIO_DECODER_SRC_PAD (dec))) {
+      GST_WARNING_OBJECT (dec, "failed to pause src pad task");
+    }
+
+    return;
+  }
+}
+
+static void
+gst_droidadec_finalize (GObject * object)
+{
+  GstDroidADec *dec = GST_DROIDADEC (object);
+
+  GST_DEBUG_OBJECT (dec, "finalize");
+
+  gst_mini_object_unref (GST_MINI_OBJECT (dec->codec));
+  dec->codec = NULL;
+
+  G_OBJECT_CLASS (parent_class)->finalize (object);
+}
+
+static gboolean
+gst_droidadec_start (GstAudioDecoder * decoder)
+{
+  GstDroidADec *dec = GST_DROIDADEC (decoder);
+
+  GST_DEBUG_OBJECT (dec, "start");
+
+  return TRUE;
+}
+
+static gboolean
+gst_droidadec_stop (GstAudioDecoder * decoder)
+{
+  GstDroidADec *dec = GST_DROIDADEC (decoder);
+
+  GST_DEBUG_OBJECT (dec, "stop");
+
+  gst_droidadec_stop_loop (decoder);
+
+  if (dec->sink_caps) {
+    gst_caps_unref (dec->sink_caps);
+    dec->sink_caps = NULL;
+  }
+
+  if (dec->comp) {
+    gst_droid_codec_stop_component (dec->comp);
+    gst_droid_codec_put_component (dec->comp);
+    dec->comp = NULL;
+  }
+
+  return TRUE;
+}
+
+/* reads the pcm format the component produces and tells the base class */
+static gboolean
+gst_droidadec_update_output_format (GstDroidADec * dec)
+{
+  gint rate, channels;
+
+  if (!gst_droid_codec_get_pcm_format (dec->comp, &rate, &channels)) {
+    return FALSE;
+  }
+
+  gst_audio_info_init (&dec->info);
+  gst_audio_info_set_format (&dec->info, GST_AUDIO_FORMAT_S16, rate, channels,
+      NULL);
+
+  return gst_audio_decoder_set_output_format (GST_AUDIO_DECODER (dec),
+      &dec->info);
+}
+
+static gboolean
+gst_droidadec_start_component (GstDroidADec * dec)
+{
+  GstStructure *s = gst_caps_get_structure (dec->sink_caps, 0);
+  const GValue *codec_data;
+  GstCaps *caps;
+  gboolean ret;
+
+  caps = gst_audio_info_to_caps (&dec->info);
+  ret = gst_droid_codec_start_component (dec->comp, dec->sink_caps, caps);
+  gst_caps_unref (caps);
+
+  if (!ret) {
+    return FALSE;
+  }
+
+  codec_data = gst_structure_get_value (s, "codec_data");
+  if (codec_data) {
+    GST_DEBUG_OBJECT (dec, "passing codec_data to decoder");
+
+    if (!gst_droid_codec_set_codec_data (dec->comp,
+            gst_value_get_buffer (codec_data))) {
+      return FALSE;
+    }
+  }
+
+  return gst_droidadec_start_loop (dec);
+}
+
+static gboolean
+gst_droidadec_set_format (GstAudioDecoder * decoder, GstCaps * caps)
+{
+  const gchar *type;
+  GstDroidADec *dec = GST_DROIDADEC (decoder);
+
+  GST_DEBUG_OBJECT (dec, "set format %" GST_PTR_FORMAT, caps);
+
+  if (dec->comp) {
+    /* a running component can not be reconfigured */
+    return gst_caps_is_equal (caps, dec->sink_caps);
+  }
+
+  type = gst_droid_codec_type_from_caps (caps, GST_DROID_CODEC_DECODER_AUDIO);
+  if (!type) {
+    return FALSE;
+  }
+
+  dec->comp =
+      gst_droid_codec_get_component_full (dec->codec, type, GST_ELEMENT (dec),
+      dec->priority, dec->admission_timeout);
+  if (!dec->comp) {
+    return FALSE;
+  }
+
+  dec->sink_caps = gst_caps_ref (caps);
+
+  if (!gst_droid_codec_configure_audio_decoder (dec->comp, caps)) {
+    return FALSE;
+  }
+
+  if (!gst_droidadec_update_output_format (dec)) {
+    return FALSE;
+  }
+
+  return gst_droidadec_start_component (dec);
+}
+
+/* the component changed its output port. Usually because the stream
+ * turned out to have another rate or channel count than advertised */
+static gboolean
+gst_droidadec_reconfigure (GstDroidADec * dec)
+{
+  GstDroidComponentPort *port = dec->comp->out_port;
+  GstStructure *config;
+  GstCaps *caps;
+
+  gst_droidadec_stop_loop (GST_AUDIO_DECODER (dec));
+
+  if (!gst_droid_codec_reconfigure_output_port (dec->comp)) {
+    return FALSE;
+  }
+
+  gst_droid_codec_unset_needs_reconfigure (dec->comp);
+
+  if (!gst_droidadec_update_output_format (dec)) {
+    return FALSE;
+  }
+
+  caps = gst_audio_info_to_caps (&dec->info);
+  config = gst_buffer_pool_get_config (port->buffers);
+  gst_buffer_pool_config_set_params (config, caps, port->def.nBufferSize,
+      port->def.nBufferCountActual, port->def.nBufferCountActual);
+  gst_buffer_pool_config_set_allocator (config, port->allocator, NULL);
+  gst_caps_unref (caps);
+
+  if (!gst_buffer_pool_set_config (port->buffers, config)) {
+    GST_ERROR_OBJECT (dec, "failed to set buffer pool configuration");
+    return FALSE;
+  }
+
+  if (!gst_buffer_pool_set_active (port->buffers, TRUE)) {
+    GST_ERROR_OBJECT (dec, "failed to activate buffer pool");
+    return FALSE;
+  }
+
+  gst_droid_codec_set_running (dec->comp, TRUE);
+
+  return gst_droidadec_start_loop (dec);
+}
+
+static gboolean
+gst_droidadec_do_handle_frame (GstAudioDecoder * decoder, GstBuffer * buffer)
+{
+  GstDroidADec *dec = GST_DROIDADEC (decoder);
+  gboolean ret;
+
+  /* _loop () needs the stream lock to finish frames while we wait for
+   * an input buffer */
+  GST_AUDIO_DECODER_STREAM_UNLOCK (decoder);
+  ret = gst_droid_codec_consume_buffer (dec->comp, buffer);
+  GST_AUDIO_DECODER_STREAM_LOCK (decoder);
+
+  return ret;
+}
+
+static GstFlowReturn
+gst_droidadec_handle_frame (GstAudioDecoder * decoder, GstBuffer * buffer)
+{
+  GstDroidADec *dec = GST_DROIDADEC (decoder);
+
+  GST_DEBUG_OBJECT (dec, "handle frame");
+
+  if (!buffer) {
+    /* draining. Like droiddec we do not wait for what omx still has */
+    gst_droidadec_stop_loop (decoder);
+    return GST_FLOW_OK;
+  }
+
+  if (!dec->comp) {
+    GST_ERROR_OBJECT (dec, "component not initialized");
+    return GST_FLOW_NOT_NEGOTIATED;
+  }
+
+  if (gst_droid_codec_has_error (dec->comp)) {
+    GST_ERROR_OBJECT (dec, "not handling frame while omx is in error state");
+    return GST_FLOW_ERROR;
+  }
+
+  /* if we have been flushed then we need to start accepting data again */
+  if (!gst_droid_codec_is_running (dec->comp)) {
+    if (!gst_droid_codec_flush (dec->comp, FALSE)) {
+      return GST_FLOW_ERROR;
+    }
+
+    gst_droid_codec_empty_full (dec->comp);
+
+    if (!gst_droidadec_start_loop (dec)) {
+      return GST_FLOW_ERROR;
+    }
+  }
+
+  if (gst_droidadec_do_handle_frame (decoder, buffer)) {
+    return GST_FLOW_OK;
+  }
+
+  if (!gst_droid_codec_is_running (dec->comp)) {
+    return GST_FLOW_FLUSHING;
+  }
+
+  if (!gst_droid_codec_needs_reconfigure (dec->comp)) {
+    GST_ERROR_OBJECT (dec, "failed to hand buffer to the component");
+    return GST_FLOW_ERROR;
+  }
+
+  if (!gst_droidadec_reconfigure (dec)) {
+    return GST_FLOW_ERROR;
+  }
+
+  if (gst_droidadec_do_handle_frame (decoder, buffer)) {
+    return GST_FLOW_OK;
+  }
+
+  return GST_FLOW_ERROR;
+}
+
+static void
+gst_droidadec_flush (GstAudioDecoder * decoder, gboolean hard)
+{
+  GstDroidADec *dec = GST_DROIDADEC (decoder);
+
+  GST_DEBUG_OBJECT (dec, "flush");
+
+  if (!dec->comp) {
+    GST_DEBUG_OBJECT (dec, "no component to flush");
+    return;
+  }
+
+  gst_droidadec_stop_loop (decoder);
+
+  if (!gst_droid_codec_flush (dec->comp, TRUE)) {
+    GST_WARNING_OBJECT (dec, "failed to flush component");
+    return;
+  }
+
+  GST_DEBUG_OBJECT (dec, "Flushed");
+}
+
+static void
+gst_droidadec_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstDroidADec *dec = GST_DROIDADEC (object);
+
+  switch (prop_id) {
+    case PROP_PRIORITY:
+      dec->priority = g_value_get_int (value);
+      break;
+    case PROP_ADMISSION_TIMEOUT:
+      dec->admission_timeout = g_value_get_int (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_droidadec_get_property (GObject * object, guint prop_id, GValue * value,
+    GParamSpec * pspec)
+{
+  GstDroidADec *dec = GST_DROIDADEC (object);
+
+  switch (prop_id) {
+    case PROP_PRIORITY:
+      g_value_set_int (value, dec->priority);
+      break;
+    case PROP_ADMISSION_TIMEOUT:
+      g_value_set_int (value, dec->admission_timeout);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_droidadec_init (GstDroidADec * dec)
+{
+  dec->codec = gst_droid_codec_get ();
+  dec->comp = NULL;
+  dec->sink_caps = NULL;
+  gst_audio_info_init (&dec->info);
+  dec->priority = GST_DROID_CODEC_PRIORITY_DEFAULT;
+  dec->admission_timeout = GST_DROID_CODEC_ADMISSION_TIMEOUT_DEFAULT;
+}
+
+static GstStateChangeReturn
+gst_droidadec_change_state (GstElement * element, GstStateChange transition)
+{
+  GstAudioDecoder *decoder = GST_AUDIO_DECODER (element);
+
+  GST_DEBUG_OBJECT (element, "change state");
+
+  if (transition == GST_STATE_CHANGE_PAUSED_TO_READY) {
+    GST_AUDIO_DECODER_STREAM_LOCK (decoder);
+    gst_droidadec_stop_loop (decoder);
+    GST_AUDIO_DECODER_STREAM_UNLOCK (decoder);
+  }
+
+  return GST_ELEMENT_CLASS (parent_class)->change_state (element, transition);
+}
+
+static void
+gst_droidadec_class_init (GstDroidADecClass * klass)
+{
+  GObjectClass *gobject_class;
+  GstElementClass *gstelement_class;
+  GstAudioDecoderClass *gstaudiodecoder_class;
+  GstCaps *caps;
+  GstPadTemplate *tpl;
+
+  gobject_class = (GObjectClass *) klass;
+  gstelement_class = (GstElementClass *) klass;
+  gstaudiodecoder_class = (GstAudioDecoderClass *) klass;
+
+  gst_element_class_set_static_metadata (gstelement_class,
+      "Audio decoder", "Decoder/Audio/Device",
+      "Android HAL audio decoder", "Mohammed Sameer <msameer@foolab.org>");
+
+  caps = gst_droid_codec_type_all_caps (GST_DROID_CODEC_DECODER_AUDIO);
+  tpl = gst_pad_template_new (GST_AUDIO_DECODER_SINK_NAME,
+      GST_PAD_SINK, GST_PAD_ALWAYS, caps);
+  gst_element_class_add_pad_template (gstelement_class, tpl);
+
+  gst_element_class_add_pad_template (gstelement_class,
+      gst_static_pad_template_get (&gst_droidadec_src_template_factory));
+
+  gobject_class->finalize = gst_droidadec_finalize;
+  gobject_class->set_property = gst_droidadec_set_property;
+  gobject_class->get_property = gst_droidadec_get_property;
+  gstelement_class->change_state =
+      GST_DEBUG_FUNCPTR (gst_droidadec_change_state);
+  gstaudiodecoder_class->start = GST_DEBUG_FUNCPTR (gst_droidadec_start);
+  gstaudiodecoder_class->stop = GST_DEBUG_FUNCPTR (gst_droidadec_stop);
+  gstaudiodecoder_class->set_format =
+      GST_DEBUG_FUNCPTR (gst_droidadec_set_format);
+  gstaudiodecoder_class->handle_frame =
+      GST_DEBUG_FUNCPTR (gst_droidadec_handle_frame);
+  gstaudiodecoder_class->flush = GST_DEBUG_FUNCPTR (gst_droidadec_flush);
+
+  g_object_class_install_property (gobject_class, PROP_PRIORITY,
+      g_param_spec_int ("priority", "Priority",
+          "Priority when waiting for a hardware codec instance. "
+          "Higher values are served first", G_MININT, G_MAXINT,
+          GST_DROID_CODEC_PRIORITY_DEFAULT,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_ADMISSION_TIMEOUT,
+      g_param_spec_int ("admission-timeout", "Admission timeout",
+          "Milliseconds to wait for a hardware codec instance when all are "
+          "in use (-1=forever, 0=fail immediately)", -1, G_MAXINT,
+          GST_DROID_CODEC_ADMISSION_TIMEOUT_DEFAULT,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+}
@@ -0,0 +1,65 @@
+/*
+ * gst-droid
+ *
+ * Copyright (C) 2014 Mohammed Sameer <msameer@foolab.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_DROID_ADEC_H__
+#define __GST_DROID_ADEC_H__
+
+#include <gst/gst.h>
+#include <gst/audio/gstaudiodecoder.h>
+#include "gstdroidcodec.h"
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_DROIDADEC \
+  (gst_droidadec_get_type())
+#define GST_DROIDADEC(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST((obj), GST_TYPE_DROIDADEC, GstDroidADec))
+#define GST_DROIDADEC_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_CAST((klass), GST_TYPE_DROIDADEC, GstDroidADecClass))
+#define GST_IS_DROIDADEC(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE((obj), GST_TYPE_DROIDADEC))
+#define GST_IS_DROIDADEC_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_TYPE((klass), GST_TYPE_DROIDADEC))
+
+typedef struct _GstDroidADec GstDroidADec;
+typedef struct _GstDroidADecClass GstDroidADecClass;
+
+struct _GstDroidADec
+{
+  GstAudioDecoder parent;
+  GstDroidCodec *codec;
+  GstDroidComponent *comp;
+  GstCaps *sink_caps;
+  GstAudioInfo info;
+  gint priority;
+  gint admission_timeout;
+};
+
+struct _GstDroidADecClass
+{
+  GstAudioDecoderClass parent_class;
+};
+
+GType gst_droidadec_get_type (void);
+
+G_END_DECLS
+
+#endif /* __GST_DROID_ADEC_H__ */
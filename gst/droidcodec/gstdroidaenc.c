@@ -0,0 +1,602 @@
+/*
+ * gst-droid
+ *
+ * Copyright (C) 2014 Mohammed Sameer <msameer@foolab.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "gstdroidaenc.h"
+#include "gstdroidcodectype.h"
+#include "plugin.h"
+
+#define gst_droidaenc_parent_class parent_class
+G_DEFINE_TYPE (GstDroidAEnc, gst_droidaenc, GST_TYPE_AUDIO_ENCODER);
+
+GST_DEBUG_CATEGORY_EXTERN (gst_droid_aenc_debug);
+#define GST_CAT_DEFAULT gst_droid_aenc_debug
+
+static GstStaticPadTemplate gst_droidaenc_sink_template_factory =
+GST_STATIC_PAD_TEMPLATE (GST_AUDIO_ENCODER_SINK_NAME,
+    GST_PAD_SINK,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS ("audio/x-raw, "
+        "format = (string) " GST_AUDIO_NE (S16) ", "
+        "layout = (string) interleaved, "
+        "rate = (int) [ 8000, 48000 ], " "channels = (int) [ 1, 2 ]"));
+
+enum
+{
+  PROP_0,
+  PROP_PRIORITY,
+  PROP_ADMISSION_TIMEOUT,
+  PROP_BITRATE,
+  PROP_CHANNELS,
+  PROP_RATE,
+};
+
+#define DEFAULT_BITRATE 128000
+#define DEFAULT_CHANNELS 0
+#define DEFAULT_RATE 0
+
+/* samples per channel in an AAC-LC frame */
+#define AAC_FRAME_SAMPLES 1024
+
+static void gst_droidaenc_loop (GstDroidAEnc * enc);
+
+static gboolean
+gst_droidaenc_start_loop (GstDroidAEnc * enc)
+{
+  if (!gst_pad_start_task (GST_AUDIO_ENCODER_SRC_PAD (enc),
+          (GstTaskFunction) gst_droidaenc_loop, gst_object_ref (enc),
+          gst_object_unref)) {
+    GST_ERROR_OBJECT (enc, "failed to start src task");
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+static void
+gst_droidaenc_stop_loop (GstAudioEncoder * encoder)
+{
+  GstDroidAEnc *enc = GST_DROIDAENC (encoder);
+
+  GST_DEBUG_OBJECT (enc, "stop loop");
+
+  if (!enc->comp) {
+    /* nothing to do here */
+    return;
+  }
+
+  /* This also puts the output queue in flushing mode which wakes up
+   * the task if it's waiting for a buffer */
+  gst_droid_codec_set_running (enc->comp, FALSE);
+
+  /* _loop () needs the stream lock to finish frames */
+  GST_AUDIO_ENCODER_STREAM_UNLOCK (encoder);
+  GST_PAD_STREAM_LOCK (GST_AUDIO_ENCODER_SRC_PAD (encoder));
+  GST_PAD_STREAM_UNLOCK (GST_AUDIO_ENCODER_SRC_PAD (encoder));
+  GST_AUDIO_ENCODER_STREAM_LOCK (encoder);
+
+  if (!gst_pad_stop_task (GST_AUDIO_ENCODER_SRC_PAD (encoder))) {
+    GST_WARNING_OBJECT (enc, "failed to stop src pad task");
+  }
+
+  GST_DEBUG_OBJECT (enc, "stopped loop");
+}
+
+/* the component hands us the AudioSpecificConfig before the first frame */
+static void
+gst_droidaenc_set_codec_data (GstDroidAEnc * enc, OMX_BUFFERHEADERTYPE * buff)
+{
+  GstBuffer *codec_data;
+  GstCaps *caps;
+
+  GST_INFO_OBJECT (enc, "received codec_data");
+
+  codec_data = gst_buffer_new_allocate (NULL, buff->nFilledLen, NULL);
+  gst_buffer_fill (codec_data, 0, buff->pBuffer + buff->nOffset,
+      buff->nFilledLen);
+
+  caps = gst_caps_new_simple ("audio/mpeg",
+      "mpegversion", G_TYPE_INT, 4,
+      "stream-format", G_TYPE_STRING, "raw",
+      "rate", G_TYPE_INT, GST_AUDIO_INFO_RATE (&enc->info),
+      "channels", G_TYPE_INT, GST_AUDIO_INFO_CHANNELS (&enc->info),
+      "codec_data", GST_TYPE_BUFFER, codec_data, NULL);
+  gst_buffer_unref (codec_data);
+
+  if (!gst_audio_encoder_set_output_format (GST_AUDIO_ENCODER (enc), caps)) {
+    GST_ELEMENT_ERROR (enc, STREAM, FORMAT, (NULL),
+        ("failed to negotiate output format"));
+  }
+
+  gst_caps_unref (caps);
+}
+
+static void
+gst_droidaenc_loop (GstDroidAEnc * enc)
+{
+  OMX_BUFFERHEADERTYPE *buff;
+  GstBuffer *buffer;
+  GstFlowReturn ret;
+
+  while (gst_droid_codec_is_running (enc->comp)) {
+    if (gst_droid_codec_has_error (enc->comp)) {
+      return;
+    }
+
+    if (!gst_droid_codec_return_output_buffers (enc->comp)) {
+      GST_WARNING_OBJECT (enc,
+          "failed to return output buffers to the encoder");
+    }
+
+    GST_DEBUG_OBJECT (enc, "trying to get a buffer");
+    buff = gst_droid_codec_ring_pop_wait (enc->comp->full);
+    GST_DEBUG_OBJECT (enc, "got buffer %p", buff);
+
+    if (!buff) {
+      GST_DEBUG_OBJECT (enc, "got no buffer");
+      /* The queue is flushing which means we are not running anymore.
+       * We will exit upon looping */
+      continue;
+    }
+
+    if (buff->nFlags & OMX_BUFFERFLAG_CODECCONFIG) {
+      gst_droidaenc_set_codec_data (enc, buff);
+    }
+
+    if (buff->nFlags & OMX_BUFFERFLAG_CODECCONFIG || buff->nFilledLen == 0) {
+      /* Hand the buffer back to omx */
+      buffer = gst_omx_buffer_get_buffer (enc->comp, buff);
+      if (buffer) {
+        gst_buffer_unref (buffer);
+      }
+
+      continue;
+    }
+
+    buffer = gst_droid_codec_wrap_output_buffer (enc->comp, buff);
+
+    ret = gst_audio_encoder_finish_frame (GST_AUDIO_ENCODER (enc), buffer,
+        AAC_FRAME_SAMPLES);
+    if (ret != GST_FLOW_OK) {
+      GST_DEBUG_OBJECT (enc, "finish frame returned %s",
+          gst_flow_get_name (ret));
+    }
+  }
+
+  if (!gst_droid_codec_is_running (enc->comp)) {
+    GST_DEBUG_OBJECT (enc, "stopping task");
+
+    if (!gst_pad_pause_task (GST_AUDIO_ENCODER_SRC_PAD (enc))) {
+      GST_WARNING_OBJECT (enc, "failed to pause src pad task");
+    }
+
+    return;
+  }
+}
+
+static void
+gst_droidaenc_finalize (GObject * object)
+{
+  GstDroidAEnc *enc = GST_DROIDAENC (object);
+
+  GST_DEBUG_OBJECT (enc, "finalize");
+
+  gst_mini_object_unref (GST_MINI_OBJECT (enc->codec));
+  enc->codec = NULL;
+
+  G_OBJECT_CLASS (parent_class)->finalize (object);
+}
+
+static gboolean
+gst_droidaenc_start (GstAudioEncoder * encoder)
+{
+  GstDroidAEnc *enc = GST_DROIDAENC (encoder);
+
+  GST_DEBUG_OBJECT (enc, "start");
+
+  /* one AAC frame for every input chunk */
+  gst_audio_encoder_set_frame_samples_min (encoder, AAC_FRAME_SAMPLES);
+  gst_audio_encoder_set_frame_samples_max (encoder, AAC_FRAME_SAMPLES);
+  gst_audio_encoder_set_frame_max (encoder, 1);
+
+  return TRUE;
+}
+
+static void
+gst_droidaenc_release_component (GstDroidAEnc * enc)
+{
+  gst_droidaenc_stop_loop (GST_AUDIO_ENCODER (enc));
+
+  if (enc->comp) {
+    gst_droid_codec_stop_component (enc->comp);
+    gst_droid_codec_put_component (enc->comp);
+    enc->comp = NULL;
+  }
+}
+
+static gboolean
+gst_droidaenc_stop (GstAudioEncoder * encoder)
+{
+  GstDroidAEnc *enc = GST_DROIDAENC (encoder);
+
+  GST_DEBUG_OBJECT (enc, "stop");
+
+  gst_droidaenc_release_component (enc);
+
+  return TRUE;
+}
+
+static GstCaps *
+gst_droidaenc_getcaps (GstAudioEncoder * encoder, GstCaps * filter)
+{
+  GstDroidAEnc *enc = GST_DROIDAENC (encoder);
+  GstCaps *caps, *ret;
+  gint channels, rate;
+
+  GST_OBJECT_LOCK (enc);
+  channels = enc->channels;
+  rate = enc->rate;
+  GST_OBJECT_UNLOCK (enc);
+
+  caps = gst_pad_get_pad_template_caps (GST_AUDIO_ENCODER_SINK_PAD (encoder));
+
+  if (channels > 0 || rate > 0) {
+    caps = gst_caps_make_writable (caps);
+
+    if (channels > 0) {
+      gst_caps_set_simple (caps, "channels", G_TYPE_INT, channels, NULL);
+    }
+
+    if (rate > 0) {
+      gst_caps_set_simple (caps, "rate", G_TYPE_INT, rate, NULL);
+    }
+  }
+
+  ret = gst_audio_encoder_proxy_getcaps (encoder, caps, filter);
+  gst_caps_unref (caps);
+
+  return ret;
+}
+
+static gboolean
+gst_droidaenc_set_format (GstAudioEncoder * encoder, GstAudioInfo * info)
+{
+  const gchar *type;
+  GstDroidAEnc *enc = GST_DROIDAENC (encoder);
+  GstCaps *caps, *tmpl;
+  guint bitrate;
+  gboolean ret;
+
+  GST_DEBUG_OBJECT (enc, "set format %d Hz, %d channels",
+      GST_AUDIO_INFO_RATE (info), GST_AUDIO_INFO_CHANNELS (info));
+
+  /* The base class has drained us already. omx can not change the format
+   * of a running component so we start over */
+  gst_droidaenc_release_component (enc);
+
+  enc->info = *info;
+
+  tmpl = gst_pad_get_pad_template_caps (GST_AUDIO_ENCODER_SRC_PAD (encoder));
+  caps = gst_pad_peer_query_caps (GST_AUDIO_ENCODER_SRC_PAD (encoder), tmpl);
+  gst_caps_unref (tmpl);
+
+  GST_DEBUG_OBJECT (enc, "peer caps %" GST_PTR_FORMAT, caps);
+
+  if (gst_caps_is_empty (caps)) {
+    GST_DEBUG_OBJECT (enc, "downstream does not accept anything we produce");
+    gst_caps_unref (caps);
+    return FALSE;
+  }
+
+  caps = gst_caps_truncate (caps);
+
+  type = gst_droid_codec_type_from_caps (caps, GST_DROID_CODEC_ENCODER_AUDIO);
+  gst_caps_unref (caps);
+
+  if (!type) {
+    GST_DEBUG_OBJECT (enc, "failed to get any encoder");
+    return FALSE;
+  }
+
+  enc->comp =
+      gst_droid_codec_get_component_full (enc->codec, type, GST_ELEMENT (enc),
+      enc->priority, enc->admission_timeout);
+  if (!enc->comp) {
+    return FALSE;
+  }
+
+  GST_OBJECT_LOCK (enc);
+  bitrate = enc->bitrate;
+  GST_OBJECT_UNLOCK (enc);
+
+  if (!gst_droid_codec_configure_audio_encoder (enc->comp,
+          GST_AUDIO_INFO_RATE (info), GST_AUDIO_INFO_CHANNELS (info),
+          bitrate)) {
+    return FALSE;
+  }
+
+  caps = gst_audio_info_to_caps (info);
+  tmpl = gst_pad_get_pad_template_caps (GST_AUDIO_ENCODER_SRC_PAD (encoder));
+  ret = gst_droid_codec_start_component (enc->comp, caps, tmpl);
+  gst_caps_unref (tmpl);
+  gst_caps_unref (caps);
+
+  if (!ret) {
+    return FALSE;
+  }
+
+  return gst_droidaenc_start_loop (enc);
+}
+
+static gboolean
+gst_droidaenc_do_handle_frame (GstAudioEncoder * encoder, GstBuffer * buffer)
+{
+  GstDroidAEnc *enc = GST_DROIDAENC (encoder);
+  gboolean ret;
+
+  /* _loop () needs the stream lock to finish frames while we wait for
+   * an input buffer */
+  GST_AUDIO_ENCODER_STREAM_UNLOCK (encoder);
+  ret = gst_droid_codec_consume_buffer (enc->comp, buffer);
+  GST_AUDIO_ENCODER_STREAM_LOCK (encoder);
+
+  return ret;
+}
+
+static GstFlowReturn
+gst_droidaenc_handle_frame (GstAudioEncoder * encoder, GstBuffer * buffer)
+{
+  GstDroidAEnc *enc = GST_DROIDAENC (encoder);
+
+  GST_DEBUG_OBJECT (enc, "handle frame");
+
+  if (!buffer) {
+    /* draining. Like droidenc we do not wait for what omx still has */
+    gst_droidaenc_stop_loop (encoder);
+    return GST_FLOW_OK;
+  }
+
+  if (!enc->comp) {
+    GST_ERROR_OBJECT (enc, "component not initialized");
+    return GST_FLOW_NOT_NEGOTIATED;
+  }
+
+  if (gst_droid_codec_has_error (enc->comp)) {
+    GST_ERROR_OBJECT (enc, "not handling frame while omx is in error state");
+    return GST_FLOW_ERROR;
+  }
+
+  /* if we have been flushed then we need to start accepting data again */
+  if (!gst_droid_codec_is_running (enc->comp)) {
+    if (!gst_droid_codec_flush (enc->comp, FALSE)) {
+      return GST_FLOW_ERROR;
+    }
+
+    gst_droid_codec_empty_full (enc->comp);
+
+    if (!gst_droidaenc_start_loop (enc)) {
+      return GST_FLOW_ERROR;
+    }
+  }
+
+  if (gst_droidaenc_do_handle_frame (encoder, buffer)) {
+    return GST_FLOW_OK;
+  }
+
+  if (!gst_droid_codec_is_running (enc->comp)) {
+    return GST_FLOW_FLUSHING;
+  }
+
+  GST_ERROR_OBJECT (enc, "failed to hand buffer to the component");
+
+  return GST_FLOW_ERROR;
+}
+
+static void
+gst_droidaenc_flush (GstAudioEncoder * encoder)
+{
+  GstDroidAEnc *enc = GST_DROIDAENC (encoder);
+
+  GST_DEBUG_OBJECT (enc, "flush");
+
+  if (!enc->comp) {
+    GST_DEBUG_OBJECT (enc, "no component to flush");
+    return;
+  }
+
+  gst_droidaenc_stop_loop (encoder);
+
+  if (!gst_droid_codec_flush (enc->comp, TRUE)) {
+    GST_WARNING_OBJECT (enc, "failed to flush component");
+    return;
+  }
+
+  GST_DEBUG_OBJECT (enc, "Flushed");
+}
+
+static void
+gst_droidaenc_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstDroidAEnc *enc = GST_DROIDAENC (object);
+
+  switch (prop_id) {
+    case PROP_PRIORITY:
+      enc->priority = g_value_get_int (value);
+      break;
+    case PROP_ADMISSION_TIMEOUT:
+      enc->admission_timeout = g_value_get_int (value);
+      break;
+    case PROP_BITRATE:
+      GST_OBJECT_LOCK (enc);
+      enc->bitrate = g_value_get_uint (value);
+      GST_OBJECT_UNLOCK (enc);
+      break;
+    case PROP_CHANNELS:
+      GST_OBJECT_LOCK (enc);
+      enc->channels = g_value_get_int (value);
+      GST_OBJECT_UNLOCK (enc);
+      break;
+    case PROP_RATE:
+      GST_OBJECT_LOCK (enc);
+      enc->rate = g_value_get_int (value);
+      GST_OBJECT_UNLOCK (enc);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_droidaenc_get_property (GObject * object, guint prop_id, GValue * value,
+    GParamSpec * pspec)
+{
+  GstDroidAEnc *enc = GST_DROIDAENC (object);
+
+  switch (prop_id) {
+    case PROP_PRIORITY:
+      g_value_set_int (value, enc->priority);
+      break;
+    case PROP_ADMISSION_TIMEOUT:
+      g_value_set_int (value, enc->admission_timeout);
+      break;
+    case PROP_BITRATE:
+      GST_OBJECT_LOCK (enc);
+      g_value_set_uint (value, enc->bitrate);
+      GST_OBJECT_UNLOCK (enc);
+      break;
+    case PROP_CHANNELS:
+      GST_OBJECT_LOCK (enc);
+      g_value_set_int (value, enc->channels);
+      GST_OBJECT_UNLOCK (enc);
+      break;
+    case PROP_RATE:
+      GST_OBJECT_LOCK (enc);
+      g_value_set_int (value, enc->rate);
+      GST_OBJECT_UNLOCK (enc);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_droidaenc_init (GstDroidAEnc * enc)
+{
+  enc->codec = gst_droid_codec_get ();
+  enc->comp = NULL;
+  gst_audio_info_init (&enc->info);
+  enc->priority = GST_DROID_CODEC_PRIORITY_DEFAULT;
+  enc->admission_timeout = GST_DROID_CODEC_ADMISSION_TIMEOUT_DEFAULT;
+  enc->bitrate = DEFAULT_BITRATE;
+  enc->channels = DEFAULT_CHANNELS;
+  enc->rate = DEFAULT_RATE;
+}
+
+static GstStateChangeReturn
+gst_droidaenc_change_state (GstElement * element, GstStateChange transition)
+{
+  GstAudioEncoder *encoder = GST_AUDIO_ENCODER (element);
+
+  GST_DEBUG_OBJECT (element, "change state");
+
+  if (transition == GST_STATE_CHANGE_PAUSED_TO_READY) {
+    GST_AUDIO_ENCODER_STREAM_LOCK (encoder);
+    gst_droidaenc_stop_loop (encoder);
+    GST_AUDIO_ENCODER_STREAM_UNLOCK (encoder);
+  }
+
+  return GST_ELEMENT_CLASS (parent_class)->change_state (element, transition);
+}
+
+static void
+gst_droidaenc_class_init (GstDroidAEncClass * klass)
+{
+  GObjectClass *gobject_class;
+  GstElementClass *gstelement_class;
+  GstAudioEncoderClass *gstaudioencoder_class;
+  GstCaps *caps;
+  GstPadTemplate *tpl;
+
+  gobject_class = (GObjectClass *) klass;
+  gstelement_class = (GstElementClass *) klass;
+  gstaudioencoder_class = (GstAudioEncoderClass *) klass;
+
+  gst_element_class_set_static_metadata (gstelement_class,
+      "Audio encoder", "Encoder/Audio/Device",
+      "Android HAL audio encoder", "Mohammed Sameer <msameer@foolab.org>");
+
+  caps = gst_droid_codec_type_all_caps (GST_DROID_CODEC_ENCODER_AUDIO);
+  tpl = gst_pad_template_new (GST_AUDIO_ENCODER_SRC_NAME,
+      GST_PAD_SRC, GST_PAD_ALWAYS, caps);
+  gst_element_class_add_pad_template (gstelement_class, tpl);
+
+  gst_element_class_add_pad_template (gstelement_class,
+      gst_static_pad_template_get (&gst_droidaenc_sink_template_factory));
+
+  gobject_class->finalize = gst_droidaenc_finalize;
+  gobject_class->set_property = gst_droidaenc_set_property;
+  gobject_class->get_property = gst_droidaenc_get_property;
+  gstelement_class->change_state =
+      GST_DEBUG_FUNCPTR (gst_droidaenc_change_state);
+  gstaudioencoder_class->start = GST_DEBUG_FUNCPTR (gst_droidaenc_start);
+  gstaudioencoder_class->stop = GST_DEBUG_FUNCPTR (gst_droidaenc_stop);
+  gstaudioencoder_class->getcaps = GST_DEBUG_FUNCPTR (gst_droidaenc_getcaps);
+  gstaudioencoder_class->set_format =
+      GST_DEBUG_FUNCPTR (gst_droidaenc_set_format);
+  gstaudioencoder_class->handle_frame =
+      GST_DEBUG_FUNCPTR (gst_droidaenc_handle_frame);
+  gstaudioencoder_class->flush = GST_DEBUG_FUNCPTR (gst_droidaenc_flush);
+
+  g_object_class_install_property (gobject_class, PROP_PRIORITY,
+      g_param_spec_int ("priority", "Priority",
+          "Priority when waiting for a hardware codec instance. "
+          "Higher values are served first", G_MININT, G_MAXINT,
+          GST_DROID_CODEC_PRIORITY_DEFAULT,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_ADMISSION_TIMEOUT,
+      g_param_spec_int ("admission-timeout", "Admission timeout",
+          "Milliseconds to wait for a hardware codec instance when all are "
+          "in use (-1=forever, 0=fail immediately)", -1, G_MAXINT,
+          GST_DROID_CODEC_ADMISSION_TIMEOUT_DEFAULT,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_BITRATE,
+      g_param_spec_uint ("bitrate", "Bitrate",
+          "Bitrate in bits per second", 8000, 320000, DEFAULT_BITRATE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_CHANNELS,
+      g_param_spec_int ("channels", "Channels",
+          "Number of channels to encode (0=as upstream provides)", 0, 2,
+          DEFAULT_CHANNELS, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_RATE,
+      g_param_spec_int ("rate", "Rate",
+          "Sample rate to encode (0=as upstream provides)", 0, 48000,
+          DEFAULT_RATE, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+}
@@ -27,26 +27,30 @@
 #include "binding.h"
 #include <dlfcn.h>
 #include <string.h>
-#include <unistd.h>
 #include "HardwareAPI.h"
 #include "gstdroidcodecallocatoromx.h"
 #include "gstdroidcodecallocatorgralloc.h"
 #include "gst/memory/gstgralloc.h"
 #include "gstdroidcodectype.h"
+#include "gstdroidcodecregistry.h"
+#include "gstdroidcodecprobe.h"
 #include "plugin.h"
 #include "gstencoderparams.h"
+#include <gst/base/gstbytereader.h>
+#include "OMX_IndexExt.h"
 
 GST_DEFINE_MINI_OBJECT_TYPE (GstDroidCodec, gst_droid_codec);
 
 GST_DEBUG_CATEGORY_EXTERN (gst_droid_codec_debug);
 #define GST_CAT_DEFAULT gst_droid_codec_debug
 
+/* used for adaptive playback when the configuration does not say */
+#define DEFAULT_MAX_WIDTH  1920
+#define DEFAULT_MAX_HEIGHT 1088
+
 static GstDroidCodec *codec = NULL;
 G_LOCK_DEFINE_STATIC (codec);
 
-/* 10 ms */
-#define WAIT_TIMEOUT 10000
-
 struct _GstDroidCodecHandle
 {
   void *handle;
@@ -58,10 +62,25 @@ struct _GstDroidCodecHandle
   gchar *name;
 
   gboolean is_decoder;
+  /* audio components get neither native buffers nor meta data */
+  gboolean is_audio;
+  /* image decoders decode into native buffers but only one frame at a time */
+  gboolean is_image;
 
   int in_port;
   int out_port;
 
+  /* ms */
+  int state_timeout;
+
+  /* idle components we keep around for reuse and for how long (seconds) */
+  int warm_components;
+  int idle_timeout;
+
+  /* largest frame we prepare decoders for */
+  int max_width;
+  int max_height;
+
     OMX_ERRORTYPE (*init) (void);
     OMX_ERRORTYPE (*deinit) (void);
     OMX_ERRORTYPE (*get_handle) (OMX_HANDLETYPE * handle,
@@ -69,12 +88,107 @@ struct _GstDroidCodecHandle
     OMX_ERRORTYPE (*free_handle) (OMX_HANDLETYPE handle);
 };
 
+typedef struct
+{
+  /* most recently returned first */
+  GQueue *idle;
+  guint hits;
+  guint misses;
+  guint evictions;
+} GstDroidCodecPool;
+
+typedef struct
+{
+  /* 0 means unlimited */
+  int max;
+  int active;
+  int peak;
+  /* gint * priorities of the waiters. Highest first */
+  GList *waiters;
+  guint admitted;
+  guint waits;
+  guint refused;
+} GstDroidCodecBudget;
+
+/* from the qcom media headers */
+typedef struct
+{
+  OMX_U32 nSize;
+  OMX_VERSIONTYPE nVersion;
+  OMX_U32 nPortIndex;
+  OMX_U32 eOutputPictureOrder;
+} QOMX_VIDEO_DECODER_PICTURE_ORDER;
+
+#define QOMX_VIDEO_DECODE_ORDER 0x1
+
+/* Output buffers downstream may hold on top of what the component needs
+ * when running in low latency mode: the frame being shown and the next one.
+ * With fewer the component waits for the sink to let go of a frame before
+ * it can output the next, which costs more latency than it saves */
+#define LOW_LATENCY_EXTRA_BUFFERS 2
+
+/* input buffers kept back for copying when upstream gets a pool of its own */
+#define SHARED_INPUT_COPY_BUFFERS 2
+
+/* upper limit when adding input buffers for frames which do not fit in one */
+#define MAX_INPUT_BUFFERS 32
+
 typedef struct _CodecProfileLevel
 {
   OMX_U32 mProfile;
   OMX_U32 mLevel;
 } CodecProfileLevel;
 
+static void
+gst_droid_codec_wake_input (GstDroidComponent * comp)
+{
+  g_mutex_lock (&comp->empty_lock);
+  g_cond_broadcast (&comp->empty_cond);
+  g_mutex_unlock (&comp->empty_lock);
+}
+
+static inline void
+gst_droid_codec_stats_add (guint64 * counter, guint64 value)
+{
+  __atomic_fetch_add (counter, value, __ATOMIC_RELAXED);
+}
+
+static inline guint64
+gst_droid_codec_stats_get (guint64 * counter)
+{
+  return __atomic_load_n (counter, __ATOMIC_RELAXED);
+}
+
+static void
+gst_droid_codec_stats_max (guint64 * counter, guint64 value)
+{
+  guint64 old = gst_droid_codec_stats_get (counter);
+
+  while (value > old && !__atomic_compare_exchange_n (counter, &old, value,
+          TRUE, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+/* a frame handed to the component, see comp->frames */
+typedef struct
+{
+  guint32 number;
+  /* monotonic time in us */
+  gint64 submitted;
+} GstDroidCodecTrackedFrame;
+
+static void
+gst_droid_codec_free_tracked_frame (GstDroidCodecTrackedFrame * tracked)
+{
+  g_slice_free (GstDroidCodecTrackedFrame, tracked);
+}
+
+static void
+gst_droid_codec_free_tracked_frames (GQueue * queue)
+{
+  g_queue_free_full (queue,
+      (GDestroyNotify) gst_droid_codec_free_tracked_frame);
+}
+
 static OMX_ERRORTYPE
 EventHandler (OMX_HANDLETYPE hComponent, OMX_PTR pAppData, OMX_EVENTTYPE eEvent,
     OMX_U32 nData1, OMX_U32 nData2, OMX_PTR pEventData)
@@ -91,7 +205,10 @@ EventHandler (OMX_HANDLETYPE hComponent, OMX_PTR pAppData, OMX_EVENTTYPE eEvent,
       if (nData1 == OMX_CommandStateSet) {
         GST_INFO_OBJECT (comp->parent, "component reached state %s",
             gst_omx_state_to_string (nData2));
-        g_atomic_int_set (&comp->state, nData2);
+        g_mutex_lock (&comp->lock);
+        comp->state = nData2;
+        g_cond_broadcast (&comp->state_cond);
+        g_mutex_unlock (&comp->lock);
       }
 
       break;
@@ -99,9 +216,13 @@ EventHandler (OMX_HANDLETYPE hComponent, OMX_PTR pAppData, OMX_EVENTTYPE eEvent,
       if (nData1 != OMX_ErrorNone) {
         GST_ERROR_OBJECT (comp->parent, "error %s from omx",
             gst_omx_error_to_string (nData1));
+        gst_droid_codec_stats_add (&comp->stats.errors, 1);
         g_mutex_lock (&comp->lock);
         comp->error = TRUE;
+        /* nobody should wait for a state change anymore */
+        g_cond_broadcast (&comp->state_cond);
         g_mutex_unlock (&comp->lock);
+        gst_droid_codec_wake_input (comp);
       }
 
       break;
@@ -112,6 +233,12 @@ EventHandler (OMX_HANDLETYPE hComponent, OMX_PTR pAppData, OMX_EVENTTYPE eEvent,
         g_mutex_lock (&comp->lock);
         comp->error = TRUE;
         g_mutex_unlock (&comp->lock);
+      } else if (nData2 == OMX_IndexConfigCommonOutputCrop) {
+        /* buffers stay as they are. */
+        GST_INFO_OBJECT (comp->parent, "output crop changed");
+        g_mutex_lock (&comp->lock);
+        comp->crop_changed = TRUE;
+        g_mutex_unlock (&comp->lock);
       } else {
         GST_INFO_OBJECT (comp->parent, "component needs to be reconfigured");
         g_mutex_lock (&comp->lock);
@@ -119,6 +246,8 @@ EventHandler (OMX_HANDLETYPE hComponent, OMX_PTR pAppData, OMX_EVENTTYPE eEvent,
         g_mutex_unlock (&comp->lock);
       }
 
+      gst_droid_codec_wake_input (comp);
+
       break;
     case OMX_EventPortFormatDetected:
       g_print ("OMX_EventPortFormatDetected\n");
@@ -154,10 +283,14 @@ EmptyBufferDone (OMX_HANDLETYPE hComponent, OMX_PTR pAppPrivate,
   pBuffer->nFilledLen = 0;
   pBuffer->nOffset = 0;
   pBuffer->nFlags = 0;
+  pBuffer->pAppPrivate = NULL;
 
   if (buffer) {
     GST_DEBUG ("buffer %p emptied and being returned", buffer);
     gst_buffer_unref (buffer);
+
+    /* the buffer is back in the pool */
+    gst_droid_codec_wake_input (comp);
   }
 
   return OMX_ErrorNone;
@@ -173,10 +306,28 @@ FillBufferDone (OMX_HANDLETYPE hComponent, OMX_PTR pAppData,
 
   GST_DEBUG_OBJECT (comp->parent, "fillBufferDone %p", pBuffer);
 
-  g_mutex_lock (&comp->full_lock);
-  g_queue_push_tail (comp->full, pBuffer);
-  g_cond_signal (&comp->full_cond);
-  g_mutex_unlock (&comp->full_lock);
+  if (pBuffer->nFilledLen > 0
+      && !(pBuffer->nFlags & OMX_BUFFERFLAG_CODECCONFIG)) {
+    gst_droid_codec_stats_add (&comp->stats.frames_finished, 1);
+    gst_droid_codec_stats_add (&comp->stats.bytes_out, pBuffer->nFilledLen);
+  }
+
+  if (!gst_droid_codec_ring_push (comp->full, pBuffer)) {
+    /* The ring holds every output buffer so this means the component
+     * returned one twice. Do not lose the buffer, the pool gets it back and
+     * gst_droid_codec_return_output_buffers () hands it out again */
+    GST_ERROR_OBJECT (comp->parent, "no room for output buffer %p", pBuffer);
+
+    if (pBuffer->pAppPrivate) {
+      GstBuffer *buffer = pBuffer->pAppPrivate;
+
+      pBuffer->pAppPrivate = NULL;
+      gst_buffer_unref (buffer);
+    }
+  }
+
+  gst_droid_codec_stats_max (&comp->stats.full_depth_max,
+      gst_droid_codec_ring_length (comp->full));
 
   return OMX_ErrorNone;
 }
@@ -227,85 +378,71 @@ gst_droid_codec_create_and_insert_handle_locked (GstDroidCodec * codec,
     const gchar * type)
 {
   OMX_ERRORTYPE err;
-  gboolean res;
-  gchar *path = NULL;
-  GKeyFile *file = NULL;
-  gchar *core_path = NULL;
-  int in_port = 0;
-  int out_port = 0;
-  gchar *name = NULL;
-  gchar *role = NULL;
+  const GstDroidCodecInfo *info;
   GstDroidCodecHandle *handle = NULL;
-  gboolean is_decoder;
-  GError *error = NULL;
 
   GST_DEBUG ("create and insert handle locked");
 
-  file = g_key_file_new ();
-  path = gst_droid_codec_type_get_path (type);
-
-  /* read info from configuration */
-  res = g_key_file_load_from_file (file, path, 0, &error);
-  if (!res) {
-    GST_ERROR ("error %s reading %s", error->message, path);
-    goto error;
-  }
-
-  core_path = g_key_file_get_string (file, "droidcodec", "core", &error);
-  if (!core_path) {
-    GST_ERROR ("error %s reading %s", error->message, path);
-    goto error;
-  }
-
-  name = g_key_file_get_string (file, "droidcodec", "component", &error);
-  if (!name) {
-    GST_ERROR ("error %s reading %s", error->message, path);
-    goto error;
-  }
-
-  is_decoder = gst_droid_codec_type_get_type (type) == GST_DROID_CODEC_DECODER;
-
-  role = g_key_file_get_string (file, "droidcodec", "role", &error);
-  if (!role) {
-    GST_ERROR ("error %s reading %s", error->message, path);
-    goto error;
-  }
-
-  in_port = g_key_file_get_integer (file, "droidcodec", "in-port", &error);
-  if (error) {
-    GST_ERROR ("error %s reading %s", error->message, path);
-    goto error;
-  }
-
-  out_port = g_key_file_get_integer (file, "droidcodec", "out-port", &error);
-  if (error) {
-    GST_ERROR ("error %s reading %s", error->message, path);
-  }
-
-  if (in_port == out_port) {
-    GST_ERROR ("in port and out port can not be equal");
-    goto error;
+  info = gst_droid_codec_registry_lookup (type);
+  if (!info) {
+    GST_ERROR ("no configuration for codec %s", type);
+    return NULL;
   }
 
   handle = g_slice_new0 (GstDroidCodecHandle);
   handle->count = 1;
   handle->type = g_strdup (type);
-  handle->role = g_strdup (role);
-  handle->name = g_strdup (name);
-  handle->in_port = in_port;
-  handle->out_port = out_port;
-  handle->is_decoder = is_decoder;
-  handle->handle = android_dlopen (core_path, RTLD_NOW);
+  handle->role = g_strdup (info->role);
+  handle->name = g_strdup (info->component);
+  handle->in_port = info->in_port;
+  handle->out_port = info->out_port;
+  handle->state_timeout = info->state_timeout;
+  handle->warm_components = info->warm_components;
+  handle->idle_timeout = info->idle_timeout;
+  handle->max_width = info->max_width;
+  handle->max_height = info->max_height;
+  if (handle->max_width == 0) {
+    handle->max_width = DEFAULT_MAX_WIDTH;
+    handle->max_height = DEFAULT_MAX_HEIGHT;
+  }
+  handle->is_image =
+      gst_droid_codec_type_get_type (type) == GST_DROID_CODEC_DECODER_IMAGE;
+  handle->is_decoder =
+      gst_droid_codec_type_get_type (type) == GST_DROID_CODEC_DECODER
+      || handle->is_image;
+  handle->is_audio =
+      gst_droid_codec_type_get_type (type) == GST_DROID_CODEC_DECODER_AUDIO
+      || gst_droid_codec_type_get_type (type) == GST_DROID_CODEC_ENCODER_AUDIO;
+#ifdef ENABLE_MOCK_CORE
+  if (info->host_core) {
+    handle->handle = dlopen (info->core, RTLD_NOW);
+  } else {
+    handle->handle = android_dlopen (info->core, RTLD_NOW);
+  }
+#else
+  handle->handle = android_dlopen (info->core, RTLD_NOW);
+#endif
+
   if (!handle->handle) {
-    GST_ERROR ("error loading core %s", core_path);
+    GST_ERROR ("error loading core %s", info->core);
     goto error;
   }
 
   /* dlsym */
-  handle->init = android_dlsym (handle->handle, "OMX_Init");
-  handle->deinit = android_dlsym (handle->handle, "OMX_Deinit");
-  handle->get_handle = android_dlsym (handle->handle, "OMX_GetHandle");
-  handle->free_handle = android_dlsym (handle->handle, "OMX_FreeHandle");
+#ifdef ENABLE_MOCK_CORE
+  if (info->host_core) {
+    handle->init = dlsym (handle->handle, "OMX_Init");
+    handle->deinit = dlsym (handle->handle, "OMX_Deinit");
+    handle->get_handle = dlsym (handle->handle, "OMX_GetHandle");
+    handle->free_handle = dlsym (handle->handle, "OMX_FreeHandle");
+  } else
+#endif
+  {
+    handle->init = android_dlsym (handle->handle, "OMX_Init");
+    handle->deinit = android_dlsym (handle->handle, "OMX_Deinit");
+    handle->get_handle = android_dlsym (handle->handle, "OMX_GetHandle");
+    handle->free_handle = android_dlsym (handle->handle, "OMX_FreeHandle");
+  }
 
   if (!handle->init) {
     GST_ERROR ("OMX_Init not found");
@@ -338,51 +475,104 @@ gst_droid_codec_create_and_insert_handle_locked (GstDroidCodec * codec,
 
   GST_DEBUG ("created handle %p", handle);
 
-  g_free (path);
-  g_free (core_path);
-  g_free (name);
-  g_free (role);
-  g_key_file_unref (file);
-
   return handle;
 
 error:
-  if (error) {
-    g_error_free (error);
-  }
+  /* unset deinit to prevent calling it from _destroy_handle */
+  handle->deinit = NULL;
+  gst_droid_codec_destroy_handle (handle);
+  return NULL;
+}
+
+static GstDroidCodecBudget *
+gst_droid_codec_get_budget_locked (GstDroidCodec * codec,
+    const GstDroidCodecInfo * info)
+{
+  GstDroidCodecBudget *budget = g_hash_table_lookup (codec->budgets,
+      info->core);
 
-  if (file) {
-    g_key_file_unref (file);
+  if (!budget) {
+    budget = g_slice_new0 (GstDroidCodecBudget);
+    g_hash_table_insert (codec->budgets, g_strdup (info->core), budget);
   }
 
-  if (path) {
-    g_free (path);
+  /* all codecs sharing a core share its budget. The lowest limit wins */
+  if (info->max_instances > 0 && (budget->max == 0
+          || info->max_instances < budget->max)) {
+    budget->max = info->max_instances;
   }
 
-  if (name) {
-    g_free (name);
+  return budget;
+}
+
+static void
+gst_droid_codec_destroy_budget (GstDroidCodecBudget * budget)
+{
+  g_list_free (budget->waiters);
+  g_slice_free (GstDroidCodecBudget, budget);
+}
+
+static void
+gst_droid_codec_release_locked (GstDroidCodec * codec, const gchar * type)
+{
+  const GstDroidCodecInfo *info = gst_droid_codec_registry_lookup (type);
+  GstDroidCodecBudget *budget;
+
+  if (!info) {
+    return;
   }
 
-  if (core_path) {
-    g_free (core_path);
+  budget = g_hash_table_lookup (codec->budgets, info->core);
+  if (budget && budget->active > 0) {
+    budget->active--;
+    g_cond_broadcast (&codec->budget_cond);
   }
+}
 
-  if (role) {
-    g_free (role);
+static void
+gst_droid_codec_component_unref (GstDroidComponent * component)
+{
+  if (!g_atomic_int_dec_and_test (&component->refcount)) {
+    return;
   }
 
-  /* unset deinit to prevent calling it from _destroy_handle */
-  handle->deinit = NULL;
-  gst_droid_codec_destroy_handle (handle);
-  return NULL;
+  g_mutex_clear (&component->lock);
+  g_cond_clear (&component->wrapped_cond);
+  g_slice_free (GstDroidComponent, component);
 }
 
-void
-gst_droid_codec_destroy_component (GstDroidComponent * component)
+static void gst_droid_codec_unload_component (GstDroidComponent * comp);
+
+static void
+gst_droid_codec_free_component (GstDroidComponent * component,
+    gboolean unref_codec)
 {
   OMX_ERRORTYPE err;
+  GstDroidCodec *codec = component->codec;
 
-  GST_DEBUG_OBJECT (component->parent, "destroy component %p", component);
+  GST_DEBUG_OBJECT (component->parent, "free component %p", component);
+
+  /* released wrapped buffers must not touch the handle anymore */
+  g_mutex_lock (&component->lock);
+  component->started = FALSE;
+  component->out_generation++;
+
+  /* their memory belongs to the component */
+  if (component->wrapped > 0) {
+    GST_INFO_OBJECT (component->parent,
+        "downstream holds %u output buffers, freeing the component later",
+        component->wrapped);
+    component->orphaned = TRUE;
+    component->orphan_unref_codec = unref_codec;
+    g_mutex_unlock (&component->lock);
+    return;
+  }
+
+  g_mutex_unlock (&component->lock);
+
+  if (component->unload_pending) {
+    gst_droid_codec_unload_component (component);
+  }
 
   if (component->omx) {
     err = component->handle->free_handle (component->omx);
@@ -394,7 +584,9 @@ gst_droid_codec_destroy_component (GstDroidComponent * component)
   }
 
   /* Let's take care of the handle */
-  g_mutex_lock (&component->codec->lock);
+  g_mutex_lock (&codec->lock);
+
+  gst_droid_codec_release_locked (codec, component->handle->type);
 
   if (component->handle->count > 1) {
     component->handle->count--;
@@ -402,107 +594,162 @@ gst_droid_codec_destroy_component (GstDroidComponent * component)
     g_hash_table_remove (codec->cores, component->handle->type);
   }
 
-  g_mutex_unlock (&component->codec->lock);
+  g_mutex_unlock (&codec->lock);
 
   /* free */
-  gst_mini_object_unref (GST_MINI_OBJECT (component->codec));
-  g_mutex_clear (&component->lock);
-  g_queue_free (component->full);
-  g_mutex_clear (&component->full_lock);
-  g_cond_clear (&component->full_cond);
+  if (unref_codec) {
+    gst_mini_object_unref (GST_MINI_OBJECT (codec));
+  }
+
+  g_cond_clear (&component->state_cond);
+  if (component->full) {
+    gst_droid_codec_ring_free (component->full);
+  }
+  g_hash_table_unref (component->frames);
+  g_mutex_clear (&component->empty_lock);
+  g_cond_clear (&component->empty_cond);
   g_slice_free (GstDroidComponentPort, component->in_port);
   g_slice_free (GstDroidComponentPort, component->out_port);
-  g_slice_free (GstDroidComponent, component);
+
+  gst_droid_codec_component_unref (component);
 }
 
-static gboolean
-gst_droid_codec_enable_android_native_buffers (GstDroidComponent * comp,
-    GstDroidComponentPort * port)
+void
+gst_droid_codec_destroy_component (GstDroidComponent * component)
 {
-  OMX_ERRORTYPE err;
-  OMX_INDEXTYPE extension;
-  struct EnableAndroidNativeBuffersParams param;
-  struct GetAndroidNativeBufferUsageParams usage_param;
-  OMX_STRING ext1 = "OMX.google.android.index.enableAndroidNativeBuffers2";
-  OMX_STRING ext2 = "OMX.google.android.index.getAndroidNativeBufferUsage";
+  GST_DEBUG_OBJECT (component->parent, "destroy component %p", component);
 
-  GST_DEBUG_OBJECT (comp->parent, "enable android native buffers");
+  gst_droid_codec_free_component (component, TRUE);
+}
 
-  /* enable */
-  err = OMX_GetExtensionIndex (comp->omx, ext1, &extension);
+static GstDroidCodecPool *
+gst_droid_codec_get_pool_locked (GstDroidCodec * codec, const gchar * type)
+{
+  GstDroidCodecPool *pool = g_hash_table_lookup (codec->pools, type);
 
-  if (err != OMX_ErrorNone) {
-    GST_ERROR_OBJECT (comp->parent,
-        "got error %s (0x%08x) while getting extension %s index",
-        gst_omx_error_to_string (err), err, ext1);
-    return FALSE;
+  if (!pool) {
+    pool = g_slice_new0 (GstDroidCodecPool);
+    pool->idle = g_queue_new ();
+    g_hash_table_insert (codec->pools, g_strdup (type), pool);
   }
 
-  GST_OMX_INIT_STRUCT (&param);
-  param.nPortIndex = port->def.nPortIndex;
-  param.enable = OMX_TRUE;
-  err = gst_droid_codec_set_param (comp, extension, &param);
-  if (err != OMX_ErrorNone) {
-    GST_ERROR_OBJECT (comp->parent,
-        "got error %s (0x%08x) while enabling android buffers",
-        gst_omx_error_to_string (err), err);
-    return FALSE;
-  }
+  return pool;
+}
 
-  /* get usage for gralloc allocation */
-  err = OMX_GetExtensionIndex (comp->omx, ext2, &extension);
+static void
+gst_droid_codec_destroy_pool (GstDroidCodecPool * pool)
+{
+  /* idle components are freed by gst_droid_codec_free () */
+  g_queue_free (pool->idle);
+  g_slice_free (GstDroidCodecPool, pool);
+}
 
-  if (err != OMX_ErrorNone) {
-    GST_ERROR_OBJECT (comp->parent,
-        "got error %s (0x%08x) while getting extension %s index",
-        gst_omx_error_to_string (err), err, ext1);
-    return FALSE;
+/* idle components which have not been used for a while are returned to the
+ * caller to be freed without holding the lock */
+static GList *
+gst_droid_codec_evict_idle_locked (GstDroidCodec * codec)
+{
+  GHashTableIter iter;
+  GstDroidCodecPool *pool;
+  GstDroidComponent *comp;
+  GList *evicted = NULL;
+  gint64 now = g_get_monotonic_time ();
+
+  g_hash_table_iter_init (&iter, codec->pools);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *) & pool)) {
+    /* the oldest are at the tail */
+    while ((comp = g_queue_peek_tail (pool->idle))) {
+      if (now - comp->idle_since <
+          comp->handle->idle_timeout * G_TIME_SPAN_SECOND) {
+        break;
+      }
+
+      g_queue_pop_tail (pool->idle);
+      pool->evictions++;
+      evicted = g_list_prepend (evicted, comp);
+    }
   }
 
-  GST_OMX_INIT_STRUCT (&usage_param);
-  usage_param.nPortIndex = port->def.nPortIndex;
-  err = gst_droid_codec_get_param (comp, extension, &param);
-  if (err != OMX_ErrorNone) {
-    GST_ERROR_OBJECT (comp->parent,
-        "got error %s (0x%08x) while getting native buffer usage",
-        gst_omx_error_to_string (err), err);
-    return FALSE;
+  return evicted;
+}
+
+/* Idle components hold an instance each. Give up the oldest one running
+ * on core so a new component can be created. */
+static GList *
+gst_droid_codec_evict_core_locked (GstDroidCodec * codec, const gchar * core)
+{
+  GHashTableIter iter;
+  const gchar *type;
+  GstDroidCodecPool *pool;
+  GstDroidComponent *comp;
+
+  g_hash_table_iter_init (&iter, codec->pools);
+  while (g_hash_table_iter_next (&iter, (gpointer *) & type,
+          (gpointer *) & pool)) {
+    const GstDroidCodecInfo *info = gst_droid_codec_registry_lookup (type);
+
+    if (!info || g_strcmp0 (info->core, core)) {
+      continue;
+    }
+
+    comp = g_queue_pop_tail (pool->idle);
+    if (comp) {
+      pool->evictions++;
+      return g_list_prepend (NULL, comp);
+    }
   }
 
-  port->usage = usage_param.nUsage;
+  return NULL;
+}
 
-  return TRUE;
+static void
+gst_droid_codec_free_evicted (GList * evicted)
+{
+  GList *iter;
+
+  for (iter = evicted; iter; iter = iter->next) {
+    GST_DEBUG ("evicting idle component %p", iter->data);
+    gst_droid_codec_free_component (iter->data, FALSE);
+  }
+
+  g_list_free (evicted);
 }
 
 static gboolean
-gst_droid_codec_enable_metadata_in_buffers (GstDroidComponent * comp,
-    GstDroidComponentPort * port)
+gst_droid_codec_reset_component (GstDroidComponent * comp, GstElement * parent)
 {
   OMX_ERRORTYPE err;
-  OMX_INDEXTYPE extension;
-  struct StoreMetaDataInBuffersParams param;
-  OMX_STRING ext = "OMX.google.android.index.storeMetaDataInBuffers";
 
-  GST_DEBUG_OBJECT (comp->parent, "enable metadata in buffers");
+  comp->parent = parent;
 
-  err = OMX_GetExtensionIndex (comp->omx, ext, &extension);
+  g_mutex_lock (&comp->lock);
+  comp->error = FALSE;
+  comp->needs_reconfigure = FALSE;
+  comp->crop_changed = FALSE;
+  comp->nal_length_size = 0;
+  comp->share_input = FALSE;
+  comp->started = FALSE;
+  g_hash_table_remove_all (comp->frames);
+  memset (&comp->stats, 0, sizeof (comp->stats));
+  g_mutex_unlock (&comp->lock);
 
+  /* The previous user might have changed the port definitions */
+  err =
+      gst_droid_codec_get_param (comp, OMX_IndexParamPortDefinition,
+      &comp->in_port->def);
   if (err != OMX_ErrorNone) {
     GST_ERROR_OBJECT (comp->parent,
-        "got error %s (0x%08x) while getting extension %s index",
-        gst_omx_error_to_string (err), err, ext);
-
+        "got error %s (0x%08x) getting input port definition",
+        gst_omx_error_to_string (err), err);
     return FALSE;
   }
 
-  GST_OMX_INIT_STRUCT (&param);
-  param.nPortIndex = port->def.nPortIndex;
-  param.bStoreMetaData = OMX_TRUE;
-
-  err = gst_droid_codec_set_param (comp, extension, &param);
+  err =
+      gst_droid_codec_get_param (comp, OMX_IndexParamPortDefinition,
+      &comp->out_port->def);
   if (err != OMX_ErrorNone) {
     GST_ERROR_OBJECT (comp->parent,
-        "got error %s (0x%08x) while enabling metadata",
+        "got error %s (0x%08x) getting output port definition",
         gst_omx_error_to_string (err), err);
     return FALSE;
   }
@@ -510,28 +757,431 @@ gst_droid_codec_enable_metadata_in_buffers (GstDroidComponent * comp,
   return TRUE;
 }
 
-GstDroidComponent *
-gst_droid_codec_get_component (GstDroidCodec * codec, const gchar * type,
-    GstElement * parent)
+void
+gst_droid_codec_put_component (GstDroidComponent * component)
 {
-  GstDroidComponent *component = NULL;
-  GstDroidCodecHandle *handle;
-  OMX_ERRORTYPE err;
-  if (!codec) {
-    return NULL;
+  GstDroidCodec *codec = component->codec;
+  GstDroidCodecPool *pool;
+  GList *evicted;
+  gboolean reuse;
+
+  GST_DEBUG_OBJECT (component->parent, "put component %p", component);
+
+  /* only components which have been stopped cleanly can be reused */
+  g_mutex_lock (&component->lock);
+  reuse = !component->error && !component->started
+      && component->state == OMX_StateLoaded;
+  g_mutex_unlock (&component->lock);
+
+  if (reuse) {
+    reuse = component->in_port->buffers == NULL
+        && component->out_port->buffers == NULL;
   }
 
   g_mutex_lock (&codec->lock);
 
-  if (g_hash_table_contains (codec->cores, type)) {
-    handle = (GstDroidCodecHandle *) g_hash_table_lookup (codec->cores, type);
-    handle->count++;
+  evicted = gst_droid_codec_evict_idle_locked (codec);
+
+  pool = gst_droid_codec_get_pool_locked (codec, component->handle->type);
+  if (reuse && pool->idle->length < component->handle->warm_components) {
+    component->parent = NULL;
+    component->idle_since = g_get_monotonic_time ();
+    g_queue_push_head (pool->idle, component);
+    /* a waiter can take its instance */
+    g_cond_broadcast (&codec->budget_cond);
   } else {
-    handle = gst_droid_codec_create_and_insert_handle_locked (codec, type);
-    if (!handle) {
-      GST_ERROR_OBJECT (parent, "error getting codec %s", type);
-      goto error;
-    }
+    reuse = FALSE;
+  }
+
+  g_mutex_unlock (&codec->lock);
+
+  gst_droid_codec_free_evicted (evicted);
+
+  if (!reuse) {
+    gst_droid_codec_destroy_component (component);
+    return;
+  }
+
+  GST_INFO ("keeping idle component %p for reuse", component);
+
+  /* Idle components do not keep the codec alive. gst_droid_codec_free ()
+   * takes care of them */
+  gst_mini_object_unref (GST_MINI_OBJECT (codec));
+}
+
+static gint
+gst_droid_codec_compare_waiters (gconstpointer a, gconstpointer b)
+{
+  /* higher priority first. Equal priorities are served in order */
+  return *(const gint *) a <= *(const gint *) b ? 1 : -1;
+}
+
+/* Reserves an instance on the core type runs on. A negative timeout (ms)
+ * waits forever and 0 does not wait at all */
+static gboolean
+gst_droid_codec_admit (GstDroidCodec * codec, const gchar * type,
+    GstElement * parent, gint priority, gint timeout)
+{
+  const GstDroidCodecInfo *info = gst_droid_codec_registry_lookup (type);
+  GstDroidCodecBudget *budget;
+  GList *evicted;
+  gint64 deadline;
+  gboolean waited = FALSE;
+  gint waiter = priority;
+
+  if (!info) {
+    /* creating the handle will fail later */
+    return TRUE;
+  }
+
+  deadline = g_get_monotonic_time () + timeout * G_TIME_SPAN_MILLISECOND;
+
+  g_mutex_lock (&codec->lock);
+
+  budget = gst_droid_codec_get_budget_locked (codec, info);
+  budget->waiters = g_list_insert_sorted (budget->waiters, &waiter,
+      gst_droid_codec_compare_waiters);
+
+  while (budget->max > 0 && (budget->active >= budget->max
+          || budget->waiters->data != &waiter)) {
+    /* Components can be parked while we wait. The first waiter takes the
+     * instance of an idle one */
+    if (budget->waiters->data == &waiter) {
+      evicted = gst_droid_codec_evict_core_locked (codec, info->core);
+      if (evicted) {
+        g_mutex_unlock (&codec->lock);
+        /* this gives their instances back */
+        gst_droid_codec_free_evicted (evicted);
+        g_mutex_lock (&codec->lock);
+        continue;
+      }
+    }
+
+    if (timeout == 0) {
+      goto refused;
+    }
+
+    if (!waited) {
+      GST_INFO_OBJECT (parent, "waiting for an instance of %s (priority %d)",
+          info->core, priority);
+      waited = TRUE;
+      budget->waits++;
+    }
+
+    if (timeout < 0) {
+      g_cond_wait (&codec->budget_cond, &codec->lock);
+    } else if (!g_cond_wait_until (&codec->budget_cond, &codec->lock,
+            deadline)) {
+      goto refused;
+    }
+  }
+
+  budget->waiters = g_list_remove (budget->waiters, &waiter);
+  budget->active++;
+  budget->peak = MAX (budget->peak, budget->active);
+  budget->admitted++;
+
+  GST_DEBUG_OBJECT (parent, "%d of %d instances of %s in use",
+      budget->active, budget->max, info->core);
+
+  /* the next waiter might fit too */
+  g_cond_broadcast (&codec->budget_cond);
+  g_mutex_unlock (&codec->lock);
+
+  return TRUE;
+
+refused:
+  budget->waiters = g_list_remove (budget->waiters, &waiter);
+  budget->refused++;
+
+  GST_WARNING_OBJECT (parent,
+      "no instance of %s available for %s (%d of %d in use, priority %d)",
+      info->core, type, budget->active, budget->max, priority);
+
+  g_cond_broadcast (&codec->budget_cond);
+  g_mutex_unlock (&codec->lock);
+
+  return FALSE;
+}
+
+GstStructure *
+gst_droid_codec_get_instance_stats (GstDroidCodec * codec)
+{
+  GHashTableIter iter;
+  const gchar *core;
+  GstDroidCodecBudget *budget;
+  GstStructure *s = gst_structure_new_empty ("droid-codec-instance-stats");
+
+  g_mutex_lock (&codec->lock);
+
+  g_hash_table_iter_init (&iter, codec->budgets);
+  while (g_hash_table_iter_next (&iter, (gpointer *) & core,
+          (gpointer *) & budget)) {
+    gchar *name = g_path_get_basename (core);
+    GstStructure *b = gst_structure_new (name,
+        "max", G_TYPE_INT, budget->max,
+        "active", G_TYPE_INT, budget->active,
+        "peak", G_TYPE_INT, budget->peak,
+        "waiting", G_TYPE_UINT, g_list_length (budget->waiters),
+        "admitted", G_TYPE_UINT, budget->admitted,
+        "waits", G_TYPE_UINT, budget->waits,
+        "refused", G_TYPE_UINT, budget->refused, NULL);
+
+    gst_structure_set (s, name, GST_TYPE_STRUCTURE, b, NULL);
+    gst_structure_free (b);
+    g_free (name);
+  }
+
+  g_mutex_unlock (&codec->lock);
+
+  return s;
+}
+
+GstStructure *
+gst_droid_codec_get_pool_stats (GstDroidCodec * codec)
+{
+  GHashTableIter iter;
+  const gchar *type;
+  GstDroidCodecPool *pool;
+  GstStructure *s = gst_structure_new_empty ("droid-codec-pool-stats");
+
+  g_mutex_lock (&codec->lock);
+
+  g_hash_table_iter_init (&iter, codec->pools);
+  while (g_hash_table_iter_next (&iter, (gpointer *) & type,
+          (gpointer *) & pool)) {
+    GstStructure *p = gst_structure_new (type,
+        "idle", G_TYPE_UINT, pool->idle->length,
+        "hits", G_TYPE_UINT, pool->hits,
+        "misses", G_TYPE_UINT, pool->misses,
+        "evictions", G_TYPE_UINT, pool->evictions, NULL);
+
+    gst_structure_set (s, type, GST_TYPE_STRUCTURE, p, NULL);
+    gst_structure_free (p);
+  }
+
+  g_mutex_unlock (&codec->lock);
+
+  return s;
+}
+
+static gboolean
+gst_droid_codec_enable_android_native_buffers (GstDroidComponent * comp,
+    GstDroidComponentPort * port)
+{
+  OMX_ERRORTYPE err;
+  OMX_INDEXTYPE extension;
+  struct EnableAndroidNativeBuffersParams param;
+  struct GetAndroidNativeBufferUsageParams usage_param;
+  OMX_STRING ext1 = "OMX.google.android.index.enableAndroidNativeBuffers2";
+  OMX_STRING ext2 = "OMX.google.android.index.getAndroidNativeBufferUsage";
+
+  GST_DEBUG_OBJECT (comp->parent, "enable android native buffers");
+
+  /* enable */
+  err = OMX_GetExtensionIndex (comp->omx, ext1, &extension);
+
+  if (err != OMX_ErrorNone) {
+    GST_ERROR_OBJECT (comp->parent,
+        "got error %s (0x%08x) while getting extension %s index",
+        gst_omx_error_to_string (err), err, ext1);
+    return FALSE;
+  }
+
+  GST_OMX_INIT_STRUCT (&param);
+  param.nPortIndex = port->def.nPortIndex;
+  param.enable = OMX_TRUE;
+  err = gst_droid_codec_set_param (comp, extension, &param);
+  if (err != OMX_ErrorNone) {
+    GST_ERROR_OBJECT (comp->parent,
+        "got error %s (0x%08x) while enabling android buffers",
+        gst_omx_error_to_string (err), err);
+    return FALSE;
+  }
+
+  /* get usage for gralloc allocation */
+  err = OMX_GetExtensionIndex (comp->omx, ext2, &extension);
+
+  if (err != OMX_ErrorNone) {
+    GST_ERROR_OBJECT (comp->parent,
+        "got error %s (0x%08x) while getting extension %s index",
+        gst_omx_error_to_string (err), err, ext1);
+    return FALSE;
+  }
+
+  GST_OMX_INIT_STRUCT (&usage_param);
+  usage_param.nPortIndex = port->def.nPortIndex;
+  err = gst_droid_codec_get_param (comp, extension, &param);
+  if (err != OMX_ErrorNone) {
+    GST_ERROR_OBJECT (comp->parent,
+        "got error %s (0x%08x) while getting native buffer usage",
+        gst_omx_error_to_string (err), err);
+    return FALSE;
+  }
+
+  port->usage = usage_param.nUsage;
+
+  return TRUE;
+}
+
+static void
+gst_droid_codec_enable_adaptive_playback (GstDroidComponent * comp,
+    GstDroidComponentPort * port)
+{
+  OMX_ERRORTYPE err;
+  OMX_INDEXTYPE extension;
+  struct PrepareForAdaptivePlaybackParams param;
+  OMX_STRING ext = "OMX.google.android.index.prepareForAdaptivePlayback";
+
+  /* not fatal. We will just reconfigure the port upon resolution changes */
+  err = OMX_GetExtensionIndex (comp->omx, ext, &extension);
+  if (err != OMX_ErrorNone) {
+    GST_INFO_OBJECT (comp->parent,
+        "got error %s (0x%08x) while getting extension %s index",
+        gst_omx_error_to_string (err), err, ext);
+    return;
+  }
+
+  GST_OMX_INIT_STRUCT (&param);
+  param.nPortIndex = port->def.nPortIndex;
+  param.bEnable = OMX_TRUE;
+  param.nMaxFrameWidth = comp->handle->max_width;
+  param.nMaxFrameHeight = comp->handle->max_height;
+
+  err = gst_droid_codec_set_param (comp, extension, &param);
+  if (err != OMX_ErrorNone) {
+    GST_INFO_OBJECT (comp->parent,
+        "got error %s (0x%08x) while enabling adaptive playback",
+        gst_omx_error_to_string (err), err);
+    return;
+  }
+
+  GST_DEBUG_OBJECT (comp->parent, "adaptive playback enabled up to %lux%lu",
+      param.nMaxFrameWidth, param.nMaxFrameHeight);
+
+  comp->adaptive = TRUE;
+}
+
+static gboolean
+gst_droid_codec_enable_metadata_in_buffers (GstDroidComponent * comp,
+    GstDroidComponentPort * port)
+{
+  OMX_ERRORTYPE err;
+  OMX_INDEXTYPE extension;
+  struct StoreMetaDataInBuffersParams param;
+  OMX_STRING ext = "OMX.google.android.index.storeMetaDataInBuffers";
+
+  GST_DEBUG_OBJECT (comp->parent, "enable metadata in buffers");
+
+  err = OMX_GetExtensionIndex (comp->omx, ext, &extension);
+
+  if (err != OMX_ErrorNone) {
+    GST_ERROR_OBJECT (comp->parent,
+        "got error %s (0x%08x) while getting extension %s index",
+        gst_omx_error_to_string (err), err, ext);
+
+    return FALSE;
+  }
+
+  GST_OMX_INIT_STRUCT (&param);
+  param.nPortIndex = port->def.nPortIndex;
+  param.bStoreMetaData = OMX_TRUE;
+
+  err = gst_droid_codec_set_param (comp, extension, &param);
+  if (err != OMX_ErrorNone) {
+    GST_ERROR_OBJECT (comp->parent,
+        "got error %s (0x%08x) while enabling metadata",
+        gst_omx_error_to_string (err), err);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+GstDroidComponent *
+gst_droid_codec_get_component (GstDroidCodec * codec, const gchar * type,
+    GstElement * parent)
+{
+  return gst_droid_codec_get_component_full (codec, type, parent, 0, 0);
+}
+
+GstDroidComponent *
+gst_droid_codec_get_component_full (GstDroidCodec * codec, const gchar * type,
+    GstElement * parent, gint priority, gint timeout)
+{
+  GstDroidComponent *component = NULL;
+  GstDroidCodecPool *pool;
+  GList *evicted;
+
+  if (!codec) {
+    return NULL;
+  }
+
+  g_mutex_lock (&codec->lock);
+
+  evicted = gst_droid_codec_evict_idle_locked (codec);
+
+  pool = gst_droid_codec_get_pool_locked (codec, type);
+  component = g_queue_pop_head (pool->idle);
+  if (component) {
+    pool->hits++;
+    component->codec =
+        (GstDroidCodec *) gst_mini_object_ref (GST_MINI_OBJECT (codec));
+  } else {
+    pool->misses++;
+  }
+
+  GST_INFO_OBJECT (parent, "component pool for %s: %u hits, %u misses",
+      type, pool->hits, pool->misses);
+
+  g_mutex_unlock (&codec->lock);
+
+  gst_droid_codec_free_evicted (evicted);
+
+  if (component) {
+    if (gst_droid_codec_reset_component (component, parent)) {
+      GST_DEBUG_OBJECT (parent, "reusing idle component %p", component);
+      return component;
+    }
+
+    gst_droid_codec_destroy_component (component);
+  }
+
+  /* we need a new instance */
+  return gst_droid_codec_create_component (codec, type, parent, priority,
+      timeout);
+}
+
+/* Like gst_droid_codec_get_component_full () but never takes a component
+ * from the idle pool */
+GstDroidComponent *
+gst_droid_codec_create_component (GstDroidCodec * codec, const gchar * type,
+    GstElement * parent, gint priority, gint timeout)
+{
+  GstDroidComponent *component = NULL;
+  GstDroidCodecHandle *handle;
+  OMX_ERRORTYPE err;
+
+  if (!codec) {
+    return NULL;
+  }
+
+  if (!gst_droid_codec_admit (codec, type, parent, priority, timeout)) {
+    return NULL;
+  }
+
+  g_mutex_lock (&codec->lock);
+
+  if (g_hash_table_contains (codec->cores, type)) {
+    handle = (GstDroidCodecHandle *) g_hash_table_lookup (codec->cores, type);
+    handle->count++;
+  } else {
+    handle = gst_droid_codec_create_and_insert_handle_locked (codec, type);
+    if (!handle) {
+      GST_ERROR_OBJECT (parent, "error getting codec %s", type);
+      gst_droid_codec_release_locked (codec, type);
+      goto unlock_and_out;
+    }
   }
 
   /* allocate */
@@ -542,14 +1192,30 @@ gst_droid_codec_get_component (GstDroidCodec * codec, const gchar * type,
       (GstDroidCodec *) gst_mini_object_ref (GST_MINI_OBJECT (codec));
   component->handle = handle;
   component->parent = parent;
-  component->full = g_queue_new ();
-  g_mutex_init (&component->full_lock);
-  g_cond_init (&component->full_cond);
+  component->full = NULL;
+  component->frames = g_hash_table_new_full (g_int64_hash, g_int64_equal,
+      g_free, (GDestroyNotify) gst_droid_codec_free_tracked_frames);
+  g_mutex_init (&component->empty_lock);
+  g_cond_init (&component->empty_cond);
   component->error = FALSE;
   component->needs_reconfigure = FALSE;
+  component->adaptive = FALSE;
+  component->crop_changed = FALSE;
+  component->nal_length_size = 0;
+  component->share_input = FALSE;
   component->started = FALSE;
+  component->refcount = 1;
+  component->out_generation = 0;
+  g_cond_init (&component->wrapped_cond);
+  component->wrapped = 0;
+  component->filling = 0;
+  component->unload_pending = FALSE;
+  component->orphaned = FALSE;
+  component->orphan_unref_codec = FALSE;
   g_mutex_init (&component->lock);
-  g_atomic_int_set (&component->state, OMX_StateLoaded);
+  g_cond_init (&component->state_cond);
+  component->state = OMX_StateLoaded;
+  component->state_change_start = g_get_monotonic_time ();
 
   err =
       handle->get_handle (&component->omx, handle->name, component, &callbacks);
@@ -571,12 +1237,19 @@ gst_droid_codec_get_component (GstDroidCodec * codec, const gchar * type,
   component->out_port->def.nPortIndex = component->handle->out_port;
   component->out_port->comp = component;
 
-  if (component->handle->is_decoder) {
+  if (component->handle->is_audio) {
+    /* plain omx buffers on both ports */
+  } else if (component->handle->is_decoder) {
     /* enable usage of android native buffers on output port */
     if (!gst_droid_codec_enable_android_native_buffers (component,
             component->out_port)) {
       goto error;
     }
+
+    if (!component->handle->is_image) {
+      gst_droid_codec_enable_adaptive_playback (component,
+          component->out_port);
+    }
   } else {
     /* encoders get meta data usage enabled */
     if (!gst_droid_codec_enable_metadata_in_buffers (component,
@@ -608,8 +1281,10 @@ gst_droid_codec_get_component (GstDroidCodec * codec, const gchar * type,
   goto unlock_and_out;
 
 error:
+  /* destroying takes the lock */
+  g_mutex_unlock (&codec->lock);
   gst_droid_codec_destroy_component (component);
-  component = NULL;
+  return NULL;
 
 unlock_and_out:
   g_mutex_unlock (&codec->lock);
@@ -620,12 +1295,32 @@ unlock_and_out:
 static void
 gst_droid_codec_free ()
 {
+  GHashTableIter iter;
+  GstDroidCodecPool *pool;
+  GList *idle = NULL;
+
   GST_DEBUG ("codec free");
 
   G_LOCK (codec);
 
+  g_mutex_lock (&codec->lock);
+  g_hash_table_iter_init (&iter, codec->pools);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *) & pool)) {
+    GstDroidComponent *comp;
+
+    while ((comp = g_queue_pop_head (pool->idle))) {
+      idle = g_list_prepend (idle, comp);
+    }
+  }
+  g_mutex_unlock (&codec->lock);
+
+  gst_droid_codec_free_evicted (idle);
+
   g_mutex_clear (&codec->lock);
+  g_hash_table_unref (codec->pools);
   g_hash_table_unref (codec->cores);
+  g_hash_table_unref (codec->budgets);
+  g_cond_clear (&codec->budget_cond);
   g_slice_free (GstDroidCodec, codec);
   codec = NULL;
 
@@ -643,6 +1338,11 @@ gst_droid_codec_get (void)
     codec = g_slice_new0 (GstDroidCodec);
     codec->cores = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
         (GDestroyNotify) gst_droid_codec_destroy_handle);
+    codec->pools = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+        (GDestroyNotify) gst_droid_codec_destroy_pool);
+    codec->budgets = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+        (GDestroyNotify) gst_droid_codec_destroy_budget);
+    g_cond_init (&codec->budget_cond);
     g_mutex_init (&codec->lock);
     gst_mini_object_init (GST_MINI_OBJECT_CAST (codec), 0, GST_TYPE_DROID_CODEC,
         NULL, NULL, (GstMiniObjectFreeFunction) gst_droid_codec_free);
@@ -673,6 +1373,15 @@ gst_droid_codec_set_param (GstDroidComponent * comp, OMX_INDEXTYPE index,
   return OMX_SetParameter (comp->omx, index, param);
 }
 
+OMX_ERRORTYPE
+gst_droid_codec_get_config (GstDroidComponent * comp,
+    OMX_INDEXTYPE index, gpointer config)
+{
+  GST_DEBUG_OBJECT (comp->parent, "getting config at index 0x%08x", index);
+
+  return OMX_GetConfig (comp->omx, index, config);
+}
+
 OMX_ERRORTYPE
 gst_droid_codec_set_config (GstDroidComponent * comp,
     OMX_INDEXTYPE index, gpointer config)
@@ -732,35 +1441,43 @@ gst_droid_codec_configure_component (GstDroidComponent * comp,
 }
 
 static gboolean
-gst_droid_codec_allocate_port_buffers (GstDroidComponent * comp,
-    GstDroidComponentPort * port, GstCaps * caps)
+gst_droid_codec_configure_aac (GstDroidComponent * comp, GstStructure * s)
 {
-  GstStructure *config;
+  OMX_ERRORTYPE err;
+  OMX_AUDIO_PARAM_AACPROFILETYPE param;
+  gint rate = 0, channels = 0;
 
-  GST_DEBUG_OBJECT (comp->parent, "allocate port %li buffers",
-      port->def.nPortIndex);
+  GST_OMX_INIT_STRUCT (&param);
+  param.nPortIndex = comp->in_port->def.nPortIndex;
 
-  if (port->usage == -1) {
-    port->allocator = gst_droid_codec_allocator_omx_new (port);
-    port->buffers = gst_buffer_pool_new ();
-  } else {
-    port->allocator = gst_droid_codec_allocator_gralloc_new (port);
-    port->buffers = gst_buffer_pool_new ();
+  err = gst_droid_codec_get_param (comp, OMX_IndexParamAudioAac, &param);
+  if (err != OMX_ErrorNone) {
+    GST_ERROR_OBJECT (comp->parent,
+        "got error %s (0x%08x) getting aac parameters",
+        gst_omx_error_to_string (err), err);
+    return FALSE;
   }
 
-  config = gst_buffer_pool_get_config (port->buffers);
-  gst_buffer_pool_config_set_params (config, caps, port->def.nBufferSize,
-      port->def.nBufferCountActual, port->def.nBufferCountActual);
-  gst_buffer_pool_config_set_allocator (config, port->allocator, NULL);
+  /* adts carries these in every frame */
+  if (gst_structure_get_int (s, "rate", &rate)) {
+    param.nSampleRate = rate;
+  }
 
-  if (!gst_buffer_pool_set_config (port->buffers, config)) {
-    GST_ERROR_OBJECT (port->comp->parent,
-        "failed to set buffer pool configuration");
-    return FALSE;
+  if (gst_structure_get_int (s, "channels", &channels)) {
+    param.nChannels = channels;
   }
 
-  if (!gst_buffer_pool_set_active (port->buffers, TRUE)) {
-    GST_ERROR_OBJECT (port->comp->parent, "failed to activate buffer pool");
+  if (!g_strcmp0 (gst_structure_get_string (s, "stream-format"), "adts")) {
+    param.eAACStreamFormat = OMX_AUDIO_AACStreamFormatMP4ADTS;
+  } else {
+    param.eAACStreamFormat = OMX_AUDIO_AACStreamFormatMP4FF;
+  }
+
+  err = gst_droid_codec_set_param (comp, OMX_IndexParamAudioAac, &param);
+  if (err != OMX_ErrorNone) {
+    GST_ERROR_OBJECT (comp->parent,
+        "got error %s (0x%08x) setting aac parameters",
+        gst_omx_error_to_string (err), err);
     return FALSE;
   }
 
@@ -768,22 +1485,32 @@ gst_droid_codec_allocate_port_buffers (GstDroidComponent * comp,
 }
 
 static gboolean
-gst_droid_codec_set_port_enabled (GstDroidComponent * comp, int index,
-    gboolean enable)
+gst_droid_codec_configure_amr (GstDroidComponent * comp, gboolean wideband)
 {
   OMX_ERRORTYPE err;
+  OMX_AUDIO_PARAM_AMRTYPE param;
 
-  GST_DEBUG_OBJECT (comp->parent, "set port enabled: %d %d", index, enable);
+  GST_OMX_INIT_STRUCT (&param);
+  param.nPortIndex = comp->in_port->def.nPortIndex;
 
-  if (enable) {
-    err = OMX_SendCommand (comp->omx, OMX_CommandPortEnable, index, NULL);
-  } else {
-    err = OMX_SendCommand (comp->omx, OMX_CommandPortDisable, index, NULL);
+  err = gst_droid_codec_get_param (comp, OMX_IndexParamAudioAmr, &param);
+  if (err != OMX_ErrorNone) {
+    GST_ERROR_OBJECT (comp->parent,
+        "got error %s (0x%08x) getting amr parameters",
+        gst_omx_error_to_string (err), err);
+    return FALSE;
   }
 
+  /* the mode of each frame is in its header. We only pick the band */
+  param.nChannels = 1;
+  param.eAMRBandMode =
+      wideband ? OMX_AUDIO_AMRBandModeWB0 : OMX_AUDIO_AMRBandModeNB0;
+  param.eAMRFrameFormat = OMX_AUDIO_AMRFrameFormatFSF;
+
+  err = gst_droid_codec_set_param (comp, OMX_IndexParamAudioAmr, &param);
   if (err != OMX_ErrorNone) {
     GST_ERROR_OBJECT (comp->parent,
-        "got error %s (0x%08x) while enabling or disabling port",
+        "got error %s (0x%08x) setting amr parameters",
         gst_omx_error_to_string (err), err);
     return FALSE;
   }
@@ -791,278 +1518,1122 @@ gst_droid_codec_set_port_enabled (GstDroidComponent * comp, int index,
   return TRUE;
 }
 
-static gboolean
-gst_droid_codec_wait_for_state (GstDroidComponent * comp,
-    OMX_STATETYPE new_state)
+gboolean
+gst_droid_codec_configure_audio_decoder (GstDroidComponent * comp,
+    GstCaps * caps)
 {
-  int x = 0;
-  for (x = 0; x < 20; x++) {
-    if (g_atomic_int_get (&comp->state) != new_state
-        && !gst_droid_codec_has_error (comp)) {
-      usleep (WAIT_TIMEOUT);
+  GstStructure *s = gst_caps_get_structure (caps, 0);
+  const gchar *type = comp->handle->type;
+  OMX_ERRORTYPE err;
+
+  GST_DEBUG_OBJECT (comp->parent, "configure audio decoder");
+
+  if (!g_strcmp0 (type, GST_DROID_CODEC_TYPE_AAC_DEC)) {
+    if (!gst_droid_codec_configure_aac (comp, s)) {
+      return FALSE;
+    }
+  } else if (!g_strcmp0 (type, GST_DROID_CODEC_TYPE_AMRNB_DEC)) {
+    if (!gst_droid_codec_configure_amr (comp, FALSE)) {
+      return FALSE;
+    }
+  } else if (!g_strcmp0 (type, GST_DROID_CODEC_TYPE_AMRWB_DEC)) {
+    if (!gst_droid_codec_configure_amr (comp, TRUE)) {
+      return FALSE;
     }
+  } else {
+    GST_ERROR_OBJECT (comp->parent, "%s is not an audio decoder", type);
+    return FALSE;
   }
 
-  if (gst_droid_codec_has_error (comp)) {
+  err =
+      gst_droid_codec_get_param (comp, OMX_IndexParamPortDefinition,
+      &comp->in_port->def);
+  if (err != OMX_ErrorNone) {
+    GST_ERROR_OBJECT (comp->parent,
+        "got error %s (0x%08x) getting input port definition",
+        gst_omx_error_to_string (err), err);
     return FALSE;
   }
 
-  if (g_atomic_int_get (&comp->state) != new_state) {
-    GST_WARNING_OBJECT (comp->parent, "timeout waiting for state change to %s",
-        gst_omx_state_to_string (new_state));
+  err =
+      gst_droid_codec_get_param (comp, OMX_IndexParamPortDefinition,
+      &comp->out_port->def);
+  if (err != OMX_ErrorNone) {
+    GST_ERROR_OBJECT (comp->parent,
+        "got error %s (0x%08x) getting output port definition",
+        gst_omx_error_to_string (err), err);
     return FALSE;
   }
 
   return TRUE;
 }
 
-static gboolean
-gst_droid_codec_set_state (GstDroidComponent * comp, OMX_STATETYPE new_state)
+gboolean
+gst_droid_codec_configure_audio_encoder (GstDroidComponent * comp, gint rate,
+    gint channels, guint bitrate)
 {
-  OMX_STATETYPE old_state;
   OMX_ERRORTYPE err;
+  OMX_AUDIO_PARAM_PCMMODETYPE pcm;
+  OMX_AUDIO_PARAM_AACPROFILETYPE aac;
 
-  GST_DEBUG_OBJECT (comp->parent, "setting state to %s",
-      gst_omx_state_to_string (new_state));
+  GST_DEBUG_OBJECT (comp->parent,
+      "configure audio encoder: %d Hz, %d channels, %u bps", rate, channels,
+      bitrate);
 
-  err = OMX_GetState (comp->omx, &old_state);
+  GST_OMX_INIT_STRUCT (&pcm);
+  pcm.nPortIndex = comp->in_port->def.nPortIndex;
+
+  err = gst_droid_codec_get_param (comp, OMX_IndexParamAudioPcm, &pcm);
   if (err != OMX_ErrorNone) {
-    GST_ERROR_OBJECT (comp->parent, "error %s getting component state",
-        gst_omx_error_to_string (err));
+    GST_ERROR_OBJECT (comp->parent,
+        "got error %s (0x%08x) getting pcm parameters",
+        gst_omx_error_to_string (err), err);
     return FALSE;
   }
 
-  if (old_state == new_state) {
-    GST_DEBUG_OBJECT (comp->parent, "new state is already the existing state");
-    return TRUE;
+  pcm.nChannels = channels;
+  pcm.nSamplingRate = rate;
+  pcm.nBitPerSample = 16;
+  pcm.eNumData = OMX_NumericalDataSigned;
+  pcm.bInterleaved = OMX_TRUE;
+  pcm.eEndian =
+      G_BYTE_ORDER == G_LITTLE_ENDIAN ? OMX_EndianLittle : OMX_EndianBig;
+  pcm.ePCMMode = OMX_AUDIO_PCMModeLinear;
+
+  err = gst_droid_codec_set_param (comp, OMX_IndexParamAudioPcm, &pcm);
+  if (err != OMX_ErrorNone) {
+    GST_ERROR_OBJECT (comp->parent,
+        "got error %s (0x%08x) setting pcm parameters",
+        gst_omx_error_to_string (err), err);
+    return FALSE;
   }
 
-  if (new_state <= OMX_StateInvalid || new_state > OMX_StatePause) {
-    GST_ERROR_OBJECT (comp->parent, "cannot handle transition from %s to %s",
-        gst_omx_state_to_string (old_state),
-        gst_omx_state_to_string (new_state));
+  GST_OMX_INIT_STRUCT (&aac);
+  aac.nPortIndex = comp->out_port->def.nPortIndex;
+
+  err = gst_droid_codec_get_param (comp, OMX_IndexParamAudioAac, &aac);
+  if (err != OMX_ErrorNone) {
+    GST_ERROR_OBJECT (comp->parent,
+        "got error %s (0x%08x) getting aac parameters",
+        gst_omx_error_to_string (err), err);
     return FALSE;
   }
 
-  err = OMX_SendCommand (comp->omx, OMX_CommandStateSet, new_state, NULL);
+  aac.nChannels = channels;
+  aac.nSampleRate = rate;
+  aac.nBitRate = bitrate;
+  aac.nAudioBandWidth = 0;
+  aac.eAACProfile = OMX_AUDIO_AACObjectLC;
+  aac.eAACStreamFormat = OMX_AUDIO_AACStreamFormatMP4FF;
+  aac.eChannelMode =
+      channels == 1 ? OMX_AUDIO_ChannelModeMono : OMX_AUDIO_ChannelModeStereo;
+
+  err = gst_droid_codec_set_param (comp, OMX_IndexParamAudioAac, &aac);
   if (err != OMX_ErrorNone) {
     GST_ERROR_OBJECT (comp->parent,
-        "got error %s (0x%08x) while setting state to %s",
-        gst_omx_error_to_string (err), err,
-        gst_omx_state_to_string (new_state));
+        "got error %s (0x%08x) setting aac parameters",
+        gst_omx_error_to_string (err), err);
     return FALSE;
   }
 
-  /* we can not do much here really */
+  err =
+      gst_droid_codec_get_param (comp, OMX_IndexParamPortDefinition,
+      &comp->in_port->def);
+  if (err != OMX_ErrorNone) {
+    GST_ERROR_OBJECT (comp->parent,
+        "got error %s (0x%08x) getting input port definition",
+        gst_omx_error_to_string (err), err);
+    return FALSE;
+  }
+
+  err =
+      gst_droid_codec_get_param (comp, OMX_IndexParamPortDefinition,
+      &comp->out_port->def);
+  if (err != OMX_ErrorNone) {
+    GST_ERROR_OBJECT (comp->parent,
+        "got error %s (0x%08x) getting output port definition",
+        gst_omx_error_to_string (err), err);
+    return FALSE;
+  }
 
   return TRUE;
 }
 
+/* decoded audio is always interleaved 16 bit native endian PCM */
 gboolean
-gst_droid_codec_start_component (GstDroidComponent * comp, GstCaps * sink,
-    GstCaps * src)
+gst_droid_codec_get_pcm_format (GstDroidComponent * comp, gint * rate,
+    gint * channels)
 {
-  GST_DEBUG_OBJECT (comp->parent, "start");
+  OMX_ERRORTYPE err;
+  OMX_AUDIO_PARAM_PCMMODETYPE param;
 
-  if (!gst_droid_codec_set_state (comp, OMX_StateIdle)) {
-    return FALSE;
-  }
+  GST_OMX_INIT_STRUCT (&param);
+  param.nPortIndex = comp->out_port->def.nPortIndex;
 
-  /* TODO: not sure when to enable the ports */
-  if (!gst_droid_codec_set_port_enabled (comp, comp->in_port->def.nPortIndex,
-          TRUE)) {
+  err = gst_droid_codec_get_param (comp, OMX_IndexParamAudioPcm, &param);
+  if (err != OMX_ErrorNone) {
+    GST_ERROR_OBJECT (comp->parent,
+        "got error %s (0x%08x) getting pcm parameters",
+        gst_omx_error_to_string (err), err);
     return FALSE;
   }
 
-  if (!gst_droid_codec_set_port_enabled (comp, comp->out_port->def.nPortIndex,
-          TRUE)) {
+  if (param.nBitPerSample != 16 || param.eNumData != OMX_NumericalDataSigned
+      || !param.bInterleaved) {
+    GST_ERROR_OBJECT (comp->parent,
+        "unsupported pcm format: %lu bits, signed %d, interleaved %d",
+        param.nBitPerSample, param.eNumData == OMX_NumericalDataSigned,
+        param.bInterleaved);
     return FALSE;
   }
 
-  /* Let's allocate our buffers. */
-  if (!gst_droid_codec_allocate_port_buffers (comp, comp->in_port, sink)) {
-    return FALSE;
-  }
+  *rate = param.nSamplingRate;
+  *channels = param.nChannels;
 
-  if (!gst_droid_codec_allocate_port_buffers (comp, comp->out_port, src)) {
-    return FALSE;
-  }
+  GST_DEBUG_OBJECT (comp->parent, "pcm output: %d Hz, %d channels", *rate,
+      *channels);
 
-  if (!gst_droid_codec_wait_for_state (comp, OMX_StateIdle)) {
-    GST_ERROR_OBJECT (comp->parent, "component failed to reach idle state");
+  return TRUE;
+}
+
+/* downscale is applied on decode. JPEG decoders can usually do 2, 4 and 8 */
+gboolean
+gst_droid_codec_configure_image_decoder (GstDroidComponent * comp,
+    gint width, gint height, guint downscale)
+{
+  OMX_ERRORTYPE err;
+  OMX_PARAM_PORTDEFINITIONTYPE def = comp->in_port->def;
+
+  GST_DEBUG_OBJECT (comp->parent, "configure image decoder for %dx%d / %u",
+      width, height, downscale);
+
+  def.format.image.nFrameWidth = width;
+  def.format.image.nFrameHeight = height;
+
+  err = gst_droid_codec_set_param (comp, OMX_IndexParamPortDefinition, &def);
+  if (err != OMX_ErrorNone) {
+    GST_ERROR_OBJECT (comp->parent,
+        "got error %s (0x%08x) setting input port definition",
+        gst_omx_error_to_string (err), err);
     return FALSE;
   }
 
-  GST_DEBUG_OBJECT (comp->parent, "component is in idle state");
+  if (downscale > 1) {
+    OMX_CONFIG_SCALEFACTORTYPE scale;
 
-  if (!gst_droid_codec_set_state (comp, OMX_StateExecuting)) {
-    return FALSE;
+    GST_OMX_INIT_STRUCT (&scale);
+    scale.nPortIndex = comp->out_port->def.nPortIndex;
+    scale.xWidth = scale.xHeight = (1 << 16) / downscale;
+
+    err = gst_droid_codec_set_config (comp, OMX_IndexConfigCommonScale, &scale);
+    if (err != OMX_ErrorNone) {
+      GST_ERROR_OBJECT (comp->parent,
+          "got error %s (0x%08x) setting downscale factor",
+          gst_omx_error_to_string (err), err);
+      return FALSE;
+    }
   }
 
-  if (!gst_droid_codec_wait_for_state (comp, OMX_StateExecuting)) {
+  err =
+      gst_droid_codec_get_param (comp, OMX_IndexParamPortDefinition,
+      &comp->in_port->def);
+  if (err != OMX_ErrorNone) {
     GST_ERROR_OBJECT (comp->parent,
-        "component failed to reach executing state");
+        "got error %s (0x%08x) getting input port definition",
+        gst_omx_error_to_string (err), err);
     return FALSE;
   }
 
-  GST_DEBUG_OBJECT (comp->parent, "component in executing state");
-
-  /* give back all output buffers */
-  if (!gst_droid_codec_return_output_buffers (comp)) {
+  err =
+      gst_droid_codec_get_param (comp, OMX_IndexParamPortDefinition,
+      &comp->out_port->def);
+  if (err != OMX_ErrorNone) {
     GST_ERROR_OBJECT (comp->parent,
-        "failed to hand output buffers to the codec");
+        "got error %s (0x%08x) getting output port definition",
+        gst_omx_error_to_string (err), err);
     return FALSE;
   }
 
-  g_mutex_lock (&comp->lock);
-  comp->started = TRUE;
-  g_mutex_unlock (&comp->lock);
-
   return TRUE;
 }
 
-static void
-gst_droid_codec_pop_full_locked (GstDroidComponent * comp)
+/* Input buffers are only ever grown. Components pick a minimum size
+ * which we must not go below. If a component will not make them as large
+ * as asked then every frame takes several buffers and we ask for more of
+ * them instead */
+gboolean
+gst_droid_codec_set_input_buffer_size (GstDroidComponent * comp, gsize size)
 {
-  OMX_BUFFERHEADERTYPE *buff;
-  GstBuffer *buffer;
-
-  while (comp->full->length > 0) {
-    buff = g_queue_pop_head (comp->full);
+  OMX_ERRORTYPE err;
+  OMX_PARAM_PORTDEFINITIONTYPE def = comp->in_port->def;
+  guint pieces, count;
 
-    if (buff) {
-      buffer = gst_omx_buffer_get_buffer (comp, buff);
-      gst_buffer_unref (buffer);
-    }
+  if (size <= def.nBufferSize) {
+    return TRUE;
   }
-}
-
-void
-gst_droid_codec_empty_full (GstDroidComponent * comp)
-{
-  g_mutex_lock (&comp->full_lock);
-  gst_droid_codec_pop_full_locked (comp);
-  g_mutex_unlock (&comp->full_lock);
-}
 
-void
-gst_droid_codec_stop_component (GstDroidComponent * comp)
-{
-  GST_DEBUG_OBJECT (comp->parent, "stop");
+  GST_DEBUG_OBJECT (comp->parent, "growing input buffers from %li to %"
+      G_GSIZE_FORMAT " bytes", def.nBufferSize, size);
 
-  g_mutex_lock (&comp->lock);
-  comp->started = FALSE;
-  g_mutex_unlock (&comp->lock);
+  def.nBufferSize = size;
 
-  gst_droid_codec_set_state (comp, OMX_StateIdle);
+  err = gst_droid_codec_set_param (comp, OMX_IndexParamPortDefinition, &def);
+  if (err != OMX_ErrorNone) {
+    GST_WARNING_OBJECT (comp->parent,
+        "got error %s (0x%08x) setting input port definition",
+        gst_omx_error_to_string (err), err);
+    return FALSE;
+  }
 
-  if (!gst_droid_codec_wait_for_state (comp, OMX_StateIdle)) {
-    GST_ERROR_OBJECT (comp->parent, "component failed to reach idle state");
+  err =
+      gst_droid_codec_get_param (comp, OMX_IndexParamPortDefinition,
+      &comp->in_port->def);
+  if (err != OMX_ErrorNone) {
+    GST_ERROR_OBJECT (comp->parent,
+        "got error %s (0x%08x) getting input port definition",
+        gst_omx_error_to_string (err), err);
+    return FALSE;
   }
 
-  gst_droid_codec_set_state (comp, OMX_StateLoaded);
+  if (comp->in_port->def.nBufferSize >= size
+      || comp->in_port->def.nBufferSize == 0) {
+    return TRUE;
+  }
 
-  gst_buffer_pool_set_active (comp->in_port->buffers, FALSE);
-  gst_buffer_pool_set_active (comp->out_port->buffers, FALSE);
+  GST_INFO_OBJECT (comp->parent, "component kept input buffers at %li bytes",
+      comp->in_port->def.nBufferSize);
 
-  g_mutex_lock (&comp->full_lock);
-  gst_droid_codec_pop_full_locked (comp);
-  g_mutex_unlock (&comp->full_lock);
+  pieces = (size + comp->in_port->def.nBufferSize - 1) /
+      comp->in_port->def.nBufferSize;
+  count = MIN (comp->in_port->def.nBufferCountMin * pieces, MAX_INPUT_BUFFERS);
 
-  if (!gst_droid_codec_wait_for_state (comp, OMX_StateLoaded)) {
-    GST_ERROR_OBJECT (comp->parent, "component failed to reach loaded state");
+  if (count <= comp->in_port->def.nBufferCountActual) {
+    return TRUE;
   }
 
-  /* TODO: flush our ports? */
-  gst_droid_codec_set_port_enabled (comp, comp->in_port->def.nPortIndex, FALSE);
-  gst_droid_codec_set_port_enabled (comp, comp->out_port->def.nPortIndex,
-      FALSE);
+  return gst_droid_codec_set_port_buffer_count (comp, comp->in_port, count);
+}
 
-  gst_object_unref (comp->in_port->buffers);
-  comp->in_port->buffers = NULL;
+static GstBufferPool *
+gst_droid_codec_create_port_pool (GstDroidComponent * comp,
+    GstDroidComponentPort * port, GstCaps * caps, guint count)
+{
+  GstStructure *config;
+  GstBufferPool *pool = gst_buffer_pool_new ();
+
+  config = gst_buffer_pool_get_config (pool);
+  gst_buffer_pool_config_set_params (config, caps, port->def.nBufferSize,
+      count, count);
+  gst_buffer_pool_config_set_allocator (config, port->allocator, NULL);
+
+  if (!gst_buffer_pool_set_config (pool, config)) {
+    GST_ERROR_OBJECT (port->comp->parent,
+        "failed to set buffer pool configuration");
+    gst_object_unref (pool);
+    return NULL;
+  }
+
+  if (!gst_buffer_pool_set_active (pool, TRUE)) {
+    GST_ERROR_OBJECT (port->comp->parent, "failed to activate buffer pool");
+    gst_object_unref (pool);
+    return NULL;
+  }
+
+  return pool;
+}
+
+static gboolean
+gst_droid_codec_allocate_port_buffers (GstDroidComponent * comp,
+    GstDroidComponentPort * port, GstCaps * caps)
+{
+  guint count = port->def.nBufferCountActual;
+  guint copy;
+
+  GST_DEBUG_OBJECT (comp->parent, "allocate port %li buffers",
+      port->def.nPortIndex);
+
+  if (port->usage == -1) {
+    port->allocator = gst_droid_codec_allocator_omx_new (port);
+  } else {
+    port->allocator = gst_droid_codec_allocator_gralloc_new (port);
+  }
+
+  /* Both pools allocate from the port so together they hold exactly the
+   * buffers the component expects */
+  if (port == comp->in_port && comp->share_input && count > 1) {
+    copy = MIN (SHARED_INPUT_COPY_BUFFERS, count - 1);
+
+    GST_DEBUG_OBJECT (comp->parent,
+        "%u input buffers for upstream, %u for copying", count - copy, copy);
+
+    port->upstream =
+        gst_droid_codec_create_port_pool (comp, port, caps, count - copy);
+    if (!port->upstream) {
+      return FALSE;
+    }
+
+    count = copy;
+  }
+
+  port->buffers = gst_droid_codec_create_port_pool (comp, port, caps, count);
+
+  return port->buffers != NULL;
+}
+
+static gboolean
+gst_droid_codec_set_port_enabled (GstDroidComponent * comp, int index,
+    gboolean enable)
+{
+  OMX_ERRORTYPE err;
+
+  GST_DEBUG_OBJECT (comp->parent, "set port enabled: %d %d", index, enable);
+
+  if (enable) {
+    err = OMX_SendCommand (comp->omx, OMX_CommandPortEnable, index, NULL);
+  } else {
+    err = OMX_SendCommand (comp->omx, OMX_CommandPortDisable, index, NULL);
+  }
+
+  if (err != OMX_ErrorNone) {
+    GST_ERROR_OBJECT (comp->parent,
+        "got error %s (0x%08x) while enabling or disabling port",
+        gst_omx_error_to_string (err), err);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+static void
+gst_droid_codec_post_state_change (GstDroidComponent * comp,
+    OMX_STATETYPE state, GstClockTime duration)
+{
+  GstStructure *s;
+  GstMessage *msg;
+
+  if (!comp->parent) {
+    return;
+  }
+
+  s = gst_structure_new ("droid-codec-state-change",
+      "component", G_TYPE_STRING, comp->handle->name,
+      "state", G_TYPE_STRING, gst_omx_state_to_string (state),
+      "duration", G_TYPE_UINT64, duration, NULL);
+
+  msg = gst_message_new_element (GST_OBJECT (comp->parent), s);
+
+  gst_element_post_message (comp->parent, msg);
+}
+
+static gboolean
+gst_droid_codec_wait_for_state (GstDroidComponent * comp,
+    OMX_STATETYPE new_state)
+{
+  gint64 end_time;
+  GstClockTime duration;
+  gboolean error;
+  OMX_STATETYPE state;
+
+  end_time = g_get_monotonic_time () +
+      comp->handle->state_timeout * G_TIME_SPAN_MILLISECOND;
+
+  g_mutex_lock (&comp->lock);
+
+  while (comp->state != new_state && !comp->error) {
+    if (!g_cond_wait_until (&comp->state_cond, &comp->lock, end_time)) {
+      /* timeout */
+      break;
+    }
+  }
+
+  state = comp->state;
+  error = comp->error;
+  duration =
+      (g_get_monotonic_time () - comp->state_change_start) * GST_USECOND;
+
+  g_mutex_unlock (&comp->lock);
+
+  if (error) {
+    return FALSE;
+  }
+
+  if (state != new_state) {
+    GST_WARNING_OBJECT (comp->parent,
+        "timeout waiting for state change to %s after %" GST_TIME_FORMAT,
+        gst_omx_state_to_string (new_state), GST_TIME_ARGS (duration));
+    return FALSE;
+  }
+
+  GST_INFO_OBJECT (comp->parent, "%s reached state %s in %" GST_TIME_FORMAT,
+      comp->handle->name, gst_omx_state_to_string (new_state),
+      GST_TIME_ARGS (duration));
+
+  gst_droid_codec_post_state_change (comp, new_state, duration);
+
+  return TRUE;
+}
+
+static gboolean
+gst_droid_codec_set_state (GstDroidComponent * comp, OMX_STATETYPE new_state)
+{
+  OMX_STATETYPE old_state;
+  OMX_ERRORTYPE err;
+
+  GST_DEBUG_OBJECT (comp->parent, "setting state to %s",
+      gst_omx_state_to_string (new_state));
+
+  g_mutex_lock (&comp->lock);
+  comp->state_change_start = g_get_monotonic_time ();
+  g_mutex_unlock (&comp->lock);
+
+  err = OMX_GetState (comp->omx, &old_state);
+  if (err != OMX_ErrorNone) {
+    GST_ERROR_OBJECT (comp->parent, "error %s getting component state",
+        gst_omx_error_to_string (err));
+    return FALSE;
+  }
+
+  if (old_state == new_state) {
+    GST_DEBUG_OBJECT (comp->parent, "new state is already the existing state");
+    return TRUE;
+  }
+
+  if (new_state <= OMX_StateInvalid || new_state > OMX_StatePause) {
+    GST_ERROR_OBJECT (comp->parent, "cannot handle transition from %s to %s",
+        gst_omx_state_to_string (old_state),
+        gst_omx_state_to_string (new_state));
+    return FALSE;
+  }
+
+  err = OMX_SendCommand (comp->omx, OMX_CommandStateSet, new_state, NULL);
+  if (err != OMX_ErrorNone) {
+    GST_ERROR_OBJECT (comp->parent,
+        "got error %s (0x%08x) while setting state to %s",
+        gst_omx_error_to_string (err), err,
+        gst_omx_state_to_string (new_state));
+    return FALSE;
+  }
+
+  /* we can not do much here really */
+
+  return TRUE;
+}
+
+static gboolean
+gst_droid_codec_create_full_ring (GstDroidComponent * comp)
+{
+  guint count = comp->out_port->def.nBufferCountActual;
+
+  if (comp->full && gst_droid_codec_ring_size (comp->full) >= count) {
+    return TRUE;
+  }
+
+  /* we only get called when no output buffers are with the codec */
+  if (comp->full) {
+    gst_droid_codec_ring_free (comp->full);
+  }
+
+  comp->full = gst_droid_codec_ring_new (count);
+  if (!comp->full) {
+    GST_ERROR_OBJECT (comp->parent, "failed to create output queue");
+    return FALSE;
+  }
+
+  /* FillBufferDone () can not wait for room so there must be a slot for
+   * every buffer of the output port */
+  g_assert (gst_droid_codec_ring_size (comp->full) >= count);
+
+  gst_droid_codec_ring_set_flushing (comp->full,
+      !gst_droid_codec_is_running (comp));
+
+  return TRUE;
+}
+
+gboolean
+gst_droid_codec_start_component (GstDroidComponent * comp, GstCaps * sink,
+    GstCaps * src)
+{
+  GST_DEBUG_OBJECT (comp->parent, "start");
+
+  /* try to leave upstream at least as many buffers as the component needs */
+  if (comp->share_input && comp->in_port->def.nBufferCountActual <
+      comp->in_port->def.nBufferCountMin + SHARED_INPUT_COPY_BUFFERS
+      && !gst_droid_codec_set_port_buffer_count (comp, comp->in_port,
+          comp->in_port->def.nBufferCountMin + SHARED_INPUT_COPY_BUFFERS)) {
+    GST_INFO_OBJECT (comp->parent, "sharing the input buffers we have");
+  }
+
+  if (!gst_droid_codec_set_state (comp, OMX_StateIdle)) {
+    return FALSE;
+  }
+
+  /* TODO: not sure when to enable the ports */
+  if (!gst_droid_codec_set_port_enabled (comp, comp->in_port->def.nPortIndex,
+          TRUE)) {
+    return FALSE;
+  }
+
+  if (!gst_droid_codec_set_port_enabled (comp, comp->out_port->def.nPortIndex,
+          TRUE)) {
+    return FALSE;
+  }
+
+  /* Let's allocate our buffers. */
+  if (!gst_droid_codec_allocate_port_buffers (comp, comp->in_port, sink)) {
+    return FALSE;
+  }
+
+  if (!gst_droid_codec_allocate_port_buffers (comp, comp->out_port, src)) {
+    return FALSE;
+  }
+
+  if (!gst_droid_codec_create_full_ring (comp)) {
+    return FALSE;
+  }
+
+  if (!gst_droid_codec_wait_for_state (comp, OMX_StateIdle)) {
+    GST_ERROR_OBJECT (comp->parent, "component failed to reach idle state");
+    return FALSE;
+  }
+
+  GST_DEBUG_OBJECT (comp->parent, "component is in idle state");
+
+  if (!gst_droid_codec_set_state (comp, OMX_StateExecuting)) {
+    return FALSE;
+  }
+
+  if (!gst_droid_codec_wait_for_state (comp, OMX_StateExecuting)) {
+    GST_ERROR_OBJECT (comp->parent,
+        "component failed to reach executing state");
+    return FALSE;
+  }
+
+  GST_DEBUG_OBJECT (comp->parent, "component in executing state");
+
+  /* give back all output buffers */
+  if (!gst_droid_codec_return_output_buffers (comp)) {
+    GST_ERROR_OBJECT (comp->parent,
+        "failed to hand output buffers to the codec");
+    return FALSE;
+  }
+
+  gst_droid_codec_set_running (comp, TRUE);
+
+  return TRUE;
+}
+
+void
+gst_droid_codec_empty_full (GstDroidComponent * comp)
+{
+  OMX_BUFFERHEADERTYPE *buff;
+  GstBuffer *buffer;
+
+  if (!comp->full) {
+    return;
+  }
+
+  while ((buff = gst_droid_codec_ring_pop (comp->full))) {
+    buffer = gst_omx_buffer_get_buffer (comp, buff);
+    gst_buffer_unref (buffer);
+  }
+}
+
+static void
+gst_droid_codec_clear_frames (GstDroidComponent * comp)
+{
+  g_mutex_lock (&comp->lock);
+  g_hash_table_remove_all (comp->frames);
+  g_mutex_unlock (&comp->lock);
+}
+
+/* Waits up to the state timeout for downstream to release the wrapped
+ * output buffers it holds */
+static gboolean
+gst_droid_codec_wait_for_wrapped (GstDroidComponent * comp)
+{
+  gint64 end_time;
+  guint wrapped;
+
+  end_time = g_get_monotonic_time () +
+      comp->handle->state_timeout * G_TIME_SPAN_MILLISECOND;
+
+  g_mutex_lock (&comp->lock);
+
+  while (comp->wrapped > 0) {
+    if (!g_cond_wait_until (&comp->wrapped_cond, &comp->lock, end_time)) {
+      break;
+    }
+  }
+
+  wrapped = comp->wrapped;
+
+  g_mutex_unlock (&comp->lock);
+
+  if (wrapped > 0) {
+    GST_WARNING_OBJECT (comp->parent,
+        "downstream still holds %u output buffers", wrapped);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+/* from idle to loaded, freeing all buffers */
+static void
+gst_droid_codec_unload_component (GstDroidComponent * comp)
+{
+  comp->unload_pending = FALSE;
+
+  gst_droid_codec_set_state (comp, OMX_StateLoaded);
+
+  gst_buffer_pool_set_active (comp->in_port->buffers, FALSE);
+  if (comp->in_port->upstream) {
+    gst_buffer_pool_set_active (comp->in_port->upstream, FALSE);
+  }
+  gst_buffer_pool_set_active (comp->out_port->buffers, FALSE);
+
+  gst_droid_codec_empty_full (comp);
+
+  gst_droid_codec_clear_frames (comp);
+
+  if (!gst_droid_codec_wait_for_state (comp, OMX_StateLoaded)) {
+    GST_ERROR_OBJECT (comp->parent, "component failed to reach loaded state");
+  }
+
+  /* TODO: flush our ports? */
+  gst_droid_codec_set_port_enabled (comp, comp->in_port->def.nPortIndex, FALSE);
+  gst_droid_codec_set_port_enabled (comp, comp->out_port->def.nPortIndex,
+      FALSE);
+
+  gst_object_unref (comp->in_port->buffers);
+  comp->in_port->buffers = NULL;
+
+  if (comp->in_port->upstream) {
+    gst_object_unref (comp->in_port->upstream);
+    comp->in_port->upstream = NULL;
+  }
 
   gst_object_unref (comp->out_port->buffers);
   comp->out_port->buffers = NULL;
 
-  gst_object_unref (comp->in_port->allocator);
-  comp->in_port->allocator = NULL;
+  gst_object_unref (comp->in_port->allocator);
+  comp->in_port->allocator = NULL;
+
+  gst_object_unref (comp->out_port->allocator);
+  comp->out_port->allocator = NULL;
+
+  GST_INFO_OBJECT (comp->parent, "component is in loaded state");
+}
+
+void
+gst_droid_codec_stop_component (GstDroidComponent * comp)
+{
+  GST_DEBUG_OBJECT (comp->parent, "stop");
+
+  gst_droid_codec_set_running (comp, FALSE);
+
+  /* The output buffers are freed when we reach loaded. Nothing is given
+   * back to the component after this but wait for anything already on its
+   * way so it does not race with the state change */
+  g_mutex_lock (&comp->lock);
+  comp->out_generation++;
+  while (comp->filling > 0) {
+    g_cond_wait (&comp->wrapped_cond, &comp->lock);
+  }
+  g_mutex_unlock (&comp->lock);
+
+  gst_droid_codec_set_state (comp, OMX_StateIdle);
+
+  if (!gst_droid_codec_wait_for_state (comp, OMX_StateIdle)) {
+    GST_ERROR_OBJECT (comp->parent, "component failed to reach idle state");
+  }
+
+  /* The component can not reach loaded before every buffer is freed and we
+   * can not free those downstream still reads from. Leave it in idle, it is
+   * unloaded when it gets freed */
+  if (!gst_droid_codec_wait_for_wrapped (comp)) {
+    comp->unload_pending = TRUE;
+    return;
+  }
+
+  gst_droid_codec_unload_component (comp);
+}
+
+static GstBuffer *
+gst_droid_codec_acquire_buffer_from_pool (GstDroidComponent * comp,
+    GstBufferPool * pool)
+{
+  GstBuffer *buffer = NULL;
+  GstBufferPoolAcquireParams params;
+  GstFlowReturn ret;
+
+  GST_DEBUG_OBJECT (comp->parent, "acquire buffer from pool %p", pool);
+
+  params.flags = GST_BUFFER_POOL_ACQUIRE_FLAG_DONTWAIT;
+
+  /* We try to acquire while holding empty_lock. EmptyBufferDone () returns
+   * the buffer to the pool before signalling us under the same lock so
+   * we can never miss a wake up */
+  g_mutex_lock (&comp->empty_lock);
+
+  while (TRUE) {
+    if (gst_droid_codec_has_error (comp)) {
+      break;
+    }
+
+    if (gst_droid_codec_needs_reconfigure (comp)) {
+      break;
+    }
+
+    if (!gst_droid_codec_is_running (comp)) {
+      break;
+    }
+
+    ret = gst_buffer_pool_acquire_buffer (pool, &buffer, &params);
+    if (buffer || ret != GST_FLOW_EOS) {
+      break;
+    }
+
+    GST_DEBUG_OBJECT (comp->parent, "waiting for buffers");
+    g_cond_wait (&comp->empty_cond, &comp->empty_lock);
+  }
+
+  g_mutex_unlock (&comp->empty_lock);
+
+  return buffer;
+}
+
+static gint
+gst_droid_codec_compare_tracked_frame (GstDroidCodecTrackedFrame * tracked,
+    gpointer number)
+{
+  return tracked->number == GPOINTER_TO_UINT (number) ? 0 : 1;
+}
+
+static void
+gst_droid_codec_record_latency (GstDroidComponent * comp, gint64 latency)
+{
+  guint bucket = 0;
+  gint64 limit = 5000;
+
+  while (bucket < GST_DROID_CODEC_LATENCY_BUCKETS - 1 && latency >= limit) {
+    bucket++;
+    limit *= 2;
+  }
+
+  gst_droid_codec_stats_add (&comp->stats.latency[bucket], 1);
+}
+
+/* wait is in us */
+static void
+gst_droid_codec_count_submission (GstDroidComponent * comp, gsize size,
+    gint64 wait)
+{
+  gst_droid_codec_stats_add (&comp->stats.frames_submitted, 1);
+  gst_droid_codec_stats_add (&comp->stats.bytes_in, size);
+  gst_droid_codec_stats_add (&comp->stats.input_wait, wait);
+}
+
+static OMX_TICKS
+gst_droid_codec_get_ticks (GstClockTime pts)
+{
+  if (pts != GST_CLOCK_TIME_NONE) {
+    return gst_util_uint64_scale (pts, OMX_TICKS_PER_SECOND, GST_SECOND);
+  }
+
+  return 0;
+}
+
+static void
+gst_droid_codec_track_frame (GstDroidComponent * comp,
+    GstVideoCodecFrame * frame)
+{
+  gint64 ticks = gst_droid_codec_get_ticks (frame->pts);
+  GQueue *queue;
+  GstDroidCodecTrackedFrame *tracked = g_slice_new (GstDroidCodecTrackedFrame);
+
+  tracked->number = frame->system_frame_number;
+  tracked->submitted = g_get_monotonic_time ();
+
+  g_mutex_lock (&comp->lock);
+
+  queue = g_hash_table_lookup (comp->frames, &ticks);
+  if (!queue) {
+    queue = g_queue_new ();
+    g_hash_table_insert (comp->frames, g_memdup (&ticks, sizeof (ticks)),
+        queue);
+  }
+
+  g_queue_push_tail (queue, tracked);
+
+  g_mutex_unlock (&comp->lock);
+}
+
+/* Finds the frame an output buffer belongs to. Components carry the input
+ * timestamp over to the output so this works even if the output is
+ * reordered or the component drops frames */
+gboolean
+gst_droid_codec_match_frame (GstDroidComponent * comp,
+    OMX_BUFFERHEADERTYPE * buff, guint32 * frame_number, gint64 * latency)
+{
+  gint64 elapsed;
+  gint64 ticks = buff->nTimeStamp;
+  GQueue *queue;
+  GstDroidCodecTrackedFrame *tracked = NULL;
+
+  g_mutex_lock (&comp->lock);
+
+  queue = g_hash_table_lookup (comp->frames, &ticks);
+  if (queue) {
+    tracked = g_queue_pop_head (queue);
+
+    if (g_queue_is_empty (queue)) {
+      g_hash_table_remove (comp->frames, &ticks);
+    }
+  }
+
+  g_mutex_unlock (&comp->lock);
+
+  if (!tracked) {
+    return FALSE;
+  }
+
+  elapsed = g_get_monotonic_time () - tracked->submitted;
+
+  *frame_number = tracked->number;
+  if (latency) {
+    *latency = elapsed;
+  }
+
+  gst_droid_codec_record_latency (comp, elapsed);
+  gst_droid_codec_free_tracked_frame (tracked);
+
+  return TRUE;
+}
+
+void
+gst_droid_codec_forget_frame (GstDroidComponent * comp,
+    GstVideoCodecFrame * frame)
+{
+  gint64 ticks = gst_droid_codec_get_ticks (frame->pts);
+  GQueue *queue;
+
+  g_mutex_lock (&comp->lock);
+
+  queue = g_hash_table_lookup (comp->frames, &ticks);
+  if (queue) {
+    GList *link = g_queue_find_custom (queue,
+        GUINT_TO_POINTER (frame->system_frame_number),
+        (GCompareFunc) gst_droid_codec_compare_tracked_frame);
+
+    if (link) {
+      gst_droid_codec_free_tracked_frame (link->data);
+      g_queue_delete_link (queue, link);
+    }
+
+    if (g_queue_is_empty (queue)) {
+      g_hash_table_remove (comp->frames, &ticks);
+    }
+  }
+
+  g_mutex_unlock (&comp->lock);
+}
+
+static void
+gst_droid_codec_prepare_input_buffer (OMX_BUFFERHEADERTYPE * omx_buf,
+    GstClockTime pts, GstClockTime duration, gboolean sync, gsize offset,
+    gsize size)
+{
+  omx_buf->nTimeStamp = gst_droid_codec_get_ticks (pts);
+
+  if (duration != GST_CLOCK_TIME_NONE && offset == 0) {
+    omx_buf->nTickCount =
+        gst_util_uint64_scale (omx_buf->nFilledLen, duration, size);
+  } else {
+    omx_buf->nTickCount = 0;
+  }
+
+  if (offset == 0 && sync) {
+    omx_buf->nFlags |= OMX_BUFFERFLAG_SYNCFRAME;
+  }
+
+  if (offset + omx_buf->nFilledLen == size) {
+    omx_buf->nFlags |= OMX_BUFFERFLAG_ENDOFFRAME;
+  }
+}
+
+static OMX_BUFFERHEADERTYPE *
+gst_droid_codec_get_input_omx_buffer (GstDroidComponent * comp,
+    GstBuffer * buffer)
+{
+  GstMemory *mem;
+  OMX_BUFFERHEADERTYPE *omx_buf;
+
+  /* We can only pass a buffer without copying if upstream has filled
+   * one of the buffers we proposed from our input port pool. avc input
+   * gets rewritten while copying */
+  if (comp->nal_length_size > 0 || gst_buffer_n_memory (buffer) != 1) {
+    return NULL;
+  }
+
+  mem = gst_buffer_peek_memory (buffer, 0);
+  if (mem->allocator != comp->in_port->allocator) {
+    return NULL;
+  }
+
+  omx_buf = gst_droid_codec_omx_allocator_get_omx_buffer (mem);
+  if (!omx_buf) {
+    return NULL;
+  }
+
+  /* still owned by the codec. Upstream is pushing the same buffer twice */
+  if (omx_buf->pAppPrivate) {
+    return NULL;
+  }
+
+  if (mem->offset + mem->size > omx_buf->nAllocLen) {
+    return NULL;
+  }
+
+  return omx_buf;
+}
+
+static gboolean
+gst_droid_codec_submit_no_copy (GstDroidComponent * comp, GstBuffer * input,
+    GstClockTime pts, GstClockTime duration, gboolean sync,
+    OMX_BUFFERHEADERTYPE * omx_buf)
+{
+  GstMemory *mem;
+  OMX_ERRORTYPE err;
+
+  GST_DEBUG_OBJECT (comp->parent, "consume frame without copying");
+
+  /* the copying path finds out when it can not get a buffer */
+  if (gst_droid_codec_has_error (comp)) {
+    GST_INFO_OBJECT (comp->parent, "component in error state");
+    return FALSE;
+  } else if (gst_droid_codec_needs_reconfigure (comp)) {
+    GST_INFO_OBJECT (comp->parent, "component needs reconfigure");
+    return FALSE;
+  } else if (!gst_droid_codec_is_running (comp)) {
+    GST_INFO_OBJECT (comp->parent, "component is not running");
+    return FALSE;
+  }
+
+  mem = gst_buffer_peek_memory (input, 0);
+
+  omx_buf->nOffset = mem->offset;
+  omx_buf->nFilledLen = mem->size;
+  omx_buf->nFlags = 0;
+
+  gst_droid_codec_prepare_input_buffer (omx_buf, pts, duration, sync, 0,
+      mem->size);
+
+  /* EmptyBufferDone () will drop this reference and the buffer goes back
+   * to the pool once upstream and the frame are done with it */
+  omx_buf->pAppPrivate = gst_buffer_ref (input);
+
+  err = OMX_EmptyThisBuffer (comp->omx, omx_buf);
+
+  if (err != OMX_ErrorNone) {
+    GST_ERROR ("got error %s (0x%08x) while calling EmptyThisBuffer",
+        gst_omx_error_to_string (err), err);
 
-  gst_object_unref (comp->out_port->allocator);
-  comp->out_port->allocator = NULL;
+    omx_buf->pAppPrivate = NULL;
+    gst_buffer_unref (input);
 
-  GST_INFO_OBJECT (comp->parent, "component is in loaded state");
-}
+    return FALSE;
+  }
 
-static GstBuffer *
-gst_droid_codec_acquire_buffer_from_pool (GstDroidComponent * comp,
-    GstBufferPool * pool)
-{
-  GstBuffer *buffer = NULL;
-  GstBufferPoolAcquireParams params;
-  GstFlowReturn ret;
+  gst_droid_codec_count_submission (comp, mem->size, 0);
 
-  GST_DEBUG_OBJECT (comp->parent, "acquire buffer from pool %p", pool);
+  return TRUE;
+}
 
-  while (TRUE) {
-    if (gst_droid_codec_has_error (comp)) {
-      return NULL;
+/* Replaces the NAL length prefixes which fall in the len bytes copied from
+ * offset to dst with start codes. next is the position of the first prefix
+ * not completely written yet. Only 4 byte prefixes are handled, which keeps
+ * the size of the data unchanged */
+static void
+gst_droid_codec_write_start_codes (const guint8 * src, gsize size,
+    guint8 * dst, gsize offset, gsize len, gsize * next)
+{
+  static const guint8 start_code[4] = { 0x00, 0x00, 0x00, 0x01 };
+  gsize end = offset + len;
+  guint32 nal;
+  gsize x;
+
+  while (*next + 4 <= size && *next < end) {
+    for (x = 0; x < 4; x++) {
+      if (*next + x >= offset && *next + x < end) {
+        dst[*next + x - offset] = start_code[x];
+      }
     }
 
-    if (gst_droid_codec_needs_reconfigure (comp)) {
-      return NULL;
+    if (*next + 4 > end) {
+      /* the rest of the prefix goes to the next buffer */
+      return;
     }
 
-    if (!gst_droid_codec_is_running (comp)) {
-      return NULL;
+    nal = GST_READ_UINT32_BE (src + *next);
+    if (nal > size - *next - 4) {
+      /* truncated. Pass the rest as it is */
+      *next = size;
+      return;
     }
 
-    params.flags = GST_BUFFER_POOL_ACQUIRE_FLAG_DONTWAIT;
-
-    ret = gst_buffer_pool_acquire_buffer (pool, &buffer, &params);
-    if (buffer || ret != GST_FLOW_EOS) {
-      break;
-    } else if (ret == GST_FLOW_EOS) {
-      GST_DEBUG_OBJECT (comp->parent, "waiting for buffers");
-      usleep (WAIT_TIMEOUT);
-    }
+    *next += 4 + nal;
   }
-
-  return buffer;
 }
 
-gboolean
-gst_droid_codec_consume_frame (GstDroidComponent * comp,
-    GstVideoCodecFrame * frame)
+static gboolean
+gst_droid_codec_submit (GstDroidComponent * comp, GstBuffer * input,
+    GstClockTime pts, GstClockTime duration, gboolean sync)
 {
   GstBuffer *buf = NULL;
   OMX_BUFFERHEADERTYPE *omx_buf;
   OMX_ERRORTYPE err;
   gsize size, offset = 0;
-  GstClockTime timestamp, duration;
+  gint64 start, wait = 0;
+  GstMapInfo info;
+  gsize next_nal = 0;
+  gboolean ret = FALSE;
 
   GST_DEBUG_OBJECT (comp->parent, "consume frame");
 
-  size = gst_buffer_get_size (frame->input_buffer);
-  timestamp = frame->pts;
-  duration = frame->duration;
+  omx_buf = gst_droid_codec_get_input_omx_buffer (comp, input);
+  if (omx_buf) {
+    return gst_droid_codec_submit_no_copy (comp, input, pts, duration, sync,
+        omx_buf);
+  }
+
+  if (!gst_buffer_map (input, &info, GST_MAP_READ)) {
+    GST_ERROR_OBJECT (comp->parent, "failed to map input buffer");
+    return FALSE;
+  }
+
+  size = info.size;
 
   /* This is mainly based on gst-omx */
   while (offset < size) {
     /* acquire a buffer from the pool */
+    start = g_get_monotonic_time ();
     buf =
         gst_droid_codec_acquire_buffer_from_pool (comp, comp->in_port->buffers);
+    wait += g_get_monotonic_time () - start;
+
     if (!buf && gst_droid_codec_has_error (comp)) {
       GST_INFO_OBJECT (comp->parent, "component in error state");
-      return FALSE;
+      goto out;
     } else if (!buf && gst_droid_codec_needs_reconfigure (comp)) {
       GST_INFO_OBJECT (comp->parent, "component needs reconfigure");
-      return FALSE;
+      goto out;
     } else if (!buf && !gst_droid_codec_is_running (comp)) {
       GST_INFO_OBJECT (comp->parent, "component is not running");
-      return FALSE;
+      goto out;
     } else if (!buf) {
       GST_ERROR_OBJECT (comp->parent, "could not acquire buffer");
-      return FALSE;
+      goto out;
     }
 
     /* get omx buffer */
@@ -1073,39 +2644,26 @@ gst_droid_codec_consume_frame (GstDroidComponent * comp,
       gst_buffer_unref (buf);
 
       GST_ERROR_OBJECT (comp->parent, "failed to get omx buffer");
-      return FALSE;
+      goto out;
     }
 
     omx_buf->nFilledLen =
         MIN (size - offset, omx_buf->nAllocLen - omx_buf->nOffset);
 
-    gst_buffer_extract (frame->input_buffer, offset,
-        omx_buf->pBuffer + omx_buf->nOffset, omx_buf->nFilledLen);
-
-    if (timestamp != GST_CLOCK_TIME_NONE) {
-      omx_buf->nTimeStamp =
-          gst_util_uint64_scale (timestamp, OMX_TICKS_PER_SECOND, GST_SECOND);
-    } else {
-      omx_buf->nTimeStamp = 0;
-    }
+    memcpy (omx_buf->pBuffer + omx_buf->nOffset, info.data + offset,
+        omx_buf->nFilledLen);
 
-    if (duration != GST_CLOCK_TIME_NONE && offset == 0) {
-      omx_buf->nTickCount =
-          gst_util_uint64_scale (omx_buf->nFilledLen, duration, size);
-    } else {
-      omx_buf->nTickCount = 0;
+    if (comp->nal_length_size > 0) {
+      gst_droid_codec_write_start_codes (info.data, size,
+          omx_buf->pBuffer + omx_buf->nOffset, offset, omx_buf->nFilledLen,
+          &next_nal);
     }
 
-    if (offset == 0 && GST_VIDEO_CODEC_FRAME_IS_SYNC_POINT (frame)) {
-      omx_buf->nFlags |= OMX_BUFFERFLAG_SYNCFRAME;
-    }
+    gst_droid_codec_prepare_input_buffer (omx_buf, pts, duration, sync, offset,
+        size);
 
     offset += omx_buf->nFilledLen;
 
-    if (offset == size) {
-      omx_buf->nFlags |= OMX_BUFFERFLAG_ENDOFFRAME;
-    }
-
     omx_buf->pAppPrivate = buf;
 
     /* empty! */
@@ -1115,15 +2673,93 @@ gst_droid_codec_consume_frame (GstDroidComponent * comp,
       GST_ERROR ("got error %s (0x%08x) while calling EmptyThisBuffer",
           gst_omx_error_to_string (err), err);
 
-      return FALSE;
+      goto out;
     }
   }
 
-  GST_DEBUG_OBJECT (comp->parent, "frame consumed");
+  GST_DEBUG_OBJECT (comp->parent,
+      "frame consumed after waiting %" GST_TIME_FORMAT " for input buffers",
+      GST_TIME_ARGS (wait * GST_USECOND));
+
+  gst_droid_codec_count_submission (comp, size, wait);
+
+  ret = TRUE;
+
+out:
+  gst_buffer_unmap (input, &info);
+
+  return ret;
+}
+
+gboolean
+gst_droid_codec_consume_frame (GstDroidComponent * comp,
+    GstVideoCodecFrame * frame)
+{
+  /* The output can arrive as soon as the input is submitted */
+  gst_droid_codec_track_frame (comp, frame);
+
+  if (!gst_droid_codec_submit (comp, frame->input_buffer, frame->pts,
+          frame->duration, GST_VIDEO_CODEC_FRAME_IS_SYNC_POINT (frame))) {
+    gst_droid_codec_forget_frame (comp, frame);
+    return FALSE;
+  }
 
   return TRUE;
 }
 
+/* adds the component counters to an element's statistics. The caller makes
+ * sure the output ring is not replaced meanwhile */
+void
+gst_droid_codec_add_component_stats (GstDroidComponent * comp,
+    GstStructure * s)
+{
+  GstDroidComponentStats *stats = &comp->stats;
+  GValue histogram = G_VALUE_INIT;
+  GValue val = G_VALUE_INIT;
+  guint x;
+
+  g_value_init (&histogram, GST_TYPE_ARRAY);
+  g_value_init (&val, G_TYPE_UINT64);
+
+  for (x = 0; x < GST_DROID_CODEC_LATENCY_BUCKETS; x++) {
+    g_value_set_uint64 (&val, gst_droid_codec_stats_get (&stats->latency[x]));
+    gst_value_array_append_value (&histogram, &val);
+  }
+
+  g_value_unset (&val);
+
+  gst_structure_set (s, "frames-submitted", G_TYPE_UINT64,
+      gst_droid_codec_stats_get (&stats->frames_submitted),
+      "frames-finished", G_TYPE_UINT64,
+      gst_droid_codec_stats_get (&stats->frames_finished),
+      "bytes-in", G_TYPE_UINT64, gst_droid_codec_stats_get (&stats->bytes_in),
+      "bytes-out", G_TYPE_UINT64,
+      gst_droid_codec_stats_get (&stats->bytes_out),
+      "input-wait", G_TYPE_UINT64,
+      gst_droid_codec_stats_get (&stats->input_wait) * GST_USECOND,
+      "full-queue-depth", G_TYPE_UINT,
+      comp->full ? gst_droid_codec_ring_length (comp->full) : 0,
+      "full-queue-depth-max", G_TYPE_UINT64,
+      gst_droid_codec_stats_get (&stats->full_depth_max),
+      "reconfigurations", G_TYPE_UINT64,
+      gst_droid_codec_stats_get (&stats->reconfigurations),
+      "flushes", G_TYPE_UINT64, gst_droid_codec_stats_get (&stats->flushes),
+      "errors", G_TYPE_UINT64, gst_droid_codec_stats_get (&stats->errors),
+      NULL);
+
+  gst_structure_take_value (s, "latency-histogram", &histogram);
+}
+
+/* for elements without GstVideoCodecFrame. There is no frame to match the
+ * output to so output is expected in input order */
+gboolean
+gst_droid_codec_consume_buffer (GstDroidComponent * comp, GstBuffer * buffer)
+{
+  return gst_droid_codec_submit (comp, buffer, GST_BUFFER_PTS (buffer),
+      GST_BUFFER_DURATION (buffer),
+      !GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_DELTA_UNIT));
+}
+
 gboolean
 gst_droid_codec_set_codec_data (GstDroidComponent * comp,
     GstBuffer * codec_data)
@@ -1150,105 +2786,411 @@ gst_droid_codec_set_codec_data (GstDroidComponent * comp,
   if (!omx_buf) {
     gst_buffer_unref (buf);
 
-    GST_ERROR_OBJECT (comp->parent, "failed to get omx buffer");
-    return FALSE;
-  }
+    GST_ERROR_OBJECT (comp->parent, "failed to get omx buffer");
+    return FALSE;
+  }
+
+  if (omx_buf->nAllocLen - omx_buf->nOffset < gst_buffer_get_size (codec_data)) {
+    gst_buffer_unref (buf);
+    GST_ERROR_OBJECT (comp->parent, "codec config is too large");
+    return FALSE;
+  }
+
+  omx_buf->nFilledLen = gst_buffer_get_size (codec_data);
+  gst_buffer_extract (codec_data, 0,
+      omx_buf->pBuffer + omx_buf->nOffset, omx_buf->nFilledLen);
+
+  omx_buf->nFlags = OMX_BUFFERFLAG_CODECCONFIG | OMX_BUFFERFLAG_ENDOFFRAME;
+  omx_buf->nTimeStamp = 0;
+  omx_buf->nTickCount = 0;
+
+  /* EmptyBufferDone () will return it to the pool */
+  omx_buf->pAppPrivate = buf;
+
+  err = OMX_EmptyThisBuffer (comp->omx, omx_buf);
+
+  if (err != OMX_ErrorNone) {
+    GST_ERROR ("got error %s (0x%08x) while calling EmptyThisBuffer",
+        gst_omx_error_to_string (err), err);
+
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+/* avcC holds the NAL length size followed by the SPS and PPS, each with a
+ * 16 bit length prefix. They are passed one by one with a start code in
+ * front, the same way Android does it */
+gboolean
+gst_droid_codec_set_avc_codec_data (GstDroidComponent * comp,
+    GstBuffer * codec_data)
+{
+  static const guint8 start_code[4] = { 0x00, 0x00, 0x00, 0x01 };
+  GstMapInfo info;
+  GstByteReader reader;
+  guint8 length_size, count;
+  guint16 len;
+  const guint8 *nal;
+  GstBuffer *buf;
+  gboolean ret = FALSE;
+  gint x, y;
+
+  GST_DEBUG_OBJECT (comp->parent, "set avc codec_data");
+
+  if (!gst_buffer_map (codec_data, &info, GST_MAP_READ)) {
+    GST_ERROR_OBJECT (comp->parent, "failed to map codec_data");
+    return FALSE;
+  }
+
+  gst_byte_reader_init (&reader, info.data, info.size);
+
+  if (!gst_byte_reader_skip (&reader, 4)
+      || !gst_byte_reader_get_uint8 (&reader, &length_size)) {
+    goto invalid;
+  }
+
+  comp->nal_length_size = (length_size & 0x03) + 1;
+  if (comp->nal_length_size != 4) {
+    GST_ERROR_OBJECT (comp->parent, "unsupported NAL length size %u",
+        comp->nal_length_size);
+    goto out;
+  }
+
+  /* SPS then PPS */
+  for (x = 0; x < 2; x++) {
+    if (!gst_byte_reader_get_uint8 (&reader, &count)) {
+      goto invalid;
+    }
+
+    if (x == 0) {
+      count &= 0x1f;
+    }
+
+    for (y = 0; y < count; y++) {
+      if (!gst_byte_reader_get_uint16_be (&reader, &len)
+          || !gst_byte_reader_get_data (&reader, len, &nal)) {
+        goto invalid;
+      }
+
+      buf = gst_buffer_new_allocate (NULL, sizeof (start_code) + len, NULL);
+      gst_buffer_fill (buf, 0, start_code, sizeof (start_code));
+      gst_buffer_fill (buf, sizeof (start_code), nal, len);
+
+      if (!gst_droid_codec_set_codec_data (comp, buf)) {
+        gst_buffer_unref (buf);
+        goto out;
+      }
+
+      gst_buffer_unref (buf);
+    }
+  }
+
+  ret = TRUE;
+  goto out;
+
+invalid:
+  GST_ERROR_OBJECT (comp->parent, "invalid avc codec_data");
+
+out:
+  gst_buffer_unmap (codec_data, &info);
+
+  return ret;
+}
+
+GstBuffer *
+gst_omx_buffer_get_buffer (GstDroidComponent * comp,
+    OMX_BUFFERHEADERTYPE * buff)
+{
+  GST_DEBUG_OBJECT (comp->parent, "get buffer");
+
+  return (GstBuffer *) buff->pAppPrivate;
+}
+
+gboolean
+gst_droid_codec_return_output_buffers (GstDroidComponent * comp)
+{
+  GstBuffer *buffer;
+  GstBufferPoolAcquireParams params;
+  OMX_ERRORTYPE err;
+
+  GST_DEBUG_OBJECT (comp->parent, "return output buffers");
+
+  params.flags = GST_BUFFER_POOL_ACQUIRE_FLAG_DONTWAIT;
+  while (gst_buffer_pool_acquire_buffer (comp->out_port->buffers, &buffer,
+          &params) == GST_FLOW_OK) {
+    OMX_BUFFERHEADERTYPE *omx;
+
+    if (comp->out_port->usage != -1) {
+      GstMemory *mem = gst_buffer_peek_memory (buffer, 0);
+      if (!gst_is_gralloc_memory (mem)) {
+        GstMemory *gralloc =
+            gst_droid_codec_gralloc_allocator_get_gralloc_memory (mem);
+        if (!gralloc) {
+          // TODO: error
+        }
+
+        gst_memory_ref (gralloc);
+
+        gst_buffer_insert_memory (buffer, 0, gralloc);
+        GST_BUFFER_FLAG_UNSET (buffer, GST_BUFFER_FLAG_TAG_MEMORY);
+      }
+
+      omx =
+          gst_droid_codec_gralloc_allocator_get_omx_buffer
+          (gst_buffer_peek_memory (buffer, 1));
+    } else {
+      omx =
+          gst_droid_codec_omx_allocator_get_omx_buffer (gst_buffer_peek_memory
+          (buffer, 0));
+    }
+
+    /* reset buffer */
+    omx->nFilledLen = 0;
+    omx->nOffset = 0;
+    omx->nFlags = 0;
+    omx->pAppPrivate = buffer;
+
+    GST_DEBUG_OBJECT (comp->parent, "handing buffer %p to the omx codec",
+        buffer);
+
+    err = OMX_FillThisBuffer (comp->omx, omx);
+
+    if (err != OMX_ErrorNone) {
+      return FALSE;
+    }
+  }
+
+  GST_DEBUG_OBJECT (comp->parent, "returned output buffers");
+
+  return TRUE;
+}
+
+typedef struct
+{
+  GstDroidComponent *comp;
+  GstBuffer *buffer;
+  OMX_BUFFERHEADERTYPE *omx;
+  guint generation;
+} GstDroidCodecWrappedBuffer;
+
+/* Called from whichever thread drops the last reference to the memory.
+ * Whether the buffer goes back to the component is decided under lock.
+ * FillThisBuffer () is called without it because the component can call us
+ * back from there, but stopping waits for it to return */
+static void
+gst_droid_codec_wrapped_buffer_released (GstDroidCodecWrappedBuffer * wrapped)
+{
+  GstDroidComponent *comp = wrapped->comp;
+  OMX_ERRORTYPE err;
+  gboolean fill, orphaned;
+
+  g_mutex_lock (&comp->lock);
+
+  /* If we are flushing or stopping then the buffer goes back to the pool.
+   * gst_droid_codec_return_output_buffers () will pick it up when we resume.
+   * Buffers of an older generation have been freed by the component */
+  fill = comp->started && !comp->needs_reconfigure
+      && wrapped->generation == comp->out_generation;
+  if (fill) {
+    comp->filling++;
+  }
+
+  comp->wrapped--;
+  orphaned = comp->orphaned && comp->wrapped == 0;
+  g_cond_broadcast (&comp->wrapped_cond);
+
+  g_mutex_unlock (&comp->lock);
+
+  if (fill) {
+    GST_DEBUG_OBJECT (comp->parent, "wrapped buffer %p released",
+        wrapped->buffer);
+
+    wrapped->omx->nFilledLen = 0;
+    wrapped->omx->nOffset = 0;
+    wrapped->omx->nFlags = 0;
+    wrapped->omx->pAppPrivate = wrapped->buffer;
+
+    err = OMX_FillThisBuffer (comp->omx, wrapped->omx);
+    if (err != OMX_ErrorNone) {
+      GST_WARNING_OBJECT (comp->parent,
+          "got error %s (0x%08x) while calling FillThisBuffer",
+          gst_omx_error_to_string (err), err);
+
+      wrapped->omx->pAppPrivate = NULL;
+      fill = FALSE;
+    }
+
+    g_mutex_lock (&comp->lock);
+    comp->filling--;
+    g_cond_broadcast (&comp->wrapped_cond);
+    g_mutex_unlock (&comp->lock);
+  }
+
+  if (!fill) {
+    gst_buffer_unref (wrapped->buffer);
+  }
+
+  /* the component was freed while we held on to this one */
+  if (orphaned) {
+    comp->orphaned = FALSE;
+    gst_droid_codec_free_component (comp, comp->orphan_unref_codec);
+  }
+
+  gst_droid_codec_component_unref (comp);
+
+  g_slice_free (GstDroidCodecWrappedBuffer, wrapped);
+}
+
+GstBuffer *
+gst_droid_codec_wrap_output_buffer (GstDroidComponent * comp,
+    OMX_BUFFERHEADERTYPE * buff)
+{
+  GstDroidCodecWrappedBuffer *wrapped;
+  GstBuffer *buffer;
+  GstMemory *mem;
+
+  GST_DEBUG_OBJECT (comp->parent, "wrap output buffer %p", buff);
+
+  wrapped = g_slice_new0 (GstDroidCodecWrappedBuffer);
+  wrapped->comp = comp;
+  wrapped->buffer = gst_omx_buffer_get_buffer (comp, buff);
+  wrapped->omx = buff;
+
+  g_atomic_int_inc (&comp->refcount);
+  g_mutex_lock (&comp->lock);
+  wrapped->generation = comp->out_generation;
+  comp->wrapped++;
+  g_mutex_unlock (&comp->lock);
+
+  /* We own the pool buffer until downstream releases the memory. The data
+   * stays valid because omx will not touch it before we call FillThisBuffer */
+  mem = gst_memory_new_wrapped (GST_MEMORY_FLAG_READONLY, buff->pBuffer,
+      buff->nAllocLen, buff->nOffset, buff->nFilledLen, wrapped,
+      (GDestroyNotify) gst_droid_codec_wrapped_buffer_released);
 
-  if (omx_buf->nAllocLen - omx_buf->nOffset < gst_buffer_get_size (codec_data)) {
-    gst_buffer_unref (buf);
-    GST_ERROR_OBJECT (comp->parent, "codec config is too large");
-    return FALSE;
-  }
+  buffer = gst_buffer_new ();
+  gst_buffer_append_memory (buffer, mem);
 
-  omx_buf->nFilledLen = gst_buffer_get_size (codec_data);
-  gst_buffer_extract (codec_data, 0,
-      omx_buf->pBuffer + omx_buf->nOffset, omx_buf->nFilledLen);
+  return buffer;
+}
+
+gboolean
+gst_droid_codec_set_port_buffer_count (GstDroidComponent * comp,
+    GstDroidComponentPort * port, guint count)
+{
+  OMX_ERRORTYPE err;
+  OMX_PARAM_PORTDEFINITIONTYPE def = port->def;
 
-  gst_buffer_unref (buf);
+  GST_DEBUG_OBJECT (comp->parent, "set port %li buffer count to %u",
+      port->def.nPortIndex, count);
 
-  omx_buf->nFlags = OMX_BUFFERFLAG_CODECCONFIG | OMX_BUFFERFLAG_ENDOFFRAME;
-  omx_buf->nTimeStamp = 0;
-  omx_buf->nTickCount = 0;
-  omx_buf->pAppPrivate = NULL;
+  if (count < def.nBufferCountMin) {
+    GST_WARNING_OBJECT (comp->parent,
+        "port %li needs at least %li buffers", def.nPortIndex,
+        def.nBufferCountMin);
+    count = def.nBufferCountMin;
+  }
 
-  err = OMX_EmptyThisBuffer (comp->omx, omx_buf);
+  def.nBufferCountActual = count;
 
+  err = gst_droid_codec_set_param (comp, OMX_IndexParamPortDefinition, &def);
   if (err != OMX_ErrorNone) {
-    GST_ERROR ("got error %s (0x%08x) while calling EmptyThisBuffer",
+    GST_ERROR_OBJECT (comp->parent,
+        "got error %s (0x%08x) setting port definition",
         gst_omx_error_to_string (err), err);
+    return FALSE;
+  }
 
+  err =
+      gst_droid_codec_get_param (comp, OMX_IndexParamPortDefinition,
+      &port->def);
+  if (err != OMX_ErrorNone) {
+    GST_ERROR_OBJECT (comp->parent,
+        "got error %s (0x%08x) getting port definition",
+        gst_omx_error_to_string (err), err);
     return FALSE;
   }
 
   return TRUE;
 }
 
-GstBuffer *
-gst_omx_buffer_get_buffer (GstDroidComponent * comp,
-    OMX_BUFFERHEADERTYPE * buff)
+/* Input buffers are split between a pool for upstream to fill and one we
+ * copy into so copying never depends on upstream returning buffers */
+void
+gst_droid_codec_set_share_input (GstDroidComponent * comp)
 {
-  GST_DEBUG_OBJECT (comp->parent, "get buffer");
-
-  return (GstBuffer *) buff->pAppPrivate;
+  comp->share_input = TRUE;
 }
 
-gboolean
-gst_droid_codec_return_output_buffers (GstDroidComponent * comp)
+/* Whether the stream caps describe can not have frames which are shown in
+ * a different order than they are decoded in */
+static gboolean
+gst_droid_codec_is_decode_order (GstCaps * caps)
 {
-  GstBuffer *buffer;
-  GstBufferPoolAcquireParams params;
-  OMX_ERRORTYPE err;
+  GstStructure *s = gst_caps_get_structure (caps, 0);
+  const gchar *profile = gst_structure_get_string (s, "profile");
 
-  GST_DEBUG_OBJECT (comp->parent, "return output buffers");
+  if (gst_structure_has_name (s, "video/x-h263")
+      || gst_structure_has_name (s, "video/x-vp8")) {
+    return TRUE;
+  }
 
-  params.flags = GST_BUFFER_POOL_ACQUIRE_FLAG_DONTWAIT;
-  while (gst_buffer_pool_acquire_buffer (comp->out_port->buffers, &buffer,
-          &params) == GST_FLOW_OK) {
-    OMX_BUFFERHEADERTYPE *omx;
+  /* no B frames */
+  if (gst_structure_has_name (s, "video/x-h264")) {
+    return !g_strcmp0 (profile, "baseline")
+        || !g_strcmp0 (profile, "constrained-baseline");
+  }
 
-    if (comp->out_port->usage != -1) {
-      GstMemory *mem = gst_buffer_peek_memory (buffer, 0);
-      if (!gst_is_gralloc_memory (mem)) {
-        GstMemory *gralloc =
-            gst_droid_codec_gralloc_allocator_get_gralloc_memory (mem);
-        if (!gralloc) {
-          // TODO: error
-        }
+  if (gst_structure_has_name (s, "video/mpeg")) {
+    return !g_strcmp0 (profile, "simple");
+  }
 
-        gst_memory_ref (gralloc);
+  return FALSE;
+}
 
-        gst_buffer_insert_memory (buffer, 0, gralloc);
-        GST_BUFFER_FLAG_UNSET (buffer, GST_BUFFER_FLAG_TAG_MEMORY);
-      }
+gboolean
+gst_droid_codec_set_low_latency (GstDroidComponent * comp, GstCaps * caps)
+{
+  OMX_ERRORTYPE err;
+  OMX_INDEXTYPE extension;
+  QOMX_VIDEO_DECODER_PICTURE_ORDER order;
+  OMX_STRING ext = "OMX.QCOM.index.param.video.DecoderPictureOrder";
 
-      omx =
-          gst_droid_codec_gralloc_allocator_get_omx_buffer
-          (gst_buffer_peek_memory (buffer, 1));
-    } else {
-      omx =
-          gst_droid_codec_omx_allocator_get_omx_buffer (gst_buffer_peek_memory
-          (buffer, 0));
-    }
+  GST_DEBUG_OBJECT (comp->parent, "set low latency");
 
-    /* reset buffer */
-    omx->nFilledLen = 0;
-    omx->nOffset = 0;
-    omx->nFlags = 0;
-    omx->pAppPrivate = buffer;
+  /* Output in decode order means no frames are held back for reordering.
+   * Streams which reorder would be shown in the wrong order so only ask
+   * when caps rule that out */
+  if (!gst_droid_codec_is_decode_order (caps)) {
+    GST_INFO_OBJECT (comp->parent,
+        "stream might reorder frames, keeping display order output");
+    goto out;
+  }
 
-    GST_DEBUG_OBJECT (comp->parent, "handing buffer %p to the omx codec",
-        buffer);
+  err = OMX_GetExtensionIndex (comp->omx, ext, &extension);
+  if (err != OMX_ErrorNone) {
+    GST_INFO_OBJECT (comp->parent,
+        "got error %s (0x%08x) while getting extension %s index",
+        gst_omx_error_to_string (err), err, ext);
+    goto out;
+  }
 
-    err = OMX_FillThisBuffer (comp->omx, omx);
+  GST_OMX_INIT_STRUCT (&order);
+  order.nPortIndex = comp->out_port->def.nPortIndex;
+  order.eOutputPictureOrder = QOMX_VIDEO_DECODE_ORDER;
 
-    if (err != OMX_ErrorNone) {
-      return FALSE;
-    }
+  err = gst_droid_codec_set_param (comp, extension, &order);
+  if (err != OMX_ErrorNone) {
+    GST_INFO_OBJECT (comp->parent,
+        "got error %s (0x%08x) setting decode order output",
+        gst_omx_error_to_string (err), err);
   }
 
-  GST_DEBUG_OBJECT (comp->parent, "returned output buffers");
+out:
 
-  return TRUE;
+  return gst_droid_codec_set_port_buffer_count (comp, comp->out_port,
+      comp->out_port->def.nBufferCountMin + LOW_LATENCY_EXTRA_BUFFERS);
 }
 
 void
@@ -1259,6 +3201,73 @@ gst_droid_codec_unset_needs_reconfigure (GstDroidComponent * comp)
   g_mutex_unlock (&comp->lock);
 }
 
+gboolean
+gst_droid_codec_take_crop_change (GstDroidComponent * comp)
+{
+  gboolean ret;
+
+  g_mutex_lock (&comp->lock);
+  ret = comp->crop_changed;
+  comp->crop_changed = FALSE;
+  g_mutex_unlock (&comp->lock);
+
+  return ret;
+}
+
+gboolean
+gst_droid_codec_get_output_crop (GstDroidComponent * comp,
+    GstVideoRectangle * rect)
+{
+  OMX_CONFIG_RECTTYPE crop;
+  OMX_ERRORTYPE err;
+  OMX_U32 max_width, max_height;
+
+  GST_OMX_INIT_STRUCT (&crop);
+  crop.nPortIndex = comp->out_port->def.nPortIndex;
+
+  err =
+      gst_droid_codec_get_config (comp, OMX_IndexConfigCommonOutputCrop, &crop);
+  if (err != OMX_ErrorNone) {
+    GST_WARNING_OBJECT (comp->parent,
+        "got error %s (0x%08x) getting output crop",
+        gst_omx_error_to_string (err), err);
+    return FALSE;
+  }
+
+  GST_DEBUG_OBJECT (comp->parent, "output crop %lux%lu+%ld+%ld",
+      crop.nWidth, crop.nHeight, crop.nLeft, crop.nTop);
+
+  /* Adaptive components keep their buffers at the largest size we told
+   * them about. A crop beyond that, or beyond the frame size otherwise,
+   * needs new buffers */
+  if (comp->adaptive) {
+    max_width = comp->handle->max_width;
+    max_height = comp->handle->max_height;
+  } else {
+    max_width = comp->out_port->def.format.video.nFrameWidth;
+    max_height = comp->out_port->def.format.video.nFrameHeight;
+  }
+
+  if (crop.nLeft < 0 || crop.nTop < 0
+      || crop.nLeft + crop.nWidth > max_width
+      || crop.nTop + crop.nHeight > max_height) {
+    GST_INFO_OBJECT (comp->parent,
+        "output crop does not fit in %lux%lu buffers", max_width, max_height);
+    g_mutex_lock (&comp->lock);
+    comp->needs_reconfigure = TRUE;
+    g_mutex_unlock (&comp->lock);
+    gst_droid_codec_wake_input (comp);
+    return FALSE;
+  }
+
+  rect->x = crop.nLeft;
+  rect->y = crop.nTop;
+  rect->w = crop.nWidth;
+  rect->h = crop.nHeight;
+
+  return TRUE;
+}
+
 gboolean
 gst_droid_codec_needs_reconfigure (GstDroidComponent * comp)
 {
@@ -1300,6 +3309,13 @@ gst_droid_codec_set_running (GstDroidComponent * comp, gboolean running)
   g_mutex_lock (&comp->lock);
   comp->started = running;
   g_mutex_unlock (&comp->lock);
+
+  /* wake up the src pad task if it's waiting for output */
+  if (comp->full) {
+    gst_droid_codec_ring_set_flushing (comp->full, !running);
+  }
+
+  gst_droid_codec_wake_input (comp);
 }
 
 gboolean
@@ -1309,15 +3325,24 @@ gst_droid_codec_reconfigure_output_port (GstDroidComponent * comp)
 
   GST_DEBUG_OBJECT (comp->parent, "reconfigure output port");
 
+  gst_droid_codec_stats_add (&comp->stats.reconfigurations, 1);
+
   /* disable port */
   if (!gst_droid_codec_set_port_enabled (comp, comp->out_port->def.nPortIndex,
           FALSE)) {
     return FALSE;
   }
 
-  g_mutex_lock (&comp->full_lock);
-  gst_droid_codec_pop_full_locked (comp);
-  g_mutex_unlock (&comp->full_lock);
+  gst_droid_codec_empty_full (comp);
+
+  g_mutex_lock (&comp->lock);
+  comp->out_generation++;
+  g_mutex_unlock (&comp->lock);
+
+  /* the port is not disabled until all its buffers are freed */
+  if (!gst_droid_codec_wait_for_wrapped (comp)) {
+    return FALSE;
+  }
 
   /* free buffers */
   gst_buffer_pool_set_active (comp->out_port->buffers, FALSE);
@@ -1340,7 +3365,7 @@ gst_droid_codec_reconfigure_output_port (GstDroidComponent * comp)
     return FALSE;
   }
 
-  return TRUE;
+  return gst_droid_codec_create_full_ring (comp);
 }
 
 gboolean
@@ -1350,9 +3375,9 @@ gst_droid_codec_flush (GstDroidComponent * comp, gboolean pause)
   GST_DEBUG_OBJECT (comp->parent, "flush %d", pause);
 
   if (pause) {
-    g_mutex_lock (&comp->lock);
-    comp->started = FALSE;
-    g_mutex_unlock (&comp->lock);
+    gst_droid_codec_stats_add (&comp->stats.flushes, 1);
+
+    gst_droid_codec_set_running (comp, FALSE);
 
     /* set state to pause */
     if (!gst_droid_codec_set_state (comp, OMX_StatePause)) {
@@ -1372,6 +3397,9 @@ gst_droid_codec_flush (GstDroidComponent * comp, gboolean pause)
           gst_omx_error_to_string (err), err);
       return FALSE;
     }
+
+    /* nothing we submitted will come back */
+    gst_droid_codec_clear_frames (comp);
   } else {
     /* set state to executing */
     if (!gst_droid_codec_set_state (comp, OMX_StateExecuting)) {
@@ -1391,9 +3419,7 @@ gst_droid_codec_flush (GstDroidComponent * comp, gboolean pause)
       return FALSE;
     }
 
-    g_mutex_lock (&comp->lock);
-    comp->started = TRUE;
-    g_mutex_unlock (&comp->lock);
+    gst_droid_codec_set_running (comp, TRUE);
   }
 
   return TRUE;
@@ -1407,6 +3433,7 @@ gst_droid_codec_get_encoder_profile_level (GstDroidComponent * comp,
   /* stolen from android OMXCodec.cpp */
   OMX_VIDEO_PARAM_PROFILELEVELTYPE param;
   OMX_ERRORTYPE err;
+  const GstDroidCodecProbe *probe;
 
   if (user.mProfile == -1) {
     user.mProfile = defaultProfileLevel.mProfile;
@@ -1419,6 +3446,18 @@ gst_droid_codec_get_encoder_profile_level (GstDroidComponent * comp,
   GST_DEBUG_OBJECT (comp->parent, "requested profile: 0x%lx, level: 0x%lx",
       user.mProfile, user.mLevel);
 
+  /* We already asked the component when it was probed */
+  probe = gst_droid_codec_probe_lookup (comp->handle->type);
+  if (probe && probe->profile_levels->len > 0) {
+    if (gst_droid_codec_probe_supports (probe, user.mProfile, user.mLevel)) {
+      profileLevel->mProfile = user.mProfile;
+      profileLevel->mLevel = user.mLevel;
+      return TRUE;
+    }
+
+    goto unsupported;
+  }
+
   GST_OMX_INIT_STRUCT (&param);
 
   param.nPortIndex = port;
@@ -1447,6 +3486,7 @@ gst_droid_codec_get_encoder_profile_level (GstDroidComponent * comp,
     }
   }
 
+unsupported:
   GST_ERROR_OBJECT (comp->parent,
       "profile (0x%lx) and level (0x%lx) are not supported", user.mProfile,
       user.mLevel);
@@ -1454,9 +3494,72 @@ gst_droid_codec_get_encoder_profile_level (GstDroidComponent * comp,
   return FALSE;
 }
 
+static gboolean
+gst_droid_codec_apply_vp8_encoding_params (GstDroidComponent * comp,
+    GstCaps * caps)
+{
+  OMX_VIDEO_PARAM_VP8TYPE vp8type;
+  OMX_ERRORTYPE err;
+  GstStructure *s;
+  const gchar *profile;
+  int level;
+
+  GST_DEBUG_OBJECT (comp->parent, "apply vp8 encoding params");
+
+  GST_OMX_INIT_STRUCT (&vp8type);
+  vp8type.nPortIndex = comp->out_port->def.nPortIndex;
+
+  err =
+      gst_droid_codec_get_param (comp, (OMX_INDEXTYPE) OMX_IndexParamVideoVp8,
+      &vp8type);
+  if (err != OMX_ErrorNone) {
+    GST_ERROR_OBJECT (comp->parent,
+        "got error %s (0x%08x) getting OMX_IndexParamVideoVp8",
+        gst_omx_error_to_string (err), err);
+    return FALSE;
+  }
+
+  vp8type.eProfile = OMX_VIDEO_VP8ProfileMain;
+
+  s = gst_caps_get_structure (caps, 0);
+  profile = gst_structure_get_string (s, "profile");
+  level = gst_encoder_params_get_vp8_level (profile);
+  if (level != -1) {
+    vp8type.eLevel = level;
+  } else if (profile) {
+    GST_WARNING_OBJECT (comp->parent, "unknown vp8 profile %s", profile);
+  }
+
+  err =
+      gst_droid_codec_set_param (comp, (OMX_INDEXTYPE) OMX_IndexParamVideoVp8,
+      &vp8type);
+  if (err != OMX_ErrorNone) {
+    GST_ERROR_OBJECT (comp->parent,
+        "got error %s (0x%08x) setting OMX_IndexParamVideoVp8",
+        gst_omx_error_to_string (err), err);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+static OMX_U32
+gst_droid_codec_get_p_frames (const GstDroidCodecEncodingParams * params,
+    int fps)
+{
+  if (params->keyframe_interval == 0) {
+    /* only the first frame is a keyframe */
+    return G_MAXUINT32;
+  } else if (params->keyframe_interval > 0) {
+    return params->keyframe_interval - 1;
+  }
+
+  return fps > 0 ? fps - 1 : 0;
+}
+
 static gboolean
 gst_droid_codec_apply_mpeg4video_encoding_params (GstDroidComponent * comp,
-    GstCaps * caps, int fps)
+    GstCaps * caps, const GstDroidCodecEncodingParams * params, int fps)
 {
   /* stolen from android OMXCodec.cpp */
 
@@ -1477,12 +3580,12 @@ gst_droid_codec_apply_mpeg4video_encoding_params (GstDroidComponent * comp,
     return FALSE;
   }
 
-  mpeg4type.nSliceHeaderSpacing = 0;
+  mpeg4type.nSliceHeaderSpacing = params->slice_size;
   mpeg4type.bSVH = OMX_FALSE;
   mpeg4type.bGov = OMX_FALSE;
   mpeg4type.nAllowedPictureTypes =
       OMX_VIDEO_PictureTypeI | OMX_VIDEO_PictureTypeP;
-  mpeg4type.nPFrames = fps - 1;
+  mpeg4type.nPFrames = gst_droid_codec_get_p_frames (params, fps);
 
   if (mpeg4type.nPFrames == 0) {
     mpeg4type.nAllowedPictureTypes = OMX_VIDEO_PictureTypeI;
@@ -1529,7 +3632,7 @@ gst_droid_codec_apply_mpeg4video_encoding_params (GstDroidComponent * comp,
 
 static gboolean
 gst_droid_codec_apply_avc_encoding_params (GstDroidComponent * comp,
-    GstCaps * caps, int fps)
+    GstCaps * caps, const GstDroidCodecEncodingParams * params, int fps)
 {
   /* stolen from android OMXCodec.cpp */
 
@@ -1583,11 +3686,11 @@ gst_droid_codec_apply_avc_encoding_params (GstDroidComponent * comp,
   }
 
   if (h264type.eProfile == OMX_VIDEO_AVCProfileBaseline) {
-    h264type.nSliceHeaderSpacing = 0;
+    h264type.nSliceHeaderSpacing = params->slice_size;
     h264type.bUseHadamard = OMX_TRUE;
     h264type.nRefFrames = 1;
     h264type.nBFrames = 0;
-    h264type.nPFrames = fps - 1;
+    h264type.nPFrames = gst_droid_codec_get_p_frames (params, fps);
 
     if (h264type.nPFrames == 0) {
       h264type.nAllowedPictureTypes = OMX_VIDEO_PictureTypeI;
@@ -1627,14 +3730,17 @@ gst_droid_codec_apply_avc_encoding_params (GstDroidComponent * comp,
 }
 
 static gboolean
-gst_droid_codec_apply_bitrate (GstDroidComponent * comp, int bitrate, int port)
+gst_droid_codec_apply_bitrate (GstDroidComponent * comp,
+    const GstDroidCodecEncodingParams * params, int port)
 {
   OMX_VIDEO_PARAM_BITRATETYPE bitrateType;
   OMX_ERRORTYPE err;
 
-  GST_DEBUG_OBJECT (comp->parent, "apply bitrate %i", bitrate);
+  GST_DEBUG_OBJECT (comp->parent, "apply bitrate %u with control rate %d",
+      params->bitrate, params->control_rate);
 
-  if (bitrate == GST_DROID_ENC_TARGET_BITRATE_DEFAULT) {
+  if (params->bitrate == GST_DROID_ENC_TARGET_BITRATE_DEFAULT
+      && params->control_rate == GST_DROID_ENC_CONTROL_RATE_DEFAULT) {
     GST_INFO_OBJECT (comp->parent, "bitrate is the default");
     return TRUE;
   }
@@ -1653,8 +3759,10 @@ gst_droid_codec_apply_bitrate (GstDroidComponent * comp, int bitrate, int port)
     return FALSE;
   }
 
-  bitrateType.eControlRate = OMX_Video_ControlRateVariable;
-  bitrateType.nTargetBitrate = bitrate;
+  bitrateType.eControlRate = params->control_rate;
+  if (params->bitrate != GST_DROID_ENC_TARGET_BITRATE_DEFAULT) {
+    bitrateType.nTargetBitrate = params->bitrate;
+  }
 
   err =
       gst_droid_codec_set_param (comp, OMX_IndexParamVideoBitrate,
@@ -1669,9 +3777,102 @@ gst_droid_codec_apply_bitrate (GstDroidComponent * comp, int bitrate, int port)
   return TRUE;
 }
 
+gboolean
+gst_droid_codec_update_bitrate (GstDroidComponent * comp, guint bitrate)
+{
+  OMX_VIDEO_CONFIG_BITRATETYPE config;
+  OMX_ERRORTYPE err;
+
+  GST_DEBUG_OBJECT (comp->parent, "update bitrate to %u", bitrate);
+
+  GST_OMX_INIT_STRUCT (&config);
+  config.nPortIndex = comp->out_port->def.nPortIndex;
+  config.nEncodeBitrate = bitrate;
+
+  err =
+      gst_droid_codec_set_config (comp, OMX_IndexConfigVideoBitrate, &config);
+  if (err != OMX_ErrorNone) {
+    GST_WARNING_OBJECT (comp->parent,
+        "got error %s (0x%08x) setting OMX_IndexConfigVideoBitrate",
+        gst_omx_error_to_string (err), err);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+gboolean
+gst_droid_codec_update_framerate (GstDroidComponent * comp, gint fps_n,
+    gint fps_d)
+{
+  OMX_CONFIG_FRAMERATETYPE config;
+  OMX_ERRORTYPE err;
+
+  GST_DEBUG_OBJECT (comp->parent, "update framerate to %d/%d", fps_n, fps_d);
+
+  if (fps_n == 0 || fps_d == 0) {
+    return TRUE;
+  }
+
+  GST_OMX_INIT_STRUCT (&config);
+  config.nPortIndex = comp->out_port->def.nPortIndex;
+  /* Q16 */
+  config.xEncodeFramerate = ((guint64) fps_n << 16) / fps_d;
+
+  err =
+      gst_droid_codec_set_config (comp, OMX_IndexConfigVideoFramerate,
+      &config);
+  if (err != OMX_ErrorNone) {
+    GST_WARNING_OBJECT (comp->parent,
+        "got error %s (0x%08x) setting OMX_IndexConfigVideoFramerate",
+        gst_omx_error_to_string (err), err);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+static gboolean
+gst_droid_codec_apply_intra_refresh (GstDroidComponent * comp, guint mbs)
+{
+  OMX_VIDEO_PARAM_INTRAREFRESHTYPE refresh;
+  OMX_ERRORTYPE err;
+
+  GST_DEBUG_OBJECT (comp->parent, "apply cyclic intra refresh of %u mbs", mbs);
+
+  GST_OMX_INIT_STRUCT (&refresh);
+  refresh.nPortIndex = comp->out_port->def.nPortIndex;
+
+  err =
+      gst_droid_codec_get_param (comp, OMX_IndexParamVideoIntraRefresh,
+      &refresh);
+  if (err != OMX_ErrorNone) {
+    GST_ERROR_OBJECT (comp->parent,
+        "got error %s (0x%08x) getting OMX_IndexParamVideoIntraRefresh",
+        gst_omx_error_to_string (err), err);
+    return FALSE;
+  }
+
+  refresh.eRefreshMode = OMX_VIDEO_IntraRefreshCyclic;
+  refresh.nCirMBs = mbs;
+
+  err =
+      gst_droid_codec_set_param (comp, OMX_IndexParamVideoIntraRefresh,
+      &refresh);
+  if (err != OMX_ErrorNone) {
+    GST_ERROR_OBJECT (comp->parent,
+        "got error %s (0x%08x) setting OMX_IndexParamVideoIntraRefresh",
+        gst_omx_error_to_string (err), err);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
 gboolean
 gst_droid_codec_apply_encoding_params (GstDroidComponent * comp,
-    GstVideoInfo * info, GstCaps * caps, int bitrate)
+    GstVideoInfo * info, GstCaps * caps,
+    const GstDroidCodecEncodingParams * params)
 {
   gboolean ret;
   int fps;
@@ -1681,9 +3882,13 @@ gst_droid_codec_apply_encoding_params (GstDroidComponent * comp,
   fps = info->fps_n / info->fps_d;
 
   if (!g_strcmp0 (comp->handle->type, GST_DROID_CODEC_TYPE_MPEG4VIDEO_ENC)) {
-    ret = gst_droid_codec_apply_mpeg4video_encoding_params (comp, caps, fps);
+    ret =
+        gst_droid_codec_apply_mpeg4video_encoding_params (comp, caps, params,
+        fps);
   } else if (!g_strcmp0 (comp->handle->type, GST_DROID_CODEC_TYPE_AVC_ENC)) {
-    ret = gst_droid_codec_apply_avc_encoding_params (comp, caps, fps);
+    ret = gst_droid_codec_apply_avc_encoding_params (comp, caps, params, fps);
+  } else if (!g_strcmp0 (comp->handle->type, GST_DROID_CODEC_TYPE_VP8_ENC)) {
+    ret = gst_droid_codec_apply_vp8_encoding_params (comp, caps);
   } else {
     GST_ERROR_OBJECT ("unknown encoder type %s", comp->handle->type);
     ret = FALSE;
@@ -1721,8 +3926,12 @@ gst_droid_codec_apply_encoding_params (GstDroidComponent * comp,
     }
   }
 
+  if (ret && params->intra_refresh > 0) {
+    ret = gst_droid_codec_apply_intra_refresh (comp, params->intra_refresh);
+  }
+
   if (ret) {
-    return gst_droid_codec_apply_bitrate (comp, bitrate,
+    return gst_droid_codec_apply_bitrate (comp, params,
         comp->out_port->def.nPortIndex);
   }
 
@@ -28,9 +28,19 @@
 #include <OMX_Core.h>
 #include <OMX_Component.h>
 
+#include "gstdroidcodecring.h"
+
 G_BEGIN_DECLS
 
 #define GST_DROID_ENC_TARGET_BITRATE_DEFAULT (0xffffffff)
+#define GST_DROID_ENC_CONTROL_RATE_DEFAULT OMX_Video_ControlRateVariable
+/* one keyframe per second */
+#define GST_DROID_ENC_KEYFRAME_INTERVAL_DEFAULT -1
+#define GST_DROID_ENC_SLICE_SIZE_DEFAULT 0
+#define GST_DROID_ENC_INTRA_REFRESH_DEFAULT 0
+#define GST_DROID_CODEC_PRIORITY_DEFAULT 0
+/* ms */
+#define GST_DROID_CODEC_ADMISSION_TIMEOUT_DEFAULT 0
 
 #define GST_TYPE_DROID_CODEC (gst_droid_codec_get_type())
 
@@ -46,6 +56,8 @@ typedef struct _GstDroidCodec GstDroidCodec;
 typedef struct _GstDroidComponent GstDroidComponent;
 typedef struct _GstDroidCodecHandle GstDroidCodecHandle;
 typedef struct _GstDroidComponentPort GstDroidComponentPort;
+typedef struct _GstDroidComponentStats GstDroidComponentStats;
+typedef struct _GstDroidCodecEncodingParams GstDroidCodecEncodingParams;
 
 struct _GstDroidCodec
 {
@@ -53,6 +65,34 @@ struct _GstDroidCodec
 
   GMutex lock;
   GHashTable *cores;
+  /* idle components per type */
+  GHashTable *pools;
+
+  /* core -> instance budget. Waiters are woken up via budget_cond */
+  GHashTable *budgets;
+  GCond budget_cond;
+};
+
+#define GST_DROID_CODEC_LATENCY_BUCKETS 8
+
+/* Updated with atomic operations from the omx callbacks and the streaming
+ * threads so nobody waits for a lock to count. Zeroed whenever the
+ * component is handed out */
+struct _GstDroidComponentStats
+{
+  guint64 frames_submitted;
+  guint64 frames_finished;
+  guint64 bytes_in;
+  guint64 bytes_out;
+  /* us spent waiting for a free input buffer */
+  guint64 input_wait;
+  guint64 full_depth_max;
+  guint64 reconfigurations;
+  guint64 flushes;
+  guint64 errors;
+  /* frames which took less than 5, 10, 20, 40, 80, 160 and 320 ms to come
+   * back from the component. The last bucket has the rest */
+  guint64 latency[GST_DROID_CODEC_LATENCY_BUCKETS];
 };
 
 struct _GstDroidComponent
@@ -66,15 +106,63 @@ struct _GstDroidComponent
   GstElement *parent;
 
   GMutex lock;
+  GCond state_cond;
   gboolean error;
   gboolean needs_reconfigure;
   gboolean started;
 
-  GMutex full_lock;
-  GCond full_cond;
-  GQueue *full;
+  /* output buffers are allocated for the largest frame we expect so
+   * resolution changes are signalled as crop changes */
+  gboolean adaptive;
+  gboolean crop_changed;
+
+  /* size of the NAL length prefixes of h264 avc input. 0 for byte-stream */
+  guint nal_length_size;
+
+  /* upstream gets input buffers of its own to fill. Set before starting */
+  gboolean share_input;
+
+  /* filled output buffers. FillBufferDone () is the only producer and the
+   * src pad task the only consumer while it's running */
+  GstDroidCodecRing *full;
+
+  /* frames handed to the component: OMX timestamp -> GQueue of
+   * system_frame_number and submission time in submission order.
+   * Protected by lock */
+  GHashTable *frames;
+
+  /* signalled when an input buffer returns to the pool or the component
+   * stops accepting input (error, reconfiguration or flush) */
+  GMutex empty_lock;
+  GCond empty_cond;
 
   OMX_STATETYPE state;
+  gint64 state_change_start;
+
+  /* when the component was put back in the pool */
+  gint64 idle_since;
+
+  /* the owner and every wrapped output buffer downstream still holds. The
+   * structure, but nothing else, lives until the last one is dropped */
+  gint refcount;
+  /* bumped under lock whenever the output port buffers are freed. Wrapped
+   * buffers from an older generation are not given back to the component */
+  guint out_generation;
+  /* protected by lock and signalled by wrapped_cond. Output buffers can not
+   * be freed while downstream holds wrapped ones (wrapped) or while they are
+   * being handed back with FillThisBuffer () (filling) */
+  GCond wrapped_cond;
+  guint wrapped;
+  guint filling;
+  /* stopping gave up waiting for wrapped buffers and left the component in
+   * idle. The buffers are freed once the last wrapped one is released */
+  gboolean unload_pending;
+  /* freed while downstream held wrapped buffers. The last one finishes
+   * the job */
+  gboolean orphaned;
+  gboolean orphan_unref_codec;
+
+  GstDroidComponentStats stats;
 };
 
 struct _GstDroidComponentPort
@@ -84,44 +172,105 @@ struct _GstDroidComponentPort
   //  GCond cond;
   OMX_PARAM_PORTDEFINITIONTYPE def;
   GstBufferPool *buffers;
+  /* input buffers proposed to upstream when share_input is set. buffers
+   * keeps the rest so copying never waits for upstream */
+  GstBufferPool *upstream;
   GstAllocator *allocator;
   GstDroidComponent *comp;
 };
 
+/* encoder configuration applied before the component is started */
+struct _GstDroidCodecEncodingParams
+{
+  guint32 bitrate;
+  OMX_VIDEO_CONTROLRATETYPE control_rate;
+  /* frames between keyframes. -1 for one second, 0 for the first frame only */
+  gint keyframe_interval;
+  /* macroblocks per slice. 0 for one slice per frame */
+  guint slice_size;
+  /* macroblocks refreshed per frame by cyclic intra refresh. 0 to disable */
+  guint intra_refresh;
+};
+
 GstDroidCodec *gst_droid_codec_get (void);
 
 GstDroidComponent *gst_droid_codec_get_component (GstDroidCodec * codec,
 						  const gchar *type, GstElement * parent);
+GstDroidComponent *gst_droid_codec_get_component_full (GstDroidCodec * codec,
+						       const gchar *type, GstElement * parent,
+						       gint priority, gint timeout);
+GstDroidComponent *gst_droid_codec_create_component (GstDroidCodec * codec,
+						     const gchar *type, GstElement * parent,
+						     gint priority, gint timeout);
 void gst_droid_codec_destroy_component (GstDroidComponent * component);
+void gst_droid_codec_put_component (GstDroidComponent * component);
+GstStructure *gst_droid_codec_get_pool_stats (GstDroidCodec * codec);
+GstStructure *gst_droid_codec_get_instance_stats (GstDroidCodec * codec);
 
 OMX_ERRORTYPE gst_droid_codec_get_param (GstDroidComponent * comp,
 					 OMX_INDEXTYPE index, gpointer param);
 OMX_ERRORTYPE gst_droid_codec_set_param (GstDroidComponent * comp,
 					 OMX_INDEXTYPE index, gpointer param);
+OMX_ERRORTYPE gst_droid_codec_get_config (GstDroidComponent * comp,
+                                         OMX_INDEXTYPE index, gpointer config);
 OMX_ERRORTYPE gst_droid_codec_set_config (GstDroidComponent * comp,
                                          OMX_INDEXTYPE index, gpointer config);
 gboolean gst_droid_codec_configure_component (GstDroidComponent *comp,
 					      const GstVideoInfo * info);
+gboolean gst_droid_codec_set_input_buffer_size (GstDroidComponent * comp,
+						gsize size);
+gboolean gst_droid_codec_configure_audio_decoder (GstDroidComponent * comp,
+						  GstCaps * caps);
+gboolean gst_droid_codec_get_pcm_format (GstDroidComponent * comp, gint * rate,
+					 gint * channels);
+gboolean gst_droid_codec_configure_audio_encoder (GstDroidComponent * comp,
+						  gint rate, gint channels,
+						  guint bitrate);
+gboolean gst_droid_codec_configure_image_decoder (GstDroidComponent * comp,
+						  gint width, gint height,
+						  guint downscale);
 gboolean gst_droid_codec_start_component (GstDroidComponent * comp, GstCaps * sink, GstCaps * src);
 void gst_droid_codec_stop_component (GstDroidComponent * comp);
 gboolean gst_droid_codec_set_codec_data (GstDroidComponent * comp, GstBuffer * codec_data);
+gboolean gst_droid_codec_set_avc_codec_data (GstDroidComponent * comp,
+					     GstBuffer * codec_data);
+gboolean gst_droid_codec_match_frame (GstDroidComponent * comp,
+				      OMX_BUFFERHEADERTYPE * buff, guint32 * frame_number,
+				      gint64 * latency);
+void gst_droid_codec_forget_frame (GstDroidComponent * comp,
+				   GstVideoCodecFrame * frame);
 gboolean gst_droid_codec_consume_frame (GstDroidComponent * comp, GstVideoCodecFrame * frame);
+gboolean gst_droid_codec_consume_buffer (GstDroidComponent * comp, GstBuffer * buffer);
+void gst_droid_codec_add_component_stats (GstDroidComponent * comp, GstStructure * s);
 GstBuffer *gst_omx_buffer_get_buffer (GstDroidComponent * comp, OMX_BUFFERHEADERTYPE * buff);
 
 gboolean gst_droid_codec_return_output_buffers (GstDroidComponent * comp);
+GstBuffer *gst_droid_codec_wrap_output_buffer (GstDroidComponent * comp, OMX_BUFFERHEADERTYPE * buff);
+gboolean gst_droid_codec_set_port_buffer_count (GstDroidComponent * comp,
+						GstDroidComponentPort * port, guint count);
 
 gboolean gst_droid_codec_reconfigure_output_port (GstDroidComponent * comp);
+gboolean gst_droid_codec_set_low_latency (GstDroidComponent * comp,
+					  GstCaps * caps);
+void gst_droid_codec_set_share_input (GstDroidComponent * comp);
 
 gboolean gst_droid_codec_has_error (GstDroidComponent * comp);
 gboolean gst_droid_codec_needs_reconfigure (GstDroidComponent * comp);
 void gst_droid_codec_unset_needs_reconfigure (GstDroidComponent * comp);
+gboolean gst_droid_codec_take_crop_change (GstDroidComponent * comp);
+gboolean gst_droid_codec_get_output_crop (GstDroidComponent * comp,
+					  GstVideoRectangle * rect);
 gboolean gst_droid_codec_is_running (GstDroidComponent * comp);
 void gst_droid_codec_set_running (GstDroidComponent * comp, gboolean running);
 
 void gst_droid_codec_empty_full (GstDroidComponent * comp);
 gboolean gst_droid_codec_flush (GstDroidComponent * comp, gboolean pause);
 gboolean gst_droid_codec_apply_encoding_params (GstDroidComponent * comp,
-    GstVideoInfo * info, GstCaps * caps, int bitrate);
+    GstVideoInfo * info, GstCaps * caps,
+    const GstDroidCodecEncodingParams * params);
+
+gboolean gst_droid_codec_update_bitrate (GstDroidComponent * comp, guint bitrate);
+gboolean gst_droid_codec_update_framerate (GstDroidComponent * comp, gint fps_n, gint fps_d);
 
 void gst_droid_codec_timestamp (GstBuffer * buffer, OMX_BUFFERHEADERTYPE * buff);
 
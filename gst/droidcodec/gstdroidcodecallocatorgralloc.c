@@ -153,10 +153,19 @@ gst_droid_codec_gralloc_allocator_alloc (GstAllocator * allocator, gsize size,
     return NULL;
   }
 
-  gralloc = gst_gralloc_allocator_alloc (alloc->gralloc,
-      alloc->port->def.format.video.nFrameWidth,
-      alloc->port->def.format.video.nFrameHeight,
-      alloc->port->def.format.video.eColorFormat, alloc->port->usage);
+  /* image and video port definitions do not share a layout */
+  if (alloc->port->def.eDomain == OMX_PortDomainImage) {
+    gralloc = gst_gralloc_allocator_alloc (alloc->gralloc,
+        alloc->port->def.format.image.nFrameWidth,
+        alloc->port->def.format.image.nFrameHeight,
+        alloc->port->def.format.image.eColorFormat, alloc->port->usage);
+  } else {
+    gralloc = gst_gralloc_allocator_alloc (alloc->gralloc,
+        alloc->port->def.format.video.nFrameWidth,
+        alloc->port->def.format.video.nFrameHeight,
+        alloc->port->def.format.video.eColorFormat, alloc->port->usage);
+  }
+
   if (!gralloc) {
     GST_ERROR_OBJECT (alloc->port->comp->parent,
         "error allocating gralloc memory");
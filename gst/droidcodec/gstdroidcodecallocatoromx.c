@@ -77,7 +77,9 @@ static gpointer
 gst_omx_mem_mem_map (GstMemory * mem, gsize maxsize, GstMapFlags flags)
 {
   GstDroidCodecOmxMemory *omx_mem = (GstDroidCodecOmxMemory *) mem;
-  return omx_mem->omx_buf->pBuffer + omx_mem->mem.offset;
+
+  /* gst_memory_map () adds the memory offset itself */
+  return omx_mem->omx_buf->pBuffer;
 }
 
 static void
@@ -0,0 +1,328 @@
+/*
+ * gst-droid
+ *
+ * Copyright (C) 2014 Mohammed Sameer <msameer@foolab.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "gstdroidcodecprobe.h"
+#include "gstdroidcodec.h"
+#include "gstdroidcodectype.h"
+#include "gstdroidcodecregistry.h"
+#include "plugin.h"
+#include <glib/gstdio.h>
+
+GST_DEBUG_CATEGORY_EXTERN (gst_droid_codec_debug);
+#define GST_CAT_DEFAULT gst_droid_codec_debug
+
+#define CACHE_FILE "droidcodec-probe.cache"
+
+/* Some components never stop returning entries */
+#define MAX_QUERY_INDEX 64
+
+static GMutex probe_lock;
+static GHashTable *probes = NULL;
+static GKeyFile *cache = NULL;
+
+static GstDroidCodecProbe *
+gst_droid_codec_probe_new (const gchar * type)
+{
+  GstDroidCodecProbe *probe = g_slice_new0 (GstDroidCodecProbe);
+
+  probe->type = g_strdup (type);
+  probe->profile_levels =
+      g_array_new (FALSE, FALSE, sizeof (GstDroidCodecProfileLevel));
+
+  return probe;
+}
+
+static void
+gst_droid_codec_probe_free (GstDroidCodecProbe * probe)
+{
+  g_free (probe->type);
+  g_array_free (probe->profile_levels, TRUE);
+  g_slice_free (GstDroidCodecProbe, probe);
+}
+
+static gchar *
+gst_droid_codec_probe_get_cache_path (void)
+{
+  return g_build_path ("/", g_get_user_cache_dir (), "gst-droid", CACHE_FILE,
+      NULL);
+}
+
+static void
+gst_droid_codec_probe_load_cache (void)
+{
+  gchar *path = gst_droid_codec_probe_get_cache_path ();
+
+  cache = g_key_file_new ();
+
+  if (!g_key_file_load_from_file (cache, path, 0, NULL)) {
+    GST_DEBUG ("no usable probe cache in %s", path);
+  }
+
+  g_free (path);
+}
+
+static void
+gst_droid_codec_probe_save_cache (void)
+{
+  GError *error = NULL;
+  gchar *path = gst_droid_codec_probe_get_cache_path ();
+  gchar *dir = g_path_get_dirname (path);
+  gchar *data;
+  gsize size;
+
+  if (g_mkdir_with_parents (dir, 0755) != 0) {
+    GST_WARNING ("failed to create %s", dir);
+    goto out;
+  }
+
+  data = g_key_file_to_data (cache, &size, NULL);
+
+  if (!g_file_set_contents (path, data, size, &error)) {
+    GST_WARNING ("error %s writing %s", error->message, path);
+    g_error_free (error);
+  }
+
+  g_free (data);
+
+out:
+  g_free (dir);
+  g_free (path);
+}
+
+static GstDroidCodecProbe *
+gst_droid_codec_probe_from_cache (const GstDroidCodecInfo * info)
+{
+  GstDroidCodecProbe *probe;
+  gint *profiles, *levels;
+  gsize profiles_len = 0, levels_len = 0;
+  gsize x;
+
+  if (!g_key_file_has_group (cache, info->type)) {
+    return NULL;
+  }
+
+  if (g_key_file_get_int64 (cache, info->type, "mtime", NULL) != info->mtime) {
+    GST_INFO ("probe cache for %s is outdated", info->type);
+    return NULL;
+  }
+
+  probe = gst_droid_codec_probe_new (info->type);
+  probe->usable = g_key_file_get_boolean (cache, info->type, "usable", NULL);
+
+  profiles = g_key_file_get_integer_list (cache, info->type, "profiles",
+      &profiles_len, NULL);
+  levels = g_key_file_get_integer_list (cache, info->type, "levels",
+      &levels_len, NULL);
+
+  for (x = 0; x < MIN (profiles_len, levels_len); x++) {
+    GstDroidCodecProfileLevel pl;
+    pl.profile = profiles[x];
+    pl.level = levels[x];
+    g_array_append_val (probe->profile_levels, pl);
+  }
+
+  g_free (profiles);
+  g_free (levels);
+
+  return probe;
+}
+
+static void
+gst_droid_codec_probe_to_cache (const GstDroidCodecInfo * info,
+    GstDroidCodecProbe * probe)
+{
+  gint *profiles = g_new (gint, probe->profile_levels->len + 1);
+  gint *levels = g_new (gint, probe->profile_levels->len + 1);
+  guint x;
+
+  for (x = 0; x < probe->profile_levels->len; x++) {
+    GstDroidCodecProfileLevel *pl =
+        &g_array_index (probe->profile_levels, GstDroidCodecProfileLevel, x);
+    profiles[x] = pl->profile;
+    levels[x] = pl->level;
+  }
+
+  g_key_file_set_int64 (cache, info->type, "mtime", info->mtime);
+  g_key_file_set_boolean (cache, info->type, "usable", probe->usable);
+  g_key_file_set_integer_list (cache, info->type, "profiles", profiles,
+      probe->profile_levels->len);
+  g_key_file_set_integer_list (cache, info->type, "levels", levels,
+      probe->profile_levels->len);
+
+  g_free (profiles);
+  g_free (levels);
+
+  gst_droid_codec_probe_save_cache ();
+}
+
+static void
+gst_droid_codec_probe_component (GstDroidComponent * comp,
+    GstDroidCodecProbe * probe)
+{
+  OMX_VIDEO_PARAM_PROFILELEVELTYPE param;
+  GstDroidComponentPort *compressed;
+  GstDroidCodecTypeType type = gst_droid_codec_type_get_type (probe->type);
+
+  if (type == GST_DROID_CODEC_DECODER_AUDIO
+      || type == GST_DROID_CODEC_ENCODER_AUDIO
+      || type == GST_DROID_CODEC_DECODER_IMAGE) {
+    /* nothing to query. Being able to create it is all we need */
+    return;
+  }
+
+  if (type == GST_DROID_CODEC_DECODER) {
+    compressed = comp->in_port;
+  } else {
+    compressed = comp->out_port;
+  }
+
+  GST_OMX_INIT_STRUCT (&param);
+  param.nPortIndex = compressed->def.nPortIndex;
+
+  for (param.nProfileIndex = 0; param.nProfileIndex < MAX_QUERY_INDEX;
+      param.nProfileIndex++) {
+    GstDroidCodecProfileLevel pl;
+
+    if (gst_droid_codec_get_param (comp,
+            OMX_IndexParamVideoProfileLevelQuerySupported,
+            &param) != OMX_ErrorNone) {
+      break;
+    }
+
+    GST_DEBUG ("%s supports profile 0x%lx, level 0x%lx", probe->type,
+        param.eProfile, param.eLevel);
+
+    pl.profile = param.eProfile;
+    pl.level = param.eLevel;
+    g_array_append_val (probe->profile_levels, pl);
+  }
+}
+
+static GstDroidCodecProbe *
+gst_droid_codec_probe_run (const gchar * type)
+{
+  GstDroidCodec *codec = gst_droid_codec_get ();
+  GstDroidComponent *comp;
+  GstDroidCodecProbe *probe = gst_droid_codec_probe_new (type);
+
+  GST_INFO ("probing %s", type);
+
+  /* This runs for caps queries so never wait for an instance to free up.
+   * Idle components are left alone, they are kept warm for a reason */
+  comp = gst_droid_codec_create_component (codec, type, NULL, 0, 0);
+  if (comp) {
+    probe->usable = TRUE;
+    gst_droid_codec_probe_component (comp, probe);
+    /* do not keep it in the warm pool, we do not know when it will be needed */
+    gst_droid_codec_destroy_component (comp);
+  } else {
+    GST_WARNING ("failed to instantiate %s. Probing again later", type);
+  }
+
+  gst_mini_object_unref (GST_MINI_OBJECT (codec));
+
+  return probe;
+}
+
+/* Returns NULL if type can not be instantiated. Failures might be temporary
+ * (e.g. all instances in use) so they are not remembered and the next
+ * lookup probes again */
+const GstDroidCodecProbe *
+gst_droid_codec_probe_lookup (const gchar * type)
+{
+  GstDroidCodecProbe *probe, *existing;
+  const GstDroidCodecInfo *info = gst_droid_codec_registry_lookup (type);
+
+  if (!info) {
+    return NULL;
+  }
+
+  g_mutex_lock (&probe_lock);
+
+  if (!probes) {
+    /* never freed */
+    probes = g_hash_table_new (g_str_hash, g_str_equal);
+    gst_droid_codec_probe_load_cache ();
+  }
+
+  probe = g_hash_table_lookup (probes, type);
+  if (!probe) {
+    probe = gst_droid_codec_probe_from_cache (info);
+    if (probe && probe->usable) {
+      /* the key is owned by probe */
+      g_hash_table_insert (probes, probe->type, probe);
+    } else if (probe) {
+      gst_droid_codec_probe_free (probe);
+      probe = NULL;
+    }
+  }
+
+  g_mutex_unlock (&probe_lock);
+
+  if (probe) {
+    return probe;
+  }
+
+  /* Instantiating a component can take a while and we do not want to hold
+   * up lookups of other types meanwhile */
+  probe = gst_droid_codec_probe_run (type);
+  if (!probe->usable) {
+    gst_droid_codec_probe_free (probe);
+    return NULL;
+  }
+
+  g_mutex_lock (&probe_lock);
+
+  /* somebody else probed it while we were at it */
+  existing = g_hash_table_lookup (probes, type);
+  if (existing) {
+    gst_droid_codec_probe_free (probe);
+    probe = existing;
+  } else {
+    gst_droid_codec_probe_to_cache (info, probe);
+    g_hash_table_insert (probes, probe->type, probe);
+  }
+
+  g_mutex_unlock (&probe_lock);
+
+  return probe;
+}
+
+gboolean
+gst_droid_codec_probe_supports (const GstDroidCodecProbe * probe,
+    OMX_U32 profile, OMX_U32 level)
+{
+  guint x;
+
+  for (x = 0; x < probe->profile_levels->len; x++) {
+    GstDroidCodecProfileLevel *pl =
+        &g_array_index (probe->profile_levels, GstDroidCodecProfileLevel, x);
+    if (pl->profile == profile && level <= pl->level) {
+      return TRUE;
+    }
+  }
+
+  return FALSE;
+}
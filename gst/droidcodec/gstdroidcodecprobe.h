@@ -0,0 +1,58 @@
+/*
+ * gst-droid
+ *
+ * Copyright (C) 2014 Mohammed Sameer <msameer@foolab.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_DROID_CODEC_PROBE_H__
+#define __GST_DROID_CODEC_PROBE_H__
+
+#include <gst/gst.h>
+#include <OMX_Core.h>
+
+G_BEGIN_DECLS
+
+typedef struct _GstDroidCodecProbe GstDroidCodecProbe;
+typedef struct _GstDroidCodecProfileLevel GstDroidCodecProfileLevel;
+
+struct _GstDroidCodecProfileLevel
+{
+  OMX_U32 profile;
+  /* highest supported level for profile */
+  OMX_U32 level;
+};
+
+/* What a component told us about itself the first time we instantiated it.
+ * Results are kept for the lifetime of the process and cached on disk
+ * until the configuration file changes. Components we could not instantiate
+ * are probed again on the next lookup. */
+struct _GstDroidCodecProbe
+{
+  gchar *type;
+  gboolean usable;
+  /* GstDroidCodecProfileLevel of the compressed port */
+  GArray *profile_levels;
+};
+
+const GstDroidCodecProbe *gst_droid_codec_probe_lookup (const gchar * type);
+gboolean gst_droid_codec_probe_supports (const GstDroidCodecProbe * probe,
+					 OMX_U32 profile, OMX_U32 level);
+
+G_END_DECLS
+
+#endif /* __GST_DROID_CODEC_PROBE_H__ */
@@ -0,0 +1,247 @@
+/*
+ * gst-droid
+ *
+ * Copyright (C) 2014 Mohammed Sameer <msameer@foolab.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "gstdroidcodecregistry.h"
+#include "plugin.h"
+#include <string.h>
+#include <glib/gstdio.h>
+
+GST_DEBUG_CATEGORY_EXTERN (gst_droid_codec_debug);
+#define GST_CAT_DEFAULT gst_droid_codec_debug
+
+/* ms */
+#define DEFAULT_STATE_TIMEOUT 1000
+#define DEFAULT_WARM_COMPONENTS 0
+/* seconds */
+#define DEFAULT_IDLE_TIMEOUT 30
+
+#define CONF_SUFFIX ".conf"
+
+#ifdef ENABLE_MOCK_CORE
+/* points the registry at another droidcodec.d, e.g. the test configurations */
+#define CONF_DIR_ENV "GST_DROID_CODEC_CONFIG_DIR"
+#endif
+
+static GHashTable *registry = NULL;
+
+static void
+gst_droid_codec_info_free (GstDroidCodecInfo * info)
+{
+  g_free (info->type);
+  g_free (info->core);
+  g_free (info->component);
+  g_free (info->role);
+  g_slice_free (GstDroidCodecInfo, info);
+}
+
+static GstDroidCodecInfo *
+gst_droid_codec_info_load (const gchar * type, const gchar * path)
+{
+  GKeyFile *file;
+  GError *error = NULL;
+  GStatBuf st;
+  GstDroidCodecInfo *info = g_slice_new0 (GstDroidCodecInfo);
+
+  info->type = g_strdup (type);
+
+  if (g_stat (path, &st) == 0) {
+    info->mtime = st.st_mtime;
+  }
+
+  file = g_key_file_new ();
+
+  if (!g_key_file_load_from_file (file, path, 0, &error)) {
+    goto error;
+  }
+
+  info->core = g_key_file_get_string (file, "droidcodec", "core", &error);
+  if (!info->core) {
+    goto error;
+  }
+
+  info->component =
+      g_key_file_get_string (file, "droidcodec", "component", &error);
+  if (!info->component) {
+    goto error;
+  }
+
+  info->role = g_key_file_get_string (file, "droidcodec", "role", &error);
+  if (!info->role) {
+    goto error;
+  }
+
+  info->in_port = g_key_file_get_integer (file, "droidcodec", "in-port",
+      &error);
+  if (error) {
+    goto error;
+  }
+
+  info->out_port = g_key_file_get_integer (file, "droidcodec", "out-port",
+      &error);
+  if (error) {
+    goto error;
+  }
+
+  if (info->in_port == info->out_port) {
+    GST_WARNING ("in port and out port can not be equal in %s", path);
+    goto out;
+  }
+
+  /* optional */
+  info->state_timeout =
+      g_key_file_get_integer (file, "droidcodec", "state-timeout", NULL);
+  if (info->state_timeout <= 0) {
+    info->state_timeout = DEFAULT_STATE_TIMEOUT;
+  }
+
+  info->warm_components =
+      g_key_file_get_integer (file, "droidcodec", "warm-components", NULL);
+  if (info->warm_components < 0) {
+    info->warm_components = DEFAULT_WARM_COMPONENTS;
+  }
+
+  info->idle_timeout =
+      g_key_file_get_integer (file, "droidcodec", "idle-timeout", NULL);
+  if (info->idle_timeout <= 0) {
+    info->idle_timeout = DEFAULT_IDLE_TIMEOUT;
+  }
+
+  info->max_width =
+      g_key_file_get_integer (file, "droidcodec", "max-width", NULL);
+  info->max_height =
+      g_key_file_get_integer (file, "droidcodec", "max-height", NULL);
+  if (info->max_width <= 0 || info->max_height <= 0) {
+    info->max_width = info->max_height = 0;
+  }
+
+  info->max_instances =
+      g_key_file_get_integer (file, "droidcodec", "max-instances", NULL);
+  if (info->max_instances < 0) {
+    info->max_instances = 0;
+  }
+
+#ifdef ENABLE_MOCK_CORE
+  info->host_core =
+      g_key_file_get_boolean (file, "droidcodec", "host-core", NULL);
+#else
+  if (g_key_file_get_boolean (file, "droidcodec", "host-core", NULL)) {
+    GST_WARNING ("%s wants a host core but they are not supported", path);
+    goto out;
+  }
+#endif
+
+  g_key_file_unref (file);
+
+  return info;
+
+error:
+  GST_WARNING ("error %s reading %s", error->message, path);
+  g_error_free (error);
+
+out:
+  g_key_file_unref (file);
+  gst_droid_codec_info_free (info);
+
+  return NULL;
+}
+
+static gpointer
+gst_droid_codec_registry_load (gpointer data)
+{
+  GDir *dir;
+  const gchar *name;
+  GError *error = NULL;
+  gchar *path = gst_droid_codec_registry_get_dir ();
+
+  registry = g_hash_table_new_full (g_str_hash, g_str_equal, NULL,
+      (GDestroyNotify) gst_droid_codec_info_free);
+
+  dir = g_dir_open (path, 0, &error);
+  if (!dir) {
+    GST_WARNING ("error %s opening %s", error->message, path);
+    g_error_free (error);
+    g_free (path);
+    return NULL;
+  }
+
+  while ((name = g_dir_read_name (dir))) {
+    gchar *file;
+    gchar *type;
+    GstDroidCodecInfo *info;
+
+    if (!g_str_has_suffix (name, CONF_SUFFIX)) {
+      continue;
+    }
+
+    type = g_strndup (name, strlen (name) - strlen (CONF_SUFFIX));
+    file = g_build_path ("/", path, name, NULL);
+
+    info = gst_droid_codec_info_load (type, file);
+    if (info) {
+      GST_INFO ("codec %s: component %s in %s", type, info->component,
+          info->core);
+      /* the key is owned by info */
+      g_hash_table_insert (registry, info->type, info);
+    }
+
+    g_free (file);
+    g_free (type);
+  }
+
+  g_dir_close (dir);
+  g_free (path);
+
+  return NULL;
+}
+
+void
+gst_droid_codec_registry_init (void)
+{
+  static GOnce once = G_ONCE_INIT;
+
+  g_once (&once, gst_droid_codec_registry_load, NULL);
+}
+
+const GstDroidCodecInfo *
+gst_droid_codec_registry_lookup (const gchar * type)
+{
+  gst_droid_codec_registry_init ();
+
+  return g_hash_table_lookup (registry, type);
+}
+
+gchar *
+gst_droid_codec_registry_get_dir (void)
+{
+#ifdef ENABLE_MOCK_CORE
+  const gchar *dir = g_getenv (CONF_DIR_ENV);
+
+  if (dir && dir[0]) {
+    return g_strdup (dir);
+  }
+#endif
+
+  return g_build_path ("/", SYSCONFDIR, "gst-droid", "droidcodec.d", NULL);
+}
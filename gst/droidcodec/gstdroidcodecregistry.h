@@ -0,0 +1,65 @@
+/*
+ * gst-droid
+ *
+ * Copyright (C) 2014 Mohammed Sameer <msameer@foolab.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_DROID_CODEC_REGISTRY_H__
+#define __GST_DROID_CODEC_REGISTRY_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+typedef struct _GstDroidCodecInfo GstDroidCodecInfo;
+
+/* Everything we know about a codec from its droidcodec.d configuration file.
+ * Entries are created once and never modified afterwards. */
+struct _GstDroidCodecInfo
+{
+  gchar *type;
+  gchar *core;
+  gchar *component;
+  gchar *role;
+  int in_port;
+  int out_port;
+
+  /* modification time of the configuration file */
+  gint64 mtime;
+
+  /* optional */
+  int state_timeout;
+  int warm_components;
+  int idle_timeout;
+  /* 0 if unknown */
+  int max_width;
+  int max_height;
+  /* how many components the core can run at once. 0 if unlimited */
+  int max_instances;
+  /* core is a host library, loaded with dlopen () instead of libhybris.
+   * Only honoured when built with --enable-mock-core for the tests */
+  gboolean host_core;
+};
+
+void gst_droid_codec_registry_init (void);
+const GstDroidCodecInfo *gst_droid_codec_registry_lookup (const gchar * type);
+gchar *gst_droid_codec_registry_get_dir (void);
+
+G_END_DECLS
+
+#endif /* __GST_DROID_CODEC_REGISTRY_H__ */
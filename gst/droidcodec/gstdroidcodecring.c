@@ -0,0 +1,187 @@
+/*
+ * gst-droid
+ *
+ * Copyright (C) 2014 Mohammed Sameer <msameer@foolab.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "gstdroidcodecring.h"
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <errno.h>
+
+struct _GstDroidCodecRing
+{
+  gpointer *data;
+  guint size;
+  guint mask;
+
+  /* written by the producer only */
+  guint tail;
+  /* written by the consumer only */
+  guint head;
+
+  gint waiting;
+  gint flushing;
+
+  int fd;
+};
+
+static void
+gst_droid_codec_ring_wake (GstDroidCodecRing * ring)
+{
+  guint64 val = 1;
+
+  while (write (ring->fd, &val, sizeof (val)) == -1 && errno == EINTR);
+}
+
+static void
+gst_droid_codec_ring_sleep (GstDroidCodecRing * ring)
+{
+  guint64 val;
+
+  while (read (ring->fd, &val, sizeof (val)) == -1 && errno == EINTR);
+}
+
+GstDroidCodecRing *
+gst_droid_codec_ring_new (guint size)
+{
+  GstDroidCodecRing *ring;
+  int fd;
+
+  fd = eventfd (0, EFD_CLOEXEC);
+  if (fd == -1) {
+    g_warning ("failed to create eventfd: %s", g_strerror (errno));
+    return NULL;
+  }
+
+  ring = g_slice_new0 (GstDroidCodecRing);
+
+  /* power of two so that we can mask our indices */
+  ring->size = 1;
+  while (ring->size < MAX (size, 1)) {
+    ring->size <<= 1;
+  }
+
+  ring->mask = ring->size - 1;
+  ring->data = g_new0 (gpointer, ring->size);
+  ring->fd = fd;
+
+  return ring;
+}
+
+void
+gst_droid_codec_ring_free (GstDroidCodecRing * ring)
+{
+  close (ring->fd);
+  g_free (ring->data);
+  g_slice_free (GstDroidCodecRing, ring);
+}
+
+gboolean
+gst_droid_codec_ring_push (GstDroidCodecRing * ring, gpointer data)
+{
+  guint tail = ring->tail;
+  guint head = __atomic_load_n (&ring->head, __ATOMIC_ACQUIRE);
+
+  if (tail - head == ring->size) {
+    /* full */
+    return FALSE;
+  }
+
+  ring->data[tail & ring->mask] = data;
+
+  /* Pairs with the consumer storing waiting before it checks tail. Either
+   * the consumer sees the new tail or we see it waiting */
+  __atomic_store_n (&ring->tail, tail + 1, __ATOMIC_SEQ_CST);
+
+  if (__atomic_load_n (&ring->waiting, __ATOMIC_SEQ_CST)) {
+    gst_droid_codec_ring_wake (ring);
+  }
+
+  return TRUE;
+}
+
+gpointer
+gst_droid_codec_ring_pop (GstDroidCodecRing * ring)
+{
+  guint head = ring->head;
+  gpointer data;
+
+  if (__atomic_load_n (&ring->tail, __ATOMIC_ACQUIRE) == head) {
+    /* empty */
+    return NULL;
+  }
+
+  data = ring->data[head & ring->mask];
+
+  __atomic_store_n (&ring->head, head + 1, __ATOMIC_RELEASE);
+
+  return data;
+}
+
+gpointer
+gst_droid_codec_ring_pop_wait (GstDroidCodecRing * ring)
+{
+  gpointer data = NULL;
+
+  while (!__atomic_load_n (&ring->flushing, __ATOMIC_ACQUIRE)) {
+    data = gst_droid_codec_ring_pop (ring);
+    if (data) {
+      break;
+    }
+
+    __atomic_store_n (&ring->waiting, 1, __ATOMIC_SEQ_CST);
+
+    if (__atomic_load_n (&ring->tail, __ATOMIC_SEQ_CST) == ring->head
+        && !__atomic_load_n (&ring->flushing, __ATOMIC_SEQ_CST)) {
+      gst_droid_codec_ring_sleep (ring);
+    }
+
+    __atomic_store_n (&ring->waiting, 0, __ATOMIC_RELAXED);
+  }
+
+  return data;
+}
+
+void
+gst_droid_codec_ring_set_flushing (GstDroidCodecRing * ring,
+    gboolean flushing)
+{
+  __atomic_store_n (&ring->flushing, flushing ? 1 : 0, __ATOMIC_SEQ_CST);
+
+  if (flushing) {
+    gst_droid_codec_ring_wake (ring);
+  }
+}
+
+guint
+gst_droid_codec_ring_length (GstDroidCodecRing * ring)
+{
+  return __atomic_load_n (&ring->tail, __ATOMIC_ACQUIRE) -
+      __atomic_load_n (&ring->head, __ATOMIC_ACQUIRE);
+}
+
+guint
+gst_droid_codec_ring_size (GstDroidCodecRing * ring)
+{
+  return ring->size;
+}
@@ -0,0 +1,53 @@
+/*
+ * gst-droid
+ *
+ * Copyright (C) 2014 Mohammed Sameer <msameer@foolab.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_DROID_CODEC_RING_H__
+#define __GST_DROID_CODEC_RING_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Bounded single producer/single consumer queue.
+ * The producer never takes a lock and only issues a system call when the
+ * consumer is sleeping.
+ */
+typedef struct _GstDroidCodecRing GstDroidCodecRing;
+
+GstDroidCodecRing *gst_droid_codec_ring_new (guint size);
+void gst_droid_codec_ring_free (GstDroidCodecRing * ring);
+
+/* producer */
+gboolean gst_droid_codec_ring_push (GstDroidCodecRing * ring, gpointer data);
+
+/* consumer */
+gpointer gst_droid_codec_ring_pop (GstDroidCodecRing * ring);
+gpointer gst_droid_codec_ring_pop_wait (GstDroidCodecRing * ring);
+
+/* any thread */
+void gst_droid_codec_ring_set_flushing (GstDroidCodecRing * ring, gboolean flushing);
+guint gst_droid_codec_ring_length (GstDroidCodecRing * ring);
+guint gst_droid_codec_ring_size (GstDroidCodecRing * ring);
+
+G_END_DECLS
+
+#endif /* __GST_DROID_CODEC_RING_H__ */
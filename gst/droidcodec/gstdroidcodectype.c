@@ -20,6 +20,9 @@
  */
 
 #include "gstdroidcodectype.h"
+#include "gstdroidcodecregistry.h"
+#include "gstdroidcodecprobe.h"
+#include "gstencoderparams.h"
 #include "plugin.h"
 
 typedef struct _GstDroidCodecType GstDroidCodecType;
@@ -38,8 +41,9 @@ h264 (GstStructure * s)
   const char *alignment = gst_structure_get_string (s, "alignment");
   const char *format = gst_structure_get_string (s, "stream-format");
 
+  /* avc gets converted to byte-stream while feeding the decoder */
   return alignment && format && !g_strcmp0 (alignment, "au")
-      && !g_strcmp0 (format, "byte-stream");
+      && (!g_strcmp0 (format, "byte-stream") || !g_strcmp0 (format, "avc"));
 }
 
 static gboolean
@@ -59,6 +63,25 @@ h264_enc (GstStructure * s)
   return TRUE;
 }
 
+static gboolean
+aac (GstStructure * s)
+{
+  gint val;
+  const char *format = gst_structure_get_string (s, "stream-format");
+
+  if (!gst_structure_get_int (s, "mpegversion", &val) || (val != 2
+          && val != 4)) {
+    return FALSE;
+  }
+
+  /* raw aac needs the AudioSpecificConfig from codec_data */
+  if (!g_strcmp0 (format, "raw")) {
+    return gst_structure_has_field (s, "codec_data");
+  }
+
+  return !g_strcmp0 (format, "adts");
+}
+
 void
 h264_compliment (GstCaps * caps)
 {
@@ -75,27 +98,63 @@ struct _GstDroidCodecType
   void (*compliment) (GstCaps * caps);
   const gchar *caps;
   gboolean in_stream_headers;
+  const gchar *(*profile_to_string) (int profile);
+  void (*levels_to_list) (int max, GValue * list);
 };
 
 GstDroidCodecType types[] = {
-  /* decoders */
+  /* decoders. Their sink caps are not restricted by profile: streams carry
+   * profiles like constrained-baseline or progressive-high which OMX has no
+   * name for and a decoder for the parent profile handles them just fine */
   {GST_DROID_CODEC_DECODER, "video/mpeg", GST_DROID_CODEC_TYPE_MPEG4VIDEO_DEC,
         mpeg4v, NULL,
-      "video/mpeg, mpegversion=4", FALSE},
+      "video/mpeg, mpegversion=4", FALSE, NULL, NULL},
   {GST_DROID_CODEC_DECODER, "video/x-h264", GST_DROID_CODEC_TYPE_AVC_DEC, h264,
-      NULL, "video/x-h264, alignment=au, stream-format=byte-stream", FALSE},
+        NULL,
+        "video/x-h264, alignment=au, stream-format={ byte-stream, avc }",
+      FALSE, NULL, NULL},
   {GST_DROID_CODEC_DECODER, "video/x-h263", GST_DROID_CODEC_TYPE_H263_DEC, NULL,
-      NULL, "video/x-h263", FALSE},
+      NULL, "video/x-h263", FALSE, NULL, NULL},
   {GST_DROID_CODEC_DECODER, "video/x-divx", GST_DROID_CODEC_TYPE_DIVX_DEC, NULL,
-      NULL, "video/x-divx", FALSE},
+      NULL, "video/x-divx", FALSE, NULL, NULL},
+  {GST_DROID_CODEC_DECODER, "video/x-vp8", GST_DROID_CODEC_TYPE_VP8_DEC, NULL,
+      NULL, "video/x-vp8", FALSE, NULL, NULL},
+
+  /* audio decoders */
+  {GST_DROID_CODEC_DECODER_AUDIO, "audio/mpeg", GST_DROID_CODEC_TYPE_AAC_DEC,
+        aac, NULL,
+        "audio/mpeg, mpegversion={ 2, 4 }, stream-format={ raw, adts }",
+      FALSE, NULL, NULL},
+  {GST_DROID_CODEC_DECODER_AUDIO, "audio/AMR", GST_DROID_CODEC_TYPE_AMRNB_DEC,
+        NULL, NULL, "audio/AMR, rate=8000, channels=1", FALSE, NULL, NULL},
+  {GST_DROID_CODEC_DECODER_AUDIO, "audio/AMR-WB",
+        GST_DROID_CODEC_TYPE_AMRWB_DEC, NULL, NULL,
+      "audio/AMR-WB, rate=16000, channels=1", FALSE, NULL, NULL},
+
+  /* image decoders */
+  {GST_DROID_CODEC_DECODER_IMAGE, "image/jpeg", GST_DROID_CODEC_TYPE_JPEG_DEC,
+      NULL, NULL, "image/jpeg, parsed=true", FALSE, NULL, NULL},
+
+  /* audio encoders */
+  {GST_DROID_CODEC_ENCODER_AUDIO, "audio/mpeg", GST_DROID_CODEC_TYPE_AAC_ENC,
+        NULL, NULL, "audio/mpeg, mpegversion=4, stream-format=raw", FALSE,
+      NULL, NULL},
 
   /* encoders */
   {GST_DROID_CODEC_ENCODER, "video/mpeg", GST_DROID_CODEC_TYPE_MPEG4VIDEO_ENC,
         mpeg4v,
-      NULL, "video/mpeg, mpegversion=4, systemstream=false", FALSE},
+        NULL, "video/mpeg, mpegversion=4, systemstream=false", FALSE,
+        gst_encoder_params_mpeg4_profile_to_string,
+      gst_encoder_params_mpeg4_levels_to_list},
   {GST_DROID_CODEC_ENCODER, "video/x-h264", GST_DROID_CODEC_TYPE_AVC_ENC,
         h264_enc, h264_compliment,
-      "video/x-h264, alignment=au, stream-format=byte-stream", TRUE},
+        "video/x-h264, alignment=au, stream-format=byte-stream", TRUE,
+        gst_encoder_params_avc_profile_to_string,
+      gst_encoder_params_avc_levels_to_list},
+  /* VP8 has a single OMX profile. The caps profile is the VP8 version which
+   * OMX calls level */
+  {GST_DROID_CODEC_ENCODER, "video/x-vp8", GST_DROID_CODEC_TYPE_VP8_ENC, NULL,
+      NULL, "video/x-vp8", FALSE, NULL, NULL},
 };
 
 const gchar *
@@ -121,6 +180,72 @@ gst_droid_codec_type_from_caps (GstCaps * caps, GstDroidCodecTypeType type)
   return NULL;
 }
 
+static GstCaps *
+gst_droid_codec_type_add_caps (GstCaps * caps, GstDroidCodecType * type)
+{
+  const GstDroidCodecInfo *info =
+      gst_droid_codec_registry_lookup (type->codec_type);
+  const GstDroidCodecProbe *probe;
+  GstStructure *s;
+  gboolean has_profiles = FALSE;
+  guint x;
+
+  if (!info) {
+    return caps;
+  }
+
+  /* The probe runs from class_init and instantiating might fail for
+   * reasons which go away (e.g. all instances in use). Keep what the
+   * configuration says in that case rather than dropping the codec */
+  probe = gst_droid_codec_probe_lookup (type->codec_type);
+
+  s = gst_structure_new_from_string (type->caps);
+
+  /* OMX IL has no way to ask a component for its largest frame size so
+   * that comes from the configuration */
+  if (info->max_width > 0) {
+    gst_structure_set (s, "width", GST_TYPE_INT_RANGE, 1, info->max_width,
+        "height", GST_TYPE_INT_RANGE, 1, info->max_height, NULL);
+  }
+
+  if (probe && type->profile_to_string) {
+    /* one structure per profile holding all the levels it can do */
+    for (x = 0; x < probe->profile_levels->len; x++) {
+      GstDroidCodecProfileLevel *pl =
+          &g_array_index (probe->profile_levels, GstDroidCodecProfileLevel, x);
+      const gchar *profile = type->profile_to_string (pl->profile);
+      GValue levels = G_VALUE_INIT;
+      GstStructure *copy;
+
+      if (!profile) {
+        continue;
+      }
+
+      g_value_init (&levels, GST_TYPE_LIST);
+      type->levels_to_list (pl->level, &levels);
+
+      copy = gst_structure_copy (s);
+      gst_structure_set (copy, "profile", G_TYPE_STRING, profile, NULL);
+      if (gst_value_list_get_size (&levels) > 0) {
+        gst_structure_take_value (copy, "level", &levels);
+      } else {
+        g_value_unset (&levels);
+      }
+
+      caps = gst_caps_merge_structure (caps, copy);
+      has_profiles = TRUE;
+    }
+  }
+
+  if (has_profiles) {
+    gst_structure_free (s);
+  } else {
+    caps = gst_caps_merge_structure (caps, s);
+  }
+
+  return caps;
+}
+
 GstCaps *
 gst_droid_codec_type_all_caps (GstDroidCodecTypeType type)
 {
@@ -133,14 +258,7 @@ gst_droid_codec_type_all_caps (GstDroidCodecTypeType type)
       continue;
     }
 
-    gchar *file = gst_droid_codec_type_get_path (types[x].codec_type);
-
-    if (g_file_test (file, G_FILE_TEST_IS_REGULAR | G_FILE_TEST_EXISTS)) {
-      GstStructure *s = gst_structure_new_from_string (types[x].caps);
-      caps = gst_caps_merge_structure (caps, s);
-    }
-
-    g_free (file);
+    caps = gst_droid_codec_type_add_caps (caps, &types[x]);
   }
 
   GST_INFO ("caps %" GST_PTR_FORMAT, caps);
@@ -164,19 +282,6 @@ gst_droid_codec_type_get_type (const gchar * type)
   return -1;
 }
 
-gchar *
-gst_droid_codec_type_get_path (const gchar * type)
-{
-  gchar *file_name = g_strdup_printf ("%s.conf", type);
-  gchar *file =
-      g_build_path ("/", SYSCONFDIR, "gst-droid", "droidcodec.d", file_name,
-      NULL);
-
-  g_free (file_name);
-
-  return file;
-}
-
 void
 gst_droid_codec_type_compliment_caps (const gchar * type, GstCaps * caps)
 {
@@ -30,18 +30,27 @@ G_BEGIN_DECLS
 #define GST_DROID_CODEC_TYPE_AVC_DEC                "h264decode"
 #define GST_DROID_CODEC_TYPE_H263_DEC               "h263decode"
 #define GST_DROID_CODEC_TYPE_DIVX_DEC               "divxdecode"
+#define GST_DROID_CODEC_TYPE_VP8_DEC                "vp8decode"
 #define GST_DROID_CODEC_TYPE_MPEG4VIDEO_ENC         "mpeg4videoencode"
 #define GST_DROID_CODEC_TYPE_AVC_ENC                "h264encode"
+#define GST_DROID_CODEC_TYPE_VP8_ENC                "vp8encode"
+#define GST_DROID_CODEC_TYPE_AAC_DEC                "aacdecode"
+#define GST_DROID_CODEC_TYPE_AMRNB_DEC              "amrnbdecode"
+#define GST_DROID_CODEC_TYPE_AMRWB_DEC              "amrwbdecode"
+#define GST_DROID_CODEC_TYPE_AAC_ENC                "aacencode"
+#define GST_DROID_CODEC_TYPE_JPEG_DEC               "jpegdecode"
 
 typedef enum {
   GST_DROID_CODEC_DECODER,
   GST_DROID_CODEC_ENCODER,
+  GST_DROID_CODEC_DECODER_AUDIO,
+  GST_DROID_CODEC_ENCODER_AUDIO,
+  GST_DROID_CODEC_DECODER_IMAGE,
 } GstDroidCodecTypeType;
 
 const gchar *gst_droid_codec_type_from_caps (GstCaps * caps, GstDroidCodecTypeType type);
 GstCaps *gst_droid_codec_type_all_caps (GstDroidCodecTypeType type);
 GstDroidCodecTypeType gst_droid_codec_type_get_type (const gchar *type);
-gchar *gst_droid_codec_type_get_path (const gchar *type);
 void gst_droid_codec_type_compliment_caps (const gchar * type, GstCaps * caps);
 gboolean gst_droid_codec_type_in_stream_headers (const gchar * type, gboolean * result);
 
@@ -41,6 +41,46 @@ GST_STATIC_PAD_TEMPLATE (GST_VIDEO_DECODER_SRC_NAME,
     GST_STATIC_CAPS (GST_VIDEO_CAPS_MAKE_WITH_FEATURES
         (GST_CAPS_FEATURE_MEMORY_DROID_HANDLE, "{ENCODED, YV12}")));
 
+enum
+{
+  PROP_0,
+  PROP_PRIORITY,
+  PROP_ADMISSION_TIMEOUT,
+  PROP_INSTANCE_STATS,
+  PROP_RECOVER,
+  PROP_RECOVERIES,
+  PROP_LOW_LATENCY,
+  PROP_STATS,
+  PROP_QOS,
+  PROP_STATS_INTERVAL,
+};
+
+#define DEFAULT_RECOVER FALSE
+#define DEFAULT_LOW_LATENCY FALSE
+#define DEFAULT_QOS TRUE
+#define DEFAULT_STATS_INTERVAL 0
+
+static void
+gst_droiddec_record_frame_size (GstDroidDec * dec, GstVideoCodecFrame * frame)
+{
+  gsize size = gst_buffer_get_size (frame->input_buffer);
+  gsize capacity = dec->comp->in_port->def.nBufferSize;
+  gboolean fragmented = capacity > 0 && size > capacity;
+
+  if (fragmented) {
+    GST_LOG_OBJECT (dec, "frame %u of %" G_GSIZE_FORMAT " bytes does not fit "
+        "in a %" G_GSIZE_FORMAT " bytes input buffer",
+        frame->system_frame_number, size, capacity);
+  }
+
+  GST_OBJECT_LOCK (dec);
+  dec->largest_frame = MAX (dec->largest_frame, size);
+  if (fragmented) {
+    dec->frames_fragmented++;
+  }
+  GST_OBJECT_UNLOCK (dec);
+}
+
 static gboolean
 gst_droiddec_do_handle_frame (GstVideoDecoder * decoder,
     GstVideoCodecFrame * frame)
@@ -52,7 +92,7 @@ gst_droiddec_do_handle_frame (GstVideoDecoder * decoder,
   /* This can deadlock if omx does not provide an input buffer and we end up
    * waiting for a buffer which does not happen because omx needs us to provide
    * output buffers to be filled (which can not happen because _loop() tries
-   * to call get_oldest_frame() which acquires the stream lock the base class
+   * to look up the frame which acquires the stream lock the base class
    * is holding before calling us */
 
   GST_VIDEO_DECODER_STREAM_UNLOCK (decoder);
@@ -73,24 +113,19 @@ gst_droiddec_stop_loop (GstVideoDecoder * decoder)
 
   GST_DEBUG_OBJECT (dec, "stop loop");
 
+  if (!dec->comp) {
+    /* nothing to do here */
+    return;
+  }
+
+  /* This also puts the output queue in flushing mode which wakes up
+   * the task if it's waiting for a buffer */
   gst_droid_codec_set_running (dec->comp, FALSE);
 
   /* That should be enough for now as we can not deactivate our buffer pools
    * otherwise we end up freeing the buffers before deactivating our omx ports
    */
 
-  /* Just informing the task that we are finishing */
-  g_mutex_lock (&dec->comp->full_lock);
-  /* if the queue is empty then we _prepend_ a NULL buffer
-   * which should not be a problem because the loop is running
-   * and it will pop it. If it's not then we will clean it up later. */
-  if (dec->comp->full->length == 0) {
-    g_queue_push_head (dec->comp->full, NULL);
-  }
-
-  g_cond_signal (&dec->comp->full_cond);
-  g_mutex_unlock (&dec->comp->full_lock);
-
   /* We need to release the stream lock to prevent deadlocks when the _loop ()
    * function tries to call _finish_frame ()
    */
@@ -133,12 +168,241 @@ gst_droiddec_configure_state (GstVideoDecoder * decoder, gsize width,
   return out;
 }
 
+static void
+gst_droiddec_update_crop (GstDroidDec * dec)
+{
+  GstVideoDecoder *decoder = GST_VIDEO_DECODER (dec);
+  GstVideoRectangle crop;
+  gsize width, height;
+  int hal_fmt;
+
+  if (!gst_droid_codec_get_output_crop (dec->comp, &crop)) {
+    return;
+  }
+
+  GST_VIDEO_DECODER_STREAM_LOCK (decoder);
+
+  GST_INFO_OBJECT (dec, "output crop changed to %dx%d+%d+%d", crop.w,
+      crop.h, crop.x, crop.y);
+
+  if (dec->use_crop_meta || crop.x != 0 || crop.y != 0) {
+    /* Downstream crops. Caps keep the size of the decoded frames. Without
+     * crop meta support that is still better than showing the wrong part */
+    dec->crop = crop;
+    dec->has_crop = TRUE;
+    width = dec->comp->out_port->def.format.video.nFrameWidth;
+    height = dec->comp->out_port->def.format.video.nFrameHeight;
+  } else {
+    /* the visible part starts at the top left corner so the caps say it */
+    dec->has_crop = FALSE;
+    width = crop.w;
+    height = crop.h;
+  }
+
+  if (!dec->out_state || (GST_VIDEO_INFO_WIDTH (&dec->out_state->info) == width
+          && GST_VIDEO_INFO_HEIGHT (&dec->out_state->info) == height)) {
+    GST_VIDEO_DECODER_STREAM_UNLOCK (decoder);
+    return;
+  }
+
+  GST_INFO_OBJECT (dec, "output size changed to %" G_GSIZE_FORMAT "x%"
+      G_GSIZE_FORMAT, width, height);
+
+  hal_fmt = dec->comp->out_port->def.format.video.eColorFormat;
+
+  gst_video_codec_state_unref (dec->out_state);
+  dec->out_state = gst_droiddec_configure_state (decoder, width, height,
+      hal_fmt);
+
+  /* decide_allocation () hands the base class the pool we already have.
+   * It stays active and its buffers are large enough already */
+  if (!gst_video_decoder_negotiate (decoder)) {
+    GST_WARNING_OBJECT (dec, "downstream did not accept %" GST_PTR_FORMAT,
+        dec->out_state->caps);
+  }
+
+  GST_VIDEO_DECODER_STREAM_UNLOCK (decoder);
+}
+
+static void
+gst_droiddec_add_crop_meta (GstDroidDec * dec, GstBuffer * buffer)
+{
+  GstVideoCropMeta *meta;
+  GstVideoRectangle crop;
+  gboolean full_frame;
+
+  GST_VIDEO_DECODER_STREAM_LOCK (dec);
+
+  full_frame = !dec->has_crop || !dec->out_state
+      || (dec->crop.x == 0 && dec->crop.y == 0
+      && dec->crop.w == GST_VIDEO_INFO_WIDTH (&dec->out_state->info)
+      && dec->crop.h == GST_VIDEO_INFO_HEIGHT (&dec->out_state->info));
+
+  crop = dec->crop;
+
+  GST_VIDEO_DECODER_STREAM_UNLOCK (dec);
+
+  /* buffers come back from the pool with the meta we added last time */
+  meta = gst_buffer_get_video_crop_meta (buffer);
+
+  if (full_frame) {
+    if (meta) {
+      gst_buffer_remove_meta (buffer, (GstMeta *) meta);
+    }
+
+    return;
+  }
+
+  if (!meta) {
+    meta = gst_buffer_add_video_crop_meta (buffer);
+  }
+
+  meta->x = crop.x;
+  meta->y = crop.y;
+  meta->width = crop.w;
+  meta->height = crop.h;
+}
+
+/* elapsed is the time in us since the component got the frame or -1 if
+ * we do not know it */
+static void
+gst_droiddec_record_latency (GstDroidDec * dec, GstVideoCodecFrame * frame,
+    gint64 elapsed)
+{
+  GstClockTime latency = elapsed * GST_USECOND;
+
+  GST_OBJECT_LOCK (dec);
+  dec->frames_decoded++;
+  if (elapsed >= 0) {
+    dec->latency_frames++;
+    dec->latency_last = latency;
+    dec->latency_total += latency;
+    if (dec->latency_frames == 1 || latency < dec->latency_min) {
+      dec->latency_min = latency;
+    }
+    dec->latency_max = MAX (dec->latency_max, latency);
+  }
+  GST_OBJECT_UNLOCK (dec);
+
+  if (elapsed >= 0) {
+    GST_LOG_OBJECT (dec, "frame %u decoded in %" GST_TIME_FORMAT,
+        frame->system_frame_number, GST_TIME_ARGS (latency));
+  }
+}
+
+/* comp must stay alive and keep its output ring while we read it. That is
+ * the case in _loop () and while holding the stream lock */
+static GstStructure *
+gst_droiddec_get_stats (GstDroidDec * dec, GstDroidComponent * comp)
+{
+  GstStructure *s;
+
+  GST_OBJECT_LOCK (dec);
+  s = gst_structure_new ("droiddec-stats",
+      "frames-decoded", G_TYPE_UINT64, dec->frames_decoded,
+      "frames-skipped", G_TYPE_UINT64, dec->frames_skipped,
+      "frames-fragmented", G_TYPE_UINT64, dec->frames_fragmented,
+      "largest-frame", G_TYPE_UINT64, (guint64) dec->largest_frame,
+      "latency-last", G_TYPE_UINT64, dec->latency_last,
+      "latency-min", G_TYPE_UINT64, dec->latency_min,
+      "latency-max", G_TYPE_UINT64, dec->latency_max,
+      "latency-average", G_TYPE_UINT64, dec->latency_frames ?
+      dec->latency_total / dec->latency_frames : 0, NULL);
+  GST_OBJECT_UNLOCK (dec);
+
+  if (comp) {
+    gst_droid_codec_add_component_stats (comp, s);
+  }
+
+  return s;
+}
+
+static void
+gst_droiddec_post_stats (GstDroidDec * dec)
+{
+  gint64 now = g_get_monotonic_time ();
+  guint interval;
+
+  GST_OBJECT_LOCK (dec);
+  interval = dec->stats_interval;
+  GST_OBJECT_UNLOCK (dec);
+
+  if (interval == 0
+      || now - dec->stats_posted < interval * G_GINT64_CONSTANT (1000)) {
+    return;
+  }
+
+  dec->stats_posted = now;
+
+  gst_element_post_message (GST_ELEMENT (dec),
+      gst_message_new_element (GST_OBJECT (dec),
+          gst_droiddec_get_stats (dec, dec->comp)));
+}
+
+/* The component never returns frames it dropped. Anything submitted before
+ * the frame we just got which should have been displayed before it is gone */
+static void
+gst_droiddec_release_dropped_frames (GstDroidDec * dec,
+    GstVideoCodecFrame * frame)
+{
+  GList *frames, *l;
+
+  if (!GST_CLOCK_TIME_IS_VALID (frame->pts)) {
+    return;
+  }
+
+  frames = gst_video_decoder_get_frames (GST_VIDEO_DECODER (dec));
+
+  for (l = frames; l; l = l->next) {
+    GstVideoCodecFrame *f = l->data;
+
+    if (f->system_frame_number < frame->system_frame_number
+        && GST_CLOCK_TIME_IS_VALID (f->pts) && f->pts < frame->pts) {
+      GST_DEBUG_OBJECT (dec, "frame %u was dropped by the component",
+          f->system_frame_number);
+      gst_droid_codec_forget_frame (dec->comp, f);
+      /* drops the reference _handle_frame () kept. The list has its own */
+      gst_video_decoder_release_frame (GST_VIDEO_DECODER (dec), f);
+    }
+  }
+
+  g_list_free_full (frames, (GDestroyNotify) gst_video_codec_frame_unref);
+}
+
+/* latency is set to the us the frame spent in the component or -1 */
+static GstVideoCodecFrame *
+gst_droiddec_find_frame (GstDroidDec * dec, OMX_BUFFERHEADERTYPE * buff,
+    gint64 * latency)
+{
+  GstVideoCodecFrame *frame;
+  guint32 number;
+
+  *latency = -1;
+
+  while (gst_droid_codec_match_frame (dec->comp, buff, &number, latency)) {
+    frame = gst_video_decoder_get_frame (GST_VIDEO_DECODER (dec), number);
+    if (frame) {
+      gst_droiddec_release_dropped_frames (dec, frame);
+      return frame;
+    }
+  }
+
+  /* the component did not keep our timestamp */
+  GST_DEBUG_OBJECT (dec, "no frame with timestamp %lli, using the oldest",
+      (long long) buff->nTimeStamp);
+
+  *latency = -1;
+
+  return gst_video_decoder_get_oldest_frame (GST_VIDEO_DECODER (dec));
+}
+
 static void
 gst_droiddec_loop (GstDroidDec * dec)
 {
   OMX_BUFFERHEADERTYPE *buff;
   GstBuffer *buffer;
   GstVideoCodecFrame *frame;
+  gint64 latency;
 
   while (gst_droid_codec_is_running (dec->comp)) {
     if (gst_droid_codec_has_error (dec->comp)) {
@@ -151,32 +415,20 @@ gst_droiddec_loop (GstDroidDec * dec)
     }
 
     GST_DEBUG_OBJECT (dec, "trying to get a buffer");
-    g_mutex_lock (&dec->comp->full_lock);
-    buff = g_queue_pop_head (dec->comp->full);
-
-    if (!buff) {
-      if (!gst_droid_codec_is_running (dec->comp)) {
-        /* this is a signal that we should quit */
-        GST_DEBUG_OBJECT (dec, "got no buffer");
-        g_mutex_unlock (&dec->comp->full_lock);
-        continue;
-      }
-
-      g_cond_wait (&dec->comp->full_cond, &dec->comp->full_lock);
-      buff = g_queue_pop_head (dec->comp->full);
-    }
-
-    g_mutex_unlock (&dec->comp->full_lock);
+    buff = gst_droid_codec_ring_pop_wait (dec->comp->full);
     GST_DEBUG_OBJECT (dec, "got buffer %p", buff);
 
     if (!buff) {
       GST_DEBUG_OBJECT (dec, "got no buffer");
-      /* This can only happen if we are not running
-       * yet we will not exit because we should detect
-       * that upon looping */
+      /* The queue is flushing which means we are not running anymore.
+       * We will exit upon looping */
       continue;
     }
 
+    if (gst_droid_codec_take_crop_change (dec->comp)) {
+      gst_droiddec_update_crop (dec);
+    }
+
     buffer = gst_omx_buffer_get_buffer (dec->comp, buff);
     if (!buffer) {
       GST_ERROR_OBJECT (dec, "can not get buffer associated with omx buffer %p",
@@ -185,21 +437,27 @@ gst_droiddec_loop (GstDroidDec * dec)
     }
 
     /* Now we can proceed. */
-    frame = gst_video_decoder_get_oldest_frame (GST_VIDEO_DECODER (dec));
+    frame = gst_droiddec_find_frame (dec, buff, &latency);
     if (!frame) {
       gst_buffer_unref (buffer);
       GST_ERROR_OBJECT (dec, "can not find a video frame");
       continue;
     }
 
+    gst_droiddec_add_crop_meta (dec, buffer);
+
     frame->output_buffer = buffer;
 
     GST_DEBUG_OBJECT (dec, "finishing frame %p", frame);
 
     gst_droid_codec_timestamp (frame->output_buffer, buff);
 
+    gst_droiddec_record_latency (dec, frame, latency);
+
     gst_video_decoder_finish_frame (GST_VIDEO_DECODER (dec), frame);
     gst_video_codec_frame_unref (frame);
+
+    gst_droiddec_post_stats (dec);
   }
 
   if (!gst_droid_codec_is_running (dec->comp)) {
@@ -284,15 +542,163 @@ gst_droiddec_stop (GstVideoDecoder * decoder)
     dec->out_state = NULL;
   }
 
+  dec->use_crop_meta = FALSE;
+  dec->has_crop = FALSE;
+  dec->wait_for_sync = FALSE;
+  dec->qos_skipping = FALSE;
+
   if (dec->comp) {
     gst_droid_codec_stop_component (dec->comp);
-    gst_droid_codec_destroy_component (dec->comp);
+    gst_droid_codec_put_component (dec->comp);
     dec->comp = NULL;
   }
 
   return TRUE;
 }
 
+/* The minimum compression ratio h264 levels allow (MinCR in table A-1 of
+ * the specification). 0 if caps do not tell */
+static guint
+gst_droiddec_get_min_compression (GstDroidDec * dec)
+{
+  GstStructure *s = gst_caps_get_structure (dec->in_state->caps, 0);
+  const gchar *level = gst_structure_get_string (s, "level");
+
+  if (!gst_structure_has_name (s, "video/x-h264") || !level) {
+    return 0;
+  }
+
+  if (!g_strcmp0 (level, "3.1") || !g_strcmp0 (level, "3.2")
+      || !g_strcmp0 (level, "4")) {
+    return 4;
+  }
+
+  return 2;
+}
+
+/* Input buffers are sized for the largest frame seen so far, with some
+ * headroom. Before we have seen any we assume 4:1 compression. Frames of
+ * a conforming stream are never larger than the level allows so we do not
+ * grow past that */
+static gsize
+gst_droiddec_get_input_buffer_size (GstDroidDec * dec)
+{
+  GstVideoInfo *info = &dec->in_state->info;
+  gsize raw, size, largest;
+  guint min_cr = gst_droiddec_get_min_compression (dec);
+
+  /* 4:2:0 macroblocks */
+  raw = GST_ROUND_UP_16 (GST_VIDEO_INFO_WIDTH (info)) *
+      GST_ROUND_UP_16 (GST_VIDEO_INFO_HEIGHT (info)) * 3 / 2;
+
+  size = raw / 4;
+
+  GST_OBJECT_LOCK (dec);
+  largest = dec->largest_frame;
+  GST_OBJECT_UNLOCK (dec);
+
+  size = MAX (size, largest + largest / 4);
+
+  if (min_cr > 0) {
+    size = MIN (size, raw / min_cr);
+  }
+
+  /* page aligned */
+  return (size + 4095) & ~((gsize) 4095);
+}
+
+static gboolean
+gst_droiddec_configure_component (GstDroidDec * dec)
+{
+  if (!gst_droid_codec_configure_component (dec->comp, &dec->in_state->info)) {
+    return FALSE;
+  }
+
+  dec->input_buffer_size = gst_droiddec_get_input_buffer_size (dec);
+
+  /* not fatal. We split frames which do not fit */
+  gst_droid_codec_set_input_buffer_size (dec->comp, dec->input_buffer_size);
+
+  return TRUE;
+}
+
+/* Frames did not fit and we would now ask for larger buffers than we did
+ * when configuring */
+static gboolean
+gst_droiddec_input_too_small (GstDroidDec * dec)
+{
+  gsize largest;
+
+  GST_OBJECT_LOCK (dec);
+  largest = dec->largest_frame;
+  GST_OBJECT_UNLOCK (dec);
+
+  return largest > dec->comp->in_port->def.nBufferSize
+      && gst_droiddec_get_input_buffer_size (dec) > dec->input_buffer_size;
+}
+
+static gboolean
+gst_droiddec_is_avc (GstDroidDec * dec)
+{
+  GstStructure *s = gst_caps_get_structure (dec->in_state->caps, 0);
+
+  return gst_structure_has_name (s, "video/x-h264")
+      && !g_strcmp0 (gst_structure_get_string (s, "stream-format"), "avc");
+}
+
+/* starts dec->comp after it has been configured */
+static gboolean
+gst_droiddec_start_component (GstDroidDec * dec)
+{
+  GstVideoDecoder *decoder = GST_VIDEO_DECODER (dec);
+
+  if (dec->low_latency
+      && !gst_droid_codec_set_low_latency (dec->comp, dec->in_state->caps)) {
+    return FALSE;
+  }
+
+  gst_droid_codec_set_share_input (dec->comp);
+
+  if (!gst_droid_codec_start_component (dec->comp, dec->in_state->caps,
+          dec->out_state->caps)) {
+    return FALSE;
+  }
+
+  if (!gst_video_decoder_negotiate (decoder)) {
+    return FALSE;
+  }
+
+  if (gst_droiddec_is_avc (dec)) {
+    if (!dec->in_state->codec_data) {
+      GST_ERROR_OBJECT (dec, "avc stream without codec_data");
+      return FALSE;
+    }
+
+    GST_DEBUG_OBJECT (dec, "passing avc codec_data to decoder");
+
+    if (!gst_droid_codec_set_avc_codec_data (dec->comp,
+            dec->in_state->codec_data)) {
+      return FALSE;
+    }
+  } else if (dec->in_state->codec_data) {
+    GST_DEBUG_OBJECT (dec, "passing codec_data to decoder");
+
+    if (!gst_droid_codec_set_codec_data (dec->comp,
+            dec->in_state->codec_data)) {
+      return FALSE;
+    }
+  }
+
+  if (!gst_pad_start_task (GST_VIDEO_DECODER_SRC_PAD (decoder),
+          (GstTaskFunction) gst_droiddec_loop, gst_object_ref (dec),
+          gst_object_unref)) {
+    GST_ERROR_OBJECT (dec, "failed to start src task");
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
 static gboolean
 gst_droiddec_set_format (GstVideoDecoder * decoder, GstVideoCodecState * state)
 {
@@ -312,7 +718,8 @@ gst_droiddec_set_format (GstVideoDecoder * decoder, GstVideoCodecState * state)
   }
 
   dec->comp =
-      gst_droid_codec_get_component (dec->codec, type, GST_ELEMENT (dec));
+      gst_droid_codec_get_component_full (dec->codec, type, GST_ELEMENT (dec),
+      dec->priority, dec->admission_timeout);
   if (!dec->comp) {
     return FALSE;
   }
@@ -320,7 +727,7 @@ gst_droiddec_set_format (GstVideoDecoder * decoder, GstVideoCodecState * state)
   dec->in_state = gst_video_codec_state_ref (state);
 
   /* configure codec */
-  if (!gst_droid_codec_configure_component (dec->comp, &state->info)) {
+  if (!gst_droiddec_configure_component (dec)) {
     return FALSE;
   }
 
@@ -330,31 +737,93 @@ gst_droiddec_set_format (GstVideoDecoder * decoder, GstVideoCodecState * state)
       gst_droiddec_configure_state (decoder, state->info.width,
       state->info.height, hal_fmt);
 
-  /* now start */
-  if (!gst_droid_codec_start_component (dec->comp, dec->in_state->caps,
-          dec->out_state->caps)) {
+  return gst_droiddec_start_component (dec);
+}
+
+static gboolean
+gst_droiddec_recover (GstDroidDec * dec, GstVideoCodecFrame * frame)
+{
+  GstVideoDecoder *decoder = GST_VIDEO_DECODER (dec);
+  const gchar *type =
+      gst_droid_codec_type_from_caps (dec->in_state->caps,
+      GST_DROID_CODEC_DECODER);
+  GList *frames, *l;
+
+  GST_WARNING_OBJECT (dec, "component failed. Trying to recover");
+
+  gst_droiddec_stop_loop (decoder);
+  gst_droid_codec_stop_component (dec->comp);
+  gst_droid_codec_destroy_component (dec->comp);
+  dec->comp = NULL;
+  dec->has_crop = FALSE;
+
+  /* whatever the old component had will never be decoded */
+  frames = gst_video_decoder_get_frames (decoder);
+  for (l = frames; l; l = l->next) {
+    if (l->data != frame) {
+      gst_video_decoder_release_frame (decoder, l->data);
+    }
+  }
+
+  g_list_free_full (frames, (GDestroyNotify) gst_video_codec_frame_unref);
+
+  dec->comp =
+      gst_droid_codec_get_component_full (dec->codec, type, GST_ELEMENT (dec),
+      dec->priority, dec->admission_timeout);
+  if (!dec->comp) {
     return FALSE;
   }
 
-  if (!gst_video_decoder_negotiate (decoder)) {
+  if (!gst_droiddec_configure_component (dec)) {
     return FALSE;
   }
 
-  if (state->codec_data) {
-    GST_DEBUG_OBJECT (dec, "passing codec_data to decoder");
+  if (!gst_droiddec_start_component (dec)) {
+    return FALSE;
+  }
 
-    if (!gst_droid_codec_set_codec_data (dec->comp, state->codec_data)) {
-      return FALSE;
-    }
+  dec->recoveries++;
+  dec->wait_for_sync = TRUE;
+
+  GST_ELEMENT_WARNING (dec, LIBRARY, FAILED, (NULL),
+      ("recovered from component error (%u recoveries)", dec->recoveries));
+
+  return TRUE;
+}
+
+/* Replaces the flushed component with one whose input buffers fit the
+ * frames we have seen so far */
+static gboolean
+gst_droiddec_resize_input (GstDroidDec * dec)
+{
+  const gchar *type =
+      gst_droid_codec_type_from_caps (dec->in_state->caps,
+      GST_DROID_CODEC_DECODER);
+
+  GST_INFO_OBJECT (dec, "restarting component for larger input buffers");
+
+  gst_droid_codec_stop_component (dec->comp);
+  gst_droid_codec_put_component (dec->comp);
+  dec->comp = NULL;
+  dec->has_crop = FALSE;
+
+  dec->comp =
+      gst_droid_codec_get_component_full (dec->codec, type, GST_ELEMENT (dec),
+      dec->priority, dec->admission_timeout);
+  if (!dec->comp) {
+    return FALSE;
   }
 
-  if (!gst_pad_start_task (GST_VIDEO_DECODER_SRC_PAD (decoder),
-          (GstTaskFunction) gst_droiddec_loop, gst_object_ref (dec),
-          gst_object_unref)) {
-    GST_ERROR_OBJECT (dec, "failed to start src task");
+  if (!gst_droiddec_configure_component (dec)) {
+    return FALSE;
+  }
+
+  if (!gst_droiddec_start_component (dec)) {
     return FALSE;
   }
 
+  dec->wait_for_sync = TRUE;
+
   return TRUE;
 }
 
@@ -370,6 +839,122 @@ gst_droiddec_finish (GstVideoDecoder * decoder)
   return GST_FLOW_OK;
 }
 
+/* h264 frames whose slices have nal_ref_idc 0 are not referenced by any
+ * other frame */
+static gboolean
+gst_droiddec_is_droppable (GstDroidDec * dec, GstVideoCodecFrame * frame)
+{
+  GstMapInfo info;
+  gsize x;
+  gboolean ret = FALSE;
+
+  if (GST_BUFFER_FLAG_IS_SET (frame->input_buffer, GST_BUFFER_FLAG_DROPPABLE)) {
+    return TRUE;
+  }
+
+  if (!gst_structure_has_name (gst_caps_get_structure (dec->in_state->caps,
+              0), "video/x-h264")) {
+    return FALSE;
+  }
+
+  if (!gst_buffer_map (frame->input_buffer, &info, GST_MAP_READ)) {
+    return FALSE;
+  }
+
+  if (dec->comp->nal_length_size > 0) {
+    /* avc: walk the length prefixed NAL units */
+    guint size = dec->comp->nal_length_size;
+
+    for (x = 0; x + size < info.size;) {
+      guint8 type = info.data[x + size] & 0x1f;
+      guint32 len = 0;
+      guint y;
+
+      if (type == 1 || type == 5) {
+        ret = (info.data[x + size] & 0x60) == 0;
+        break;
+      }
+
+      for (y = 0; y < size; y++) {
+        len = (len << 8) | info.data[x + y];
+      }
+
+      if (len > info.size - x - size) {
+        break;
+      }
+
+      x += size + len;
+    }
+
+    gst_buffer_unmap (frame->input_buffer, &info);
+
+    return ret;
+  }
+
+  for (x = 0; x + 3 < info.size; x++) {
+    guint8 type;
+
+    if (info.data[x] != 0x00 || info.data[x + 1] != 0x00
+        || info.data[x + 2] != 0x01) {
+      continue;
+    }
+
+    type = info.data[x + 3] & 0x1f;
+    if (type == 1 || type == 5) {
+      /* first slice decides */
+      ret = (info.data[x + 3] & 0x60) == 0;
+      break;
+    }
+
+    x += 3;
+  }
+
+  gst_buffer_unmap (frame->input_buffer, &info);
+
+  return ret;
+}
+
+/* Decides whether frame should be dropped before it reaches the component
+ * because it will be too late anyway */
+static gboolean
+gst_droiddec_qos_skip (GstDroidDec * dec, GstVideoCodecFrame * frame)
+{
+  GstClockTimeDiff deadline;
+
+  if (GST_VIDEO_CODEC_FRAME_IS_SYNC_POINT (frame)) {
+    if (dec->qos_skipping) {
+      GST_DEBUG_OBJECT (dec, "sync point reached. Decoding again");
+      dec->qos_skipping = FALSE;
+    }
+
+    /* never skip those or we will not be able to decode anything */
+    return FALSE;
+  }
+
+  if (!dec->qos_skipping) {
+    deadline =
+        gst_video_decoder_get_max_decode_time (GST_VIDEO_DECODER (dec), frame);
+    if (deadline >= 0) {
+      return FALSE;
+    }
+
+    GST_DEBUG_OBJECT (dec, "frame %u is late by %" GST_TIME_FORMAT,
+        frame->system_frame_number, GST_TIME_ARGS (-deadline));
+
+    /* frames referencing this one can still be decoded */
+    if (!gst_droiddec_is_droppable (dec, frame)) {
+      GST_DEBUG_OBJECT (dec, "skipping until the next sync point");
+      dec->qos_skipping = TRUE;
+    }
+  }
+
+  GST_OBJECT_LOCK (dec);
+  dec->frames_skipped++;
+  GST_OBJECT_UNLOCK (dec);
+
+  return TRUE;
+}
+
 static GstFlowReturn
 gst_droiddec_handle_frame (GstVideoDecoder * decoder,
     GstVideoCodecFrame * frame)
@@ -387,13 +972,35 @@ gst_droiddec_handle_frame (GstVideoDecoder * decoder,
   }
 
   if (gst_droid_codec_has_error (dec->comp)) {
-    GST_ERROR_OBJECT (dec, "not handling frame while omx is in error state");
-    goto error;
+    if (!dec->recover) {
+      GST_ERROR_OBJECT (dec, "not handling frame while omx is in error state");
+      goto error;
+    }
+
+    if (!gst_droiddec_recover (dec, frame)) {
+      GST_ERROR_OBJECT (dec, "failed to recover from omx error");
+      goto error;
+    }
+  }
+
+  if (dec->wait_for_sync) {
+    if (!GST_VIDEO_CODEC_FRAME_IS_SYNC_POINT (frame)) {
+      GST_DEBUG_OBJECT (dec, "dropping non sync frame after recovery");
+      gst_video_decoder_drop_frame (decoder, frame);
+      return GST_FLOW_OK;
+    }
+
+    dec->wait_for_sync = FALSE;
+  }
+
+  if (dec->qos && gst_droiddec_qos_skip (dec, frame)) {
+    gst_video_decoder_drop_frame (decoder, frame);
+    return GST_FLOW_OK;
   }
 
   /* if we have been flushed then we need to start accepting data again */
   if (!gst_droid_codec_is_running (dec->comp)) {
-    if (GST_VIDEO_CODEC_FRAME_IS_SYNC_POINT (frame)) {
+    if (!GST_VIDEO_CODEC_FRAME_IS_SYNC_POINT (frame)) {
       GST_WARNING_OBJECT (dec, "dropping non sync frame");
       gst_video_decoder_drop_frame (decoder, frame);
       return GST_FLOW_OK;
@@ -413,6 +1020,9 @@ gst_droiddec_handle_frame (GstVideoDecoder * decoder,
     }
   }
 
+  /* once, the frame is submitted again after reconfiguring */
+  gst_droiddec_record_frame_size (dec, frame);
+
   if (gst_droiddec_do_handle_frame (decoder, frame)) {
     return GST_FLOW_OK;
   }
@@ -431,6 +1041,9 @@ gst_droiddec_handle_frame (GstVideoDecoder * decoder,
       /* failed */
       goto error;
     }
+
+    /* a crop for the old frame size means nothing now */
+    dec->has_crop = FALSE;
   }
 
   gst_droid_codec_unset_needs_reconfigure (dec->comp);
@@ -509,6 +1122,13 @@ gst_droiddec_decide_allocation (GstVideoDecoder * decoder, GstQuery * query)
 
   gst_structure_free (conf);
 
+  dec->use_crop_meta =
+      gst_query_find_allocation_meta (query, GST_VIDEO_CROP_META_API_TYPE,
+      NULL);
+
+  GST_DEBUG_OBJECT (dec, "downstream supports crop meta: %d",
+      dec->use_crop_meta);
+
   if (gst_query_get_n_allocation_pools (query) > 0) {
     gst_query_set_nth_allocation_pool (query, 0, dec->comp->out_port->buffers,
         size, size, size);
@@ -523,11 +1143,27 @@ gst_droiddec_decide_allocation (GstVideoDecoder * decoder, GstQuery * query)
 static gboolean
 gst_droiddec_propose_allocation (GstVideoDecoder * decoder, GstQuery * query)
 {
+  GstBufferPool *pool;
+  GstStructure *config;
+  guint size, count;
   GstDroidDec *dec = GST_DROIDDEC (decoder);
 
   GST_DEBUG_OBJECT (dec, "propose allocation %" GST_PTR_FORMAT, query);
 
-  // TODO:
+  if (!dec->comp || !dec->comp->in_port->upstream) {
+    GST_DEBUG_OBJECT (dec, "no input pool to propose yet");
+    return TRUE;
+  }
+
+  /* If upstream fills buffers from our input port pool then we can hand
+   * them to omx without copying. The pool is upstream's alone, copying
+   * uses buffers of its own */
+  pool = dec->comp->in_port->upstream;
+  config = gst_buffer_pool_get_config (pool);
+  gst_buffer_pool_config_get_params (config, NULL, &size, &count, NULL);
+  gst_structure_free (config);
+
+  gst_query_add_allocation_pool (query, pool, size, count, count);
 
   return TRUE;
 }
@@ -546,6 +1182,8 @@ gst_droiddec_flush (GstVideoDecoder * decoder)
 
   gst_droiddec_stop_loop (decoder);
 
+  dec->qos_skipping = FALSE;
+
   /* now flush our component */
   if (!gst_droid_codec_flush (dec->comp, TRUE)) {
     return FALSE;
@@ -553,9 +1191,93 @@ gst_droiddec_flush (GstVideoDecoder * decoder)
 
   GST_DEBUG_OBJECT (dec, "Flushed");
 
+  /* Nothing is in flight now. If frames did not fit in one input buffer
+   * this is where we make them larger */
+  if (gst_droiddec_input_too_small (dec)) {
+    return gst_droiddec_resize_input (dec);
+  }
+
   return TRUE;
 }
 
+static void
+gst_droiddec_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstDroidDec *dec = GST_DROIDDEC (object);
+
+  switch (prop_id) {
+    case PROP_PRIORITY:
+      dec->priority = g_value_get_int (value);
+      break;
+    case PROP_ADMISSION_TIMEOUT:
+      dec->admission_timeout = g_value_get_int (value);
+      break;
+    case PROP_RECOVER:
+      dec->recover = g_value_get_boolean (value);
+      break;
+    case PROP_LOW_LATENCY:
+      dec->low_latency = g_value_get_boolean (value);
+      break;
+    case PROP_QOS:
+      dec->qos = g_value_get_boolean (value);
+      break;
+    case PROP_STATS_INTERVAL:
+      GST_OBJECT_LOCK (dec);
+      dec->stats_interval = g_value_get_uint (value);
+      GST_OBJECT_UNLOCK (dec);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_droiddec_get_property (GObject * object, guint prop_id, GValue * value,
+    GParamSpec * pspec)
+{
+  GstDroidDec *dec = GST_DROIDDEC (object);
+
+  switch (prop_id) {
+    case PROP_PRIORITY:
+      g_value_set_int (value, dec->priority);
+      break;
+    case PROP_ADMISSION_TIMEOUT:
+      g_value_set_int (value, dec->admission_timeout);
+      break;
+    case PROP_INSTANCE_STATS:
+      g_value_take_boxed (value,
+          gst_droid_codec_get_instance_stats (dec->codec));
+      break;
+    case PROP_RECOVER:
+      g_value_set_boolean (value, dec->recover);
+      break;
+    case PROP_RECOVERIES:
+      g_value_set_uint (value, dec->recoveries);
+      break;
+    case PROP_LOW_LATENCY:
+      g_value_set_boolean (value, dec->low_latency);
+      break;
+    case PROP_STATS:
+      GST_VIDEO_DECODER_STREAM_LOCK (dec);
+      g_value_take_boxed (value, gst_droiddec_get_stats (dec, dec->comp));
+      GST_VIDEO_DECODER_STREAM_UNLOCK (dec);
+      break;
+    case PROP_QOS:
+      g_value_set_boolean (value, dec->qos);
+      break;
+    case PROP_STATS_INTERVAL:
+      GST_OBJECT_LOCK (dec);
+      g_value_set_uint (value, dec->stats_interval);
+      GST_OBJECT_UNLOCK (dec);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
 static void
 gst_droiddec_init (GstDroidDec * dec)
 {
@@ -563,6 +1285,28 @@ gst_droiddec_init (GstDroidDec * dec)
   dec->comp = NULL;
   dec->in_state = NULL;
   dec->out_state = NULL;
+  dec->use_crop_meta = FALSE;
+  dec->has_crop = FALSE;
+  dec->priority = GST_DROID_CODEC_PRIORITY_DEFAULT;
+  dec->admission_timeout = GST_DROID_CODEC_ADMISSION_TIMEOUT_DEFAULT;
+  dec->recover = DEFAULT_RECOVER;
+  dec->recoveries = 0;
+  dec->wait_for_sync = FALSE;
+  dec->low_latency = DEFAULT_LOW_LATENCY;
+  dec->qos = DEFAULT_QOS;
+  dec->qos_skipping = FALSE;
+  dec->frames_decoded = 0;
+  dec->frames_skipped = 0;
+  dec->frames_fragmented = 0;
+  dec->largest_frame = 0;
+  dec->input_buffer_size = 0;
+  dec->latency_frames = 0;
+  dec->latency_last = 0;
+  dec->latency_min = 0;
+  dec->latency_max = 0;
+  dec->latency_total = 0;
+  dec->stats_interval = DEFAULT_STATS_INTERVAL;
+  dec->stats_posted = 0;
 }
 
 static GstStateChangeReturn
@@ -670,6 +1414,8 @@ gst_droiddec_class_init (GstDroidDecClass * klass)
       gst_static_pad_template_get (&gst_droiddec_src_template_factory));
 
   gobject_class->finalize = gst_droiddec_finalize;
+  gobject_class->set_property = gst_droiddec_set_property;
+  gobject_class->get_property = gst_droiddec_get_property;
   gstelement_class->change_state =
       GST_DEBUG_FUNCPTR (gst_droiddec_change_state);
   gstvideodecoder_class->open = GST_DEBUG_FUNCPTR (gst_droiddec_open);
@@ -687,4 +1433,61 @@ gst_droiddec_class_init (GstDroidDecClass * klass)
       GST_DEBUG_FUNCPTR (gst_droiddec_propose_allocation);
   gstvideodecoder_class->flush = GST_DEBUG_FUNCPTR (gst_droiddec_flush);
   gstvideodecoder_class->negotiate = GST_DEBUG_FUNCPTR (gst_droiddec_negotiate);
+
+  g_object_class_install_property (gobject_class, PROP_PRIORITY,
+      g_param_spec_int ("priority", "Priority",
+          "Priority when waiting for a hardware codec instance. "
+          "Higher values are served first", G_MININT, G_MAXINT,
+          GST_DROID_CODEC_PRIORITY_DEFAULT,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_ADMISSION_TIMEOUT,
+      g_param_spec_int ("admission-timeout", "Admission timeout",
+          "Milliseconds to wait for a hardware codec instance when all are "
+          "in use (-1=forever, 0=fail immediately)", -1, G_MAXINT,
+          GST_DROID_CODEC_ADMISSION_TIMEOUT_DEFAULT,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_INSTANCE_STATS,
+      g_param_spec_boxed ("instance-stats", "Instance statistics",
+          "Hardware codec instance occupancy per core", GST_TYPE_STRUCTURE,
+          G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_RECOVER,
+      g_param_spec_boolean ("recover", "Recover",
+          "Replace the component and resume from the next sync frame "
+          "when it reports an error", DEFAULT_RECOVER,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_RECOVERIES,
+      g_param_spec_uint ("recoveries", "Recoveries",
+          "Number of times the component has been replaced after an error",
+          0, G_MAXUINT, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_LOW_LATENCY,
+      g_param_spec_boolean ("low-latency", "Low latency",
+          "Use as few output buffers as possible and ask the component to "
+          "output frames in decode order when the stream profile does not "
+          "reorder them", DEFAULT_LOW_LATENCY,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_STATS,
+      g_param_spec_boxed ("stats", "Statistics",
+          "Decoded frames, the time (ns) between submitting a frame to "
+          "the component and getting it back and how often frames did not "
+          "fit in one input buffer. While decoding it also has the "
+          "component counters", GST_TYPE_STRUCTURE,
+          G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_QOS,
+      g_param_spec_boolean ("qos", "QoS",
+          "Skip frames which will be too late before they reach the "
+          "component", DEFAULT_QOS,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_STATS_INTERVAL,
+      g_param_spec_uint ("stats-interval", "Statistics interval",
+          "Post the statistics as an element message at most every this "
+          "many milliseconds while decoding (0=never)", 0, G_MAXUINT,
+          DEFAULT_STATS_INTERVAL, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 }
@@ -49,6 +49,42 @@ struct _GstDroidDec
   GstDroidComponent *comp;
   GstVideoCodecState *in_state;
   GstVideoCodecState *out_state;
+  gint priority;
+  gint admission_timeout;
+  gboolean recover;
+  guint recoveries;
+  /* drop frames until a sync point after recovering */
+  gboolean wait_for_sync;
+  gboolean low_latency;
+  gboolean qos;
+  /* dropping the rest of a GOP we are too late for */
+  gboolean qos_skipping;
+
+  /* protected by the object lock */
+  guint64 frames_decoded;
+  guint64 frames_skipped;
+  /* frames split across more than one input buffer */
+  guint64 frames_fragmented;
+  gsize largest_frame;
+  /* input buffer size we asked the component for */
+  gsize input_buffer_size;
+  /* from the submission times the component keeps. Frames it did not
+   * return our timestamp for are not included */
+  guint64 latency_frames;
+  GstClockTime latency_last;
+  GstClockTime latency_min;
+  GstClockTime latency_max;
+  GstClockTime latency_total;
+  /* ms between stats messages. 0 to never post them */
+  guint stats_interval;
+
+  /* when the last stats message was posted. Only used by _loop () */
+  gint64 stats_posted;
+
+  /* output crop as reported by the component */
+  gboolean use_crop_meta;
+  gboolean has_crop;
+  GstVideoRectangle crop;
 };
 
 struct _GstDroidDecClass
@@ -47,8 +47,48 @@ enum
 {
   PROP_0,
   PROP_TARGET_BITRATE,
+  PROP_OUTPUT_BUFFERS,
+  PROP_PRIORITY,
+  PROP_ADMISSION_TIMEOUT,
+  PROP_INSTANCE_STATS,
+  PROP_RECOVER,
+  PROP_RECOVERIES,
+  PROP_CONTROL_RATE,
+  PROP_KEYFRAME_INTERVAL,
+  PROP_SLICE_SIZE,
+  PROP_INTRA_REFRESH,
+  PROP_STATS,
+  PROP_STATS_INTERVAL,
 };
 
+#define DEFAULT_OUTPUT_BUFFERS 0
+#define DEFAULT_RECOVER FALSE
+#define DEFAULT_STATS_INTERVAL 0
+
+GType
+gst_droidenc_control_rate_get_type (void)
+{
+  static volatile gsize type = 0;
+
+  if (g_once_init_enter (&type)) {
+    static const GEnumValue values[] = {
+      {OMX_Video_ControlRateDisable, "Disable rate control", "disable"},
+      {OMX_Video_ControlRateVariable, "Variable bitrate", "variable"},
+      {OMX_Video_ControlRateConstant, "Constant bitrate", "constant"},
+      {OMX_Video_ControlRateVariableSkipFrames,
+          "Variable bitrate, frames can be skipped", "variable-skip-frames"},
+      {OMX_Video_ControlRateConstantSkipFrames,
+          "Constant bitrate, frames can be skipped", "constant-skip-frames"},
+      {0, NULL, NULL}
+    };
+
+    g_once_init_leave (&type,
+        g_enum_register_static ("GstDroidEncControlRate", values));
+  }
+
+  return type;
+}
+
 static gboolean
 gst_droidenc_do_handle_frame (GstVideoEncoder * encoder,
     GstVideoCodecFrame * frame)
@@ -61,7 +101,7 @@ gst_droidenc_do_handle_frame (GstVideoEncoder * encoder,
   /* This can deadlock if omx does not provide an input buffer and we end up
    * waiting for a buffer which does not happen because omx needs us to provide
    * output buffers to be filled (which can not happen because _loop() tries
-   * to call get_oldest_frame() which acquires the stream lock the base class
+   * to look up the frame which acquires the stream lock the base class
    * is holding before calling us */
 
   GST_VIDEO_ENCODER_STREAM_UNLOCK (encoder);
@@ -92,24 +132,14 @@ gst_droidenc_stop_loop (GstVideoEncoder * encoder)
     return;
   }
 
+  /* This also puts the output queue in flushing mode which wakes up
+   * the task if it's waiting for a buffer */
   gst_droid_codec_set_running (enc->comp, FALSE);
 
   /* That should be enough for now as we can not deactivate our buffer pools
    * otherwise we end up freeing the buffers before deactivating our omx ports
    */
 
-  /* Just informing the task that we are finishing */
-  g_mutex_lock (&enc->comp->full_lock);
-  /* if the queue is empty then we _prepend_ a NULL buffer
-   * which should not be a problem because the loop is running
-   * and it will pop it. If it's not then we will clean it up later. */
-  if (enc->comp->full->length == 0) {
-    g_queue_push_head (enc->comp->full, NULL);
-  }
-
-  g_cond_signal (&enc->comp->full_cond);
-  g_mutex_unlock (&enc->comp->full_lock);
-
   /* We need to release the stream lock to prevent deadlocks when the _loop ()
    * function tries to call _finish_frame ()
    */
@@ -151,13 +181,98 @@ gst_droidenc_configure_state (GstVideoEncoder * encoder,
   return out;
 }
 
+/* comp must stay alive and keep its output ring while we read it. That is
+ * the case in _loop () and while holding the stream lock */
+static GstStructure *
+gst_droidenc_get_stats (GstDroidEnc * enc, GstDroidComponent * comp)
+{
+  GstStructure *s;
+
+  s = gst_structure_new ("droidenc-stats",
+      "recoveries", G_TYPE_UINT, enc->recoveries, NULL);
+
+  if (comp) {
+    gst_droid_codec_add_component_stats (comp, s);
+  }
+
+  return s;
+}
+
+static void
+gst_droidenc_post_stats (GstDroidEnc * enc)
+{
+  gint64 now = g_get_monotonic_time ();
+  guint interval;
+
+  GST_OBJECT_LOCK (enc);
+  interval = enc->stats_interval;
+  GST_OBJECT_UNLOCK (enc);
+
+  if (interval == 0
+      || now - enc->stats_posted < interval * G_GINT64_CONSTANT (1000)) {
+    return;
+  }
+
+  enc->stats_posted = now;
+
+  gst_element_post_message (GST_ELEMENT (enc),
+      gst_message_new_element (GST_OBJECT (enc),
+          gst_droidenc_get_stats (enc, enc->comp)));
+}
+
+/* Frames the component skipped (rate control can do that) never come back.
+ * The encoder does not reorder so anything submitted before the frame we
+ * just got is gone */
+static void
+gst_droidenc_drop_skipped_frames (GstDroidEnc * enc, GstVideoCodecFrame * frame)
+{
+  GList *frames, *l;
+
+  frames = gst_video_encoder_get_frames (GST_VIDEO_ENCODER (enc));
+
+  for (l = frames; l; l = l->next) {
+    GstVideoCodecFrame *f = l->data;
+
+    if (f->system_frame_number < frame->system_frame_number) {
+      GST_DEBUG_OBJECT (enc, "frame %u was skipped by the component",
+          f->system_frame_number);
+      gst_droid_codec_forget_frame (enc->comp, f);
+      /* finishing without an output buffer drops the frame and the
+       * reference _handle_frame () kept. The list has its own */
+      gst_video_encoder_finish_frame (GST_VIDEO_ENCODER (enc), f);
+    }
+  }
+
+  g_list_free_full (frames, (GDestroyNotify) gst_video_codec_frame_unref);
+}
+
+static GstVideoCodecFrame *
+gst_droidenc_find_frame (GstDroidEnc * enc, OMX_BUFFERHEADERTYPE * buff)
+{
+  GstVideoCodecFrame *frame;
+  guint32 number;
+
+  while (gst_droid_codec_match_frame (enc->comp, buff, &number, NULL)) {
+    frame = gst_video_encoder_get_frame (GST_VIDEO_ENCODER (enc), number);
+    if (frame) {
+      gst_droidenc_drop_skipped_frames (enc, frame);
+      return frame;
+    }
+  }
+
+  /* the component did not keep our timestamp */
+  GST_DEBUG_OBJECT (enc, "no frame with timestamp %lli, using the oldest",
+      (long long) buff->nTimeStamp);
+
+  return gst_video_encoder_get_oldest_frame (GST_VIDEO_ENCODER (enc));
+}
+
 static void
 gst_droidenc_loop (GstDroidEnc * enc)
 {
   OMX_BUFFERHEADERTYPE *buff;
   GstBuffer *buffer;
   GstVideoCodecFrame *frame;
-  GstMapInfo map = GST_MAP_INFO_INIT;
 
   while (gst_droid_codec_is_running (enc->comp)) {
     if (gst_droid_codec_has_error (enc->comp)) {
@@ -170,29 +285,13 @@ gst_droidenc_loop (GstDroidEnc * enc)
     }
 
     GST_DEBUG_OBJECT (enc, "trying to get a buffer");
-    g_mutex_lock (&enc->comp->full_lock);
-    buff = g_queue_pop_head (enc->comp->full);
-
-    if (!buff) {
-      if (!gst_droid_codec_is_running (enc->comp)) {
-        /* this is a signal that we should quit */
-        GST_DEBUG_OBJECT (enc, "got no buffer");
-        g_mutex_unlock (&enc->comp->full_lock);
-        continue;
-      }
-
-      g_cond_wait (&enc->comp->full_cond, &enc->comp->full_lock);
-      buff = g_queue_pop_head (enc->comp->full);
-    }
-
-    g_mutex_unlock (&enc->comp->full_lock);
+    buff = gst_droid_codec_ring_pop_wait (enc->comp->full);
     GST_DEBUG_OBJECT (enc, "got buffer %p", buff);
 
     if (!buff) {
       GST_DEBUG_OBJECT (enc, "got no buffer");
-      /* This can only happen if we are not running
-       * yet we will not exit because we should detect
-       * that upon looping */
+      /* The queue is flushing which means we are not running anymore.
+       * We will exit upon looping */
       continue;
     }
 
@@ -217,9 +316,11 @@ gst_droidenc_loop (GstDroidEnc * enc)
         gst_video_encoder_set_headers (encoder, headers);
       } else {
         gst_buffer_replace (&enc->out_state->codec_data, codec_data);
-        gst_buffer_unref (buffer);
+        gst_buffer_unref (codec_data);
       }
 
+      gst_buffer_unref (buffer);
+
       continue;
     }
 
@@ -237,7 +338,7 @@ gst_droidenc_loop (GstDroidEnc * enc)
     }
 
     /* Now we can proceed. */
-    frame = gst_video_encoder_get_oldest_frame (GST_VIDEO_ENCODER (enc));
+    frame = gst_droidenc_find_frame (enc, buff);
     if (!frame) {
       gst_buffer_unref (buffer);
       GST_ERROR_OBJECT (enc, "can not find a video frame");
@@ -246,23 +347,18 @@ gst_droidenc_loop (GstDroidEnc * enc)
 
     if (!buff->nFilledLen) {
       GST_WARNING_OBJECT (enc, "received empty buffer");
-      gst_video_codec_frame_unref (frame);      /* we have an extra ref from _get_oldest_frame */
+      gst_video_codec_frame_unref (frame);      /* we have an extra ref from _find_frame */
       gst_video_encoder_finish_frame (GST_VIDEO_ENCODER (enc), frame);
       gst_buffer_unref (buffer);
       continue;
     }
 
-    frame->output_buffer =
-        gst_video_encoder_allocate_output_buffer (GST_VIDEO_ENCODER (enc),
-        buff->nFilledLen);
-
     if (buff->nFlags & OMX_BUFFERFLAG_SYNCFRAME) {
       GST_VIDEO_CODEC_FRAME_SET_SYNC_POINT (frame);
     }
 
-    gst_buffer_map (frame->output_buffer, &map, GST_MAP_WRITE);
-    memcpy (map.data, buff->pBuffer + buff->nOffset, buff->nFilledLen);
-    gst_buffer_unmap (frame->output_buffer, &map);
+    /* the omx buffer goes back to the encoder when downstream is done */
+    frame->output_buffer = gst_droid_codec_wrap_output_buffer (enc->comp, buff);
 
     GST_DEBUG_OBJECT (enc, "finishing frame %p", frame);
 
@@ -270,7 +366,8 @@ gst_droidenc_loop (GstDroidEnc * enc)
 
     gst_video_encoder_finish_frame (GST_VIDEO_ENCODER (enc), frame);
     gst_video_codec_frame_unref (frame);
-    gst_buffer_unref (buffer);
+
+    gst_droidenc_post_stats (enc);
   }
 
   if (!gst_droid_codec_is_running (enc->comp)) {
@@ -293,7 +390,39 @@ gst_droidenc_set_property (GObject * object, guint prop_id,
 
   switch (prop_id) {
     case PROP_TARGET_BITRATE:
+      GST_OBJECT_LOCK (enc);
       enc->target_bitrate = g_value_get_uint (value);
+      enc->bitrate_changed = TRUE;
+      GST_OBJECT_UNLOCK (enc);
+      break;
+    case PROP_OUTPUT_BUFFERS:
+      enc->output_buffers = g_value_get_uint (value);
+      break;
+    case PROP_PRIORITY:
+      enc->priority = g_value_get_int (value);
+      break;
+    case PROP_ADMISSION_TIMEOUT:
+      enc->admission_timeout = g_value_get_int (value);
+      break;
+    case PROP_RECOVER:
+      enc->recover = g_value_get_boolean (value);
+      break;
+    case PROP_CONTROL_RATE:
+      enc->control_rate = g_value_get_enum (value);
+      break;
+    case PROP_KEYFRAME_INTERVAL:
+      enc->keyframe_interval = g_value_get_int (value);
+      break;
+    case PROP_SLICE_SIZE:
+      enc->slice_size = g_value_get_uint (value);
+      break;
+    case PROP_INTRA_REFRESH:
+      enc->intra_refresh = g_value_get_uint (value);
+      break;
+    case PROP_STATS_INTERVAL:
+      GST_OBJECT_LOCK (enc);
+      enc->stats_interval = g_value_get_uint (value);
+      GST_OBJECT_UNLOCK (enc);
       break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
@@ -309,7 +438,50 @@ gst_droidenc_get_property (GObject * object, guint prop_id, GValue * value,
 
   switch (prop_id) {
     case PROP_TARGET_BITRATE:
+      GST_OBJECT_LOCK (enc);
       g_value_set_uint (value, enc->target_bitrate);
+      GST_OBJECT_UNLOCK (enc);
+      break;
+    case PROP_OUTPUT_BUFFERS:
+      g_value_set_uint (value, enc->output_buffers);
+      break;
+    case PROP_PRIORITY:
+      g_value_set_int (value, enc->priority);
+      break;
+    case PROP_ADMISSION_TIMEOUT:
+      g_value_set_int (value, enc->admission_timeout);
+      break;
+    case PROP_INSTANCE_STATS:
+      g_value_take_boxed (value,
+          gst_droid_codec_get_instance_stats (enc->codec));
+      break;
+    case PROP_RECOVER:
+      g_value_set_boolean (value, enc->recover);
+      break;
+    case PROP_RECOVERIES:
+      g_value_set_uint (value, enc->recoveries);
+      break;
+    case PROP_CONTROL_RATE:
+      g_value_set_enum (value, enc->control_rate);
+      break;
+    case PROP_KEYFRAME_INTERVAL:
+      g_value_set_int (value, enc->keyframe_interval);
+      break;
+    case PROP_SLICE_SIZE:
+      g_value_set_uint (value, enc->slice_size);
+      break;
+    case PROP_INTRA_REFRESH:
+      g_value_set_uint (value, enc->intra_refresh);
+      break;
+    case PROP_STATS:
+      GST_VIDEO_ENCODER_STREAM_LOCK (enc);
+      g_value_take_boxed (value, gst_droidenc_get_stats (enc, enc->comp));
+      GST_VIDEO_ENCODER_STREAM_UNLOCK (enc);
+      break;
+    case PROP_STATS_INTERVAL:
+      GST_OBJECT_LOCK (enc);
+      g_value_set_uint (value, enc->stats_interval);
+      GST_OBJECT_UNLOCK (enc);
       break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
@@ -387,7 +559,7 @@ gst_droidenc_stop (GstVideoEncoder * encoder)
 
   if (enc->comp) {
     gst_droid_codec_stop_component (enc->comp);
-    gst_droid_codec_destroy_component (enc->comp);
+    gst_droid_codec_put_component (enc->comp);
     enc->comp = NULL;
   }
 
@@ -396,6 +568,139 @@ gst_droidenc_stop (GstVideoEncoder * encoder)
   return TRUE;
 }
 
+/* creates and configures enc->comp for enc->in_state */
+static gboolean
+gst_droidenc_create_component (GstDroidEnc * enc, const gchar * type,
+    GstCaps * caps)
+{
+  GstDroidCodecEncodingParams params;
+
+  GST_OBJECT_LOCK (enc);
+  params.bitrate = enc->target_bitrate;
+  enc->bitrate_changed = FALSE;
+  GST_OBJECT_UNLOCK (enc);
+
+  params.control_rate = enc->control_rate;
+  params.keyframe_interval = enc->keyframe_interval;
+  params.slice_size = enc->slice_size;
+  params.intra_refresh = enc->intra_refresh;
+
+  enc->framerate_changed = FALSE;
+
+  enc->comp =
+      gst_droid_codec_get_component_full (enc->codec, type, GST_ELEMENT (enc),
+      enc->priority, enc->admission_timeout);
+  if (!enc->comp) {
+    GST_ERROR_OBJECT (enc, "failed to get component");
+    return FALSE;
+  }
+
+  /* configure codec */
+  if (!gst_droid_codec_configure_component (enc->comp, &enc->in_state->info)) {
+    return FALSE;
+  }
+
+  if (!gst_droid_codec_apply_encoding_params (enc->comp, &enc->in_state->info,
+          caps, &params)) {
+    return FALSE;
+  }
+
+  if (enc->output_buffers != DEFAULT_OUTPUT_BUFFERS
+      && !gst_droid_codec_set_port_buffer_count (enc->comp,
+          enc->comp->out_port, enc->output_buffers)) {
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+static gboolean
+gst_droidenc_start_component (GstDroidEnc * enc)
+{
+  GstVideoEncoder *encoder = GST_VIDEO_ENCODER (enc);
+
+  if (!gst_droid_codec_start_component (enc->comp, enc->in_state->caps,
+          enc->out_state->caps)) {
+    return FALSE;
+  }
+
+  if (!gst_pad_start_task (GST_VIDEO_ENCODER_SRC_PAD (encoder),
+          (GstTaskFunction) gst_droidenc_loop, gst_object_ref (enc),
+          gst_object_unref)) {
+    GST_ERROR_OBJECT (enc, "failed to start src task");
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+/* Only the framerate can change without restarting the component */
+static gboolean
+gst_droidenc_update_format (GstDroidEnc * enc, GstVideoCodecState * state)
+{
+  GstVideoInfo *old = &enc->in_state->info;
+  GstVideoInfo *info = &state->info;
+  GstVideoCodecState *out;
+  GstCaps *caps;
+
+  if (GST_VIDEO_INFO_FORMAT (old) != GST_VIDEO_INFO_FORMAT (info)
+      || GST_VIDEO_INFO_WIDTH (old) != GST_VIDEO_INFO_WIDTH (info)
+      || GST_VIDEO_INFO_HEIGHT (old) != GST_VIDEO_INFO_HEIGHT (info)) {
+    return FALSE;
+  }
+
+  if (GST_VIDEO_INFO_FPS_N (old) == GST_VIDEO_INFO_FPS_N (info)
+      && GST_VIDEO_INFO_FPS_D (old) == GST_VIDEO_INFO_FPS_D (info)) {
+    return TRUE;
+  }
+
+  GST_INFO_OBJECT (enc, "framerate changed to %d/%d",
+      GST_VIDEO_INFO_FPS_N (info), GST_VIDEO_INFO_FPS_D (info));
+
+  gst_video_codec_state_unref (enc->in_state);
+  enc->in_state = gst_video_codec_state_ref (state);
+
+  caps = gst_caps_copy (enc->out_state->caps);
+  gst_caps_set_simple (caps, "framerate", GST_TYPE_FRACTION,
+      GST_VIDEO_INFO_FPS_N (info), GST_VIDEO_INFO_FPS_D (info), NULL);
+
+  out = gst_video_encoder_set_output_state (GST_VIDEO_ENCODER (enc), caps,
+      enc->in_state);
+  gst_buffer_replace (&out->codec_data, enc->out_state->codec_data);
+  gst_video_codec_state_unref (enc->out_state);
+  enc->out_state = out;
+
+  /* applied with the next frame */
+  enc->framerate_changed = TRUE;
+
+  return TRUE;
+}
+
+/* Applies property and framerate changes made since the last frame */
+static void
+gst_droidenc_update_config (GstDroidEnc * enc)
+{
+  gboolean bitrate_changed;
+  guint32 bitrate;
+
+  GST_OBJECT_LOCK (enc);
+  bitrate_changed = enc->bitrate_changed;
+  bitrate = enc->target_bitrate;
+  enc->bitrate_changed = FALSE;
+  GST_OBJECT_UNLOCK (enc);
+
+  if (bitrate_changed && bitrate != GST_DROID_ENC_TARGET_BITRATE_DEFAULT) {
+    gst_droid_codec_update_bitrate (enc->comp, bitrate);
+  }
+
+  if (enc->framerate_changed) {
+    enc->framerate_changed = FALSE;
+    gst_droid_codec_update_framerate (enc->comp,
+        GST_VIDEO_INFO_FPS_N (&enc->in_state->info),
+        GST_VIDEO_INFO_FPS_D (&enc->in_state->info));
+  }
+}
+
 static gboolean
 gst_droidenc_set_format (GstVideoEncoder * encoder, GstVideoCodecState * state)
 {
@@ -406,8 +711,12 @@ gst_droidenc_set_format (GstVideoEncoder * encoder, GstVideoCodecState * state)
   GST_DEBUG_OBJECT (enc, "set format %" GST_PTR_FORMAT, state->caps);
 
   if (enc->comp) {
-    GST_ERROR_OBJECT (enc, "cannot renegotiate");
-    return FALSE;
+    if (!gst_droidenc_update_format (enc, state)) {
+      GST_ERROR_OBJECT (enc, "cannot renegotiate");
+      return FALSE;
+    }
+
+    return TRUE;
   }
 
   enc->first_frame_sent = FALSE;
@@ -436,42 +745,57 @@ gst_droidenc_set_format (GstVideoEncoder * encoder, GstVideoCodecState * state)
     return FALSE;
   }
 
-  enc->comp =
-      gst_droid_codec_get_component (enc->codec, type, GST_ELEMENT (enc));
-  if (!enc->comp) {
-    GST_ERROR_OBJECT (enc, "failed to get component");
+  if (!gst_droidenc_create_component (enc, type, caps)) {
     gst_caps_unref (caps);
     return FALSE;
   }
 
-  /* configure codec */
-  if (!gst_droid_codec_configure_component (enc->comp, &state->info)) {
-    gst_caps_unref (caps);
-    return FALSE;
-  }
+  enc->out_state =
+      gst_droidenc_configure_state (encoder, &state->info, caps, type);
 
-  if (!gst_droid_codec_apply_encoding_params (enc->comp, &state->info, caps,
-          enc->target_bitrate)) {
-    gst_caps_unref (caps);
-    return FALSE;
+  return gst_droidenc_start_component (enc);
+}
+
+static gboolean
+gst_droidenc_recover (GstDroidEnc * enc, GstVideoCodecFrame * frame)
+{
+  GstVideoEncoder *encoder = GST_VIDEO_ENCODER (enc);
+  const gchar *type =
+      gst_droid_codec_type_from_caps (enc->out_state->caps,
+      GST_DROID_CODEC_ENCODER);
+  GList *frames, *l;
+
+  GST_WARNING_OBJECT (enc, "component failed. Trying to recover");
+
+  gst_droidenc_stop_loop (encoder);
+  gst_droid_codec_stop_component (enc->comp);
+  gst_droid_codec_destroy_component (enc->comp);
+  enc->comp = NULL;
+
+  /* whatever the old component had will never be encoded */
+  frames = gst_video_encoder_get_frames (encoder);
+  for (l = frames; l; l = l->next) {
+    if (l->data != frame) {
+      gst_video_encoder_finish_frame (encoder, l->data);
+    }
   }
 
-  enc->out_state =
-      gst_droidenc_configure_state (encoder, &state->info, caps, type);
+  g_list_free_full (frames, (GDestroyNotify) gst_video_codec_frame_unref);
 
-  /* now start */
-  if (!gst_droid_codec_start_component (enc->comp, enc->in_state->caps,
-          enc->out_state->caps)) {
+  if (!gst_droidenc_create_component (enc, type, enc->out_state->caps)) {
     return FALSE;
   }
 
-  if (!gst_pad_start_task (GST_VIDEO_ENCODER_SRC_PAD (encoder),
-          (GstTaskFunction) gst_droidenc_loop, gst_object_ref (enc),
-          gst_object_unref)) {
-    GST_ERROR_OBJECT (enc, "failed to start src task");
+  /* the new component starts with a sync frame and sends its headers again */
+  if (!gst_droidenc_start_component (enc)) {
     return FALSE;
   }
 
+  enc->recoveries++;
+
+  GST_ELEMENT_WARNING (enc, LIBRARY, FAILED, (NULL),
+      ("recovered from component error (%u recoveries)", enc->recoveries));
+
   return TRUE;
 }
 
@@ -502,10 +826,19 @@ gst_droidenc_handle_frame (GstVideoEncoder * encoder,
   }
 
   if (gst_droid_codec_has_error (enc->comp)) {
-    GST_ERROR_OBJECT (enc, "not handling frame while omx is in error state");
-    goto out;
+    if (!enc->recover) {
+      GST_ERROR_OBJECT (enc, "not handling frame while omx is in error state");
+      goto out;
+    }
+
+    if (!gst_droidenc_recover (enc, frame)) {
+      GST_ERROR_OBJECT (enc, "failed to recover from omx error");
+      goto out;
+    }
   }
 
+  gst_droidenc_update_config (enc);
+
   if (GST_VIDEO_CODEC_FRAME_IS_FORCE_KEYFRAME (frame)) {
     OMX_CONFIG_INTRAREFRESHVOPTYPE config;
     OMX_ERRORTYPE err;
@@ -575,6 +908,19 @@ gst_droidenc_init (GstDroidEnc * enc)
   enc->in_state = NULL;
   enc->out_state = NULL;
   enc->target_bitrate = GST_DROID_ENC_TARGET_BITRATE_DEFAULT;
+  enc->bitrate_changed = FALSE;
+  enc->framerate_changed = FALSE;
+  enc->output_buffers = DEFAULT_OUTPUT_BUFFERS;
+  enc->priority = GST_DROID_CODEC_PRIORITY_DEFAULT;
+  enc->admission_timeout = GST_DROID_CODEC_ADMISSION_TIMEOUT_DEFAULT;
+  enc->recover = DEFAULT_RECOVER;
+  enc->recoveries = 0;
+  enc->control_rate = GST_DROID_ENC_CONTROL_RATE_DEFAULT;
+  enc->keyframe_interval = GST_DROID_ENC_KEYFRAME_INTERVAL_DEFAULT;
+  enc->slice_size = GST_DROID_ENC_SLICE_SIZE_DEFAULT;
+  enc->intra_refresh = GST_DROID_ENC_INTRA_REFRESH_DEFAULT;
+  enc->stats_interval = DEFAULT_STATS_INTERVAL;
+  enc->stats_posted = 0;
 }
 
 static GstStateChangeReturn
@@ -679,7 +1025,84 @@ gst_droidenc_class_init (GstDroidEncClass * klass)
 
   g_object_class_install_property (gobject_class, PROP_TARGET_BITRATE,
       g_param_spec_uint ("target-bitrate", "Target Bitrate",
-          "Target bitrate (0xffffffff=component default)", 0, G_MAXUINT,
+          "Target bitrate (0xffffffff=component default). Can be changed "
+          "while encoding", 0, G_MAXUINT,
           GST_DROID_ENC_TARGET_BITRATE_DEFAULT,
+          G_PARAM_READWRITE | GST_PARAM_MUTABLE_PLAYING |
+          G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_OUTPUT_BUFFERS,
+      g_param_spec_uint ("output-buffers", "Output buffers",
+          "Number of output buffers allocated by the encoder. Downstream can "
+          "hold encoded buffers without stalling the encoder as long as "
+          "some are left (0=component default)", 0, G_MAXUINT,
+          DEFAULT_OUTPUT_BUFFERS, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_PRIORITY,
+      g_param_spec_int ("priority", "Priority",
+          "Priority when waiting for a hardware codec instance. "
+          "Higher values are served first", G_MININT, G_MAXINT,
+          GST_DROID_CODEC_PRIORITY_DEFAULT,
           G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_ADMISSION_TIMEOUT,
+      g_param_spec_int ("admission-timeout", "Admission timeout",
+          "Milliseconds to wait for a hardware codec instance when all are "
+          "in use (-1=forever, 0=fail immediately)", -1, G_MAXINT,
+          GST_DROID_CODEC_ADMISSION_TIMEOUT_DEFAULT,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_INSTANCE_STATS,
+      g_param_spec_boxed ("instance-stats", "Instance statistics",
+          "Hardware codec instance occupancy per core", GST_TYPE_STRUCTURE,
+          G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_RECOVER,
+      g_param_spec_boolean ("recover", "Recover",
+          "Replace the component and carry on encoding when it reports "
+          "an error", DEFAULT_RECOVER,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_RECOVERIES,
+      g_param_spec_uint ("recoveries", "Recoveries",
+          "Number of times the component has been replaced after an error",
+          0, G_MAXUINT, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_CONTROL_RATE,
+      g_param_spec_enum ("control-rate", "Control rate",
+          "Bitrate control method", GST_TYPE_DROIDENC_CONTROL_RATE,
+          GST_DROID_ENC_CONTROL_RATE_DEFAULT,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_KEYFRAME_INTERVAL,
+      g_param_spec_int ("keyframe-interval", "Keyframe interval",
+          "Frames between keyframes (-1=one second, 0=first frame only)",
+          -1, G_MAXINT, GST_DROID_ENC_KEYFRAME_INTERVAL_DEFAULT,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_SLICE_SIZE,
+      g_param_spec_uint ("slice-size", "Slice size",
+          "Macroblocks per slice (0=one slice per frame)", 0, G_MAXUINT,
+          GST_DROID_ENC_SLICE_SIZE_DEFAULT,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_INTRA_REFRESH,
+      g_param_spec_uint ("intra-refresh", "Intra refresh",
+          "Macroblocks refreshed per frame by cyclic intra refresh. Together "
+          "with keyframe-interval=0 this avoids keyframe bitrate spikes "
+          "(0=disabled)", 0, G_MAXUINT, GST_DROID_ENC_INTRA_REFRESH_DEFAULT,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_STATS,
+      g_param_spec_boxed ("stats", "Statistics",
+          "Component counters while encoding: frames and bytes in and out, "
+          "time (ns) spent waiting for input buffers, output queue depth, "
+          "reconfigurations, flushes, errors and a latency histogram",
+          GST_TYPE_STRUCTURE, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_STATS_INTERVAL,
+      g_param_spec_uint ("stats-interval", "Statistics interval",
+          "Post the statistics as an element message at most every this "
+          "many milliseconds while encoding (0=never)", 0, G_MAXUINT,
+          DEFAULT_STATS_INTERVAL, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 }
@@ -38,6 +38,8 @@ G_BEGIN_DECLS
   (G_TYPE_CHECK_INSTANCE_TYPE((obj), GST_TYPE_DROIDENC))
 #define GST_IS_DROIDENC_CLASS(klass) \
   (G_TYPE_CHECK_CLASS_TYPE((klass), GST_TYPE_DROIDENC))
+#define GST_TYPE_DROIDENC_CONTROL_RATE \
+  (gst_droidenc_control_rate_get_type())
 
 typedef struct _GstDroidEnc GstDroidEnc;
 typedef struct _GstDroidEncClass GstDroidEncClass;
@@ -51,7 +53,25 @@ struct _GstDroidEnc
   GstVideoCodecState *out_state;
   gboolean first_frame_sent;
   guint32 target_bitrate;
+  /* target_bitrate and bitrate_changed are protected by the object lock */
+  gboolean bitrate_changed;
+  gboolean framerate_changed;
+  gint control_rate;
+  gint keyframe_interval;
+  guint slice_size;
+  guint intra_refresh;
+  guint output_buffers;
+  gint priority;
+  gint admission_timeout;
+  gboolean recover;
+  guint recoveries;
   gboolean in_stream_headers;
+  /* ms between stats messages, protected by the object lock. 0 to never
+   * post them */
+  guint stats_interval;
+
+  /* when the last stats message was posted. Only used by _loop () */
+  gint64 stats_posted;
 };
 
 struct _GstDroidEncClass
@@ -60,6 +80,7 @@ struct _GstDroidEncClass
 };
 
 GType gst_droidenc_get_type (void);
+GType gst_droidenc_control_rate_get_type (void);
 
 G_END_DECLS
 
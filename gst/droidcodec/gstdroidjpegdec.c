@@ -0,0 +1,700 @@
+/*
+ * gst-droid
+ *
+ * Copyright (C) 2014 Mohammed Sameer <msameer@foolab.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "gstdroidjpegdec.h"
+#include "gst/memory/gstgralloc.h"
+#include "gstdroidcodectype.h"
+#include "plugin.h"
+
+#define gst_droidjpegdec_parent_class parent_class
+G_DEFINE_TYPE (GstDroidJpegDec, gst_droidjpegdec, GST_TYPE_VIDEO_DECODER);
+
+GST_DEBUG_CATEGORY_EXTERN (gst_droid_jpegdec_debug);
+#define GST_CAT_DEFAULT gst_droid_jpegdec_debug
+
+static GstStaticPadTemplate gst_droidjpegdec_src_template_factory =
+GST_STATIC_PAD_TEMPLATE (GST_VIDEO_DECODER_SRC_NAME,
+    GST_PAD_SRC,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS (GST_VIDEO_CAPS_MAKE_WITH_FEATURES
+        (GST_CAPS_FEATURE_MEMORY_DROID_HANDLE, "{ENCODED, YV12}")));
+
+enum
+{
+  PROP_0,
+  PROP_PRIORITY,
+  PROP_ADMISSION_TIMEOUT,
+  PROP_DOWNSCALE,
+};
+
+#define DEFAULT_DOWNSCALE 1
+
+static void gst_droidjpegdec_loop (GstDroidJpegDec * dec);
+
+static gboolean
+gst_droidjpegdec_start_loop (GstDroidJpegDec * dec)
+{
+  if (!gst_pad_start_task (GST_VIDEO_DECODER_SRC_PAD (dec),
+          (GstTaskFunction) gst_droidjpegdec_loop, gst_object_ref (dec),
+          gst_object_unref)) {
+    GST_ERROR_OBJECT (dec, "failed to start src task");
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+static void
+gst_droidjpegdec_stop_loop (GstVideoDecoder * decoder)
+{
+  GstDroidJpegDec *dec = GST_DROIDJPEGDEC (decoder);
+
+  GST_DEBUG_OBJECT (dec, "stop loop");
+
+  if (!dec->comp) {
+    /* nothing to do here */
+    return;
+  }
+
+  /* This also puts the output queue in flushing mode which wakes up
+   * the task if it's waiting for a buffer */
+  gst_droid_codec_set_running (dec->comp, FALSE);
+
+  /* _loop () needs the stream lock to finish frames */
+  GST_VIDEO_DECODER_STREAM_UNLOCK (decoder);
+  GST_PAD_STREAM_LOCK (GST_VIDEO_DECODER_SRC_PAD (decoder));
+  GST_PAD_STREAM_UNLOCK (GST_VIDEO_DECODER_SRC_PAD (decoder));
+  GST_VIDEO_DECODER_STREAM_LOCK (decoder);
+
+  if (!gst_pad_stop_task (GST_VIDEO_DECODER_SRC_PAD (decoder))) {
+    GST_WARNING_OBJECT (dec, "failed to stop src pad task");
+  }
+
+  GST_DEBUG_OBJECT (dec, "stopped loop");
+}
+
+static void
+gst_droidjpegdec_configure_state (GstDroidJpegDec * dec)
+{
+  OMX_IMAGE_PORTDEFINITIONTYPE *image = &dec->comp->out_port->def.format.image;
+  GstCapsFeatures *feature;
+
+  GST_DEBUG_OBJECT (dec, "configure state: width: %lu, height: %lu, fmt: 0x%x",
+      image->nFrameWidth, image->nFrameHeight, image->eColorFormat);
+
+  if (dec->out_state) {
+    gst_video_codec_state_unref (dec->out_state);
+  }
+
+  dec->out_state =
+      gst_video_decoder_set_output_state (GST_VIDEO_DECODER (dec),
+      GST_VIDEO_FORMAT_ENCODED, image->nFrameWidth, image->nFrameHeight,
+      dec->in_state);
+
+  if (!dec->out_state->caps) {
+    /* we will add our caps */
+    dec->out_state->caps = gst_video_info_to_caps (&dec->out_state->info);
+  }
+
+  feature = gst_caps_features_new (GST_CAPS_FEATURE_MEMORY_DROID_HANDLE, NULL);
+  gst_caps_set_features (dec->out_state->caps, 0, feature);
+
+  GST_DEBUG_OBJECT (dec, "output caps %" GST_PTR_FORMAT, dec->out_state->caps);
+}
+
+static GstVideoCodecFrame *
+gst_droidjpegdec_find_frame (GstDroidJpegDec * dec,
+    OMX_BUFFERHEADERTYPE * buff)
+{
+  GstVideoCodecFrame *frame;
+  guint32 number;
+
+  while (gst_droid_codec_match_frame (dec->comp, buff, &number, NULL)) {
+    frame = gst_video_decoder_get_frame (GST_VIDEO_DECODER (dec), number);
+    if (frame) {
+      return frame;
+    }
+  }
+
+  /* one image in, one image out */
+  return gst_video_decoder_get_oldest_frame (GST_VIDEO_DECODER (dec));
+}
+
+static void
+gst_droidjpegdec_loop (GstDroidJpegDec * dec)
+{
+  OMX_BUFFERHEADERTYPE *buff;
+  GstBuffer *buffer;
+  GstVideoCodecFrame *frame;
+
+  while (gst_droid_codec_is_running (dec->comp)) {
+    if (gst_droid_codec_has_error (dec->comp)) {
+      return;
+    }
+
+    if (!gst_droid_codec_return_output_buffers (dec->comp)) {
+      GST_WARNING_OBJECT (dec,
+          "failed to return output buffers to the decoder");
+    }
+
+    GST_DEBUG_OBJECT (dec, "trying to get a buffer");
+    buff = gst_droid_codec_ring_pop_wait (dec->comp->full);
+    GST_DEBUG_OBJECT (dec, "got buffer %p", buff);
+
+    if (!buff) {
+      GST_DEBUG_OBJECT (dec, "got no buffer");
+      /* The queue is flushing which means we are not running anymore.
+       * We will exit upon looping */
+      continue;
+    }
+
+    buffer = gst_omx_buffer_get_buffer (dec->comp, buff);
+    if (!buffer) {
+      GST_ERROR_OBJECT (dec, "can not get buffer associated with omx buffer %p",
+          buff);
+      continue;
+    }
+
+    frame = gst_droidjpegdec_find_frame (dec, buff);
+    if (!frame) {
+      gst_buffer_unref (buffer);
+      GST_ERROR_OBJECT (dec, "can not find a video frame");
+      continue;
+    }
+
+    frame->output_buffer = buffer;
+
+    GST_DEBUG_OBJECT (dec, "finishing frame %p", frame);
+
+    gst_video_decoder_finish_frame (GST_VIDEO_DECODER (dec), frame);
+    gst_video_codec_frame_unref (frame);
+  }
+
+  if (!gst_droid_codec_is_running (dec->comp)) {
+    GST_DEBUG_OBJECT (dec, "stopping task");
+
+    if (!gst_pad_pause_task (GST_VIDEO_DECODER_SRC_PAD (dec))) {
+      GST_WARNING_OBJECT (dec, "failed to pause src pad task");
+    }
+
+    return;
+  }
+}
+
+static void
+gst_droidjpegdec_finalize (GObject * object)
+{
+  GstDroidJpegDec *dec = GST_DROIDJPEGDEC (object);
+
+  GST_DEBUG_OBJECT (dec, "finalize");
+
+  gst_mini_object_unref (GST_MINI_OBJECT (dec->codec));
+  dec->codec = NULL;
+
+  G_OBJECT_CLASS (parent_class)->finalize (object);
+}
+
+static gboolean
+gst_droidjpegdec_start (GstVideoDecoder * decoder)
+{
+  GstDroidJpegDec *dec = GST_DROIDJPEGDEC (decoder);
+
+  GST_DEBUG_OBJECT (dec, "start");
+
+  return TRUE;
+}
+
+/* Components go back to the pool so the next image size is cheap if the
+ * core keeps warm components */
+static void
+gst_droidjpegdec_release_component (GstDroidJpegDec * dec)
+{
+  gst_droidjpegdec_stop_loop (GST_VIDEO_DECODER (dec));
+
+  if (dec->comp) {
+    gst_droid_codec_stop_component (dec->comp);
+    gst_droid_codec_put_component (dec->comp);
+    dec->comp = NULL;
+  }
+}
+
+static gboolean
+gst_droidjpegdec_stop (GstVideoDecoder * decoder)
+{
+  GstDroidJpegDec *dec = GST_DROIDJPEGDEC (decoder);
+
+  GST_DEBUG_OBJECT (dec, "stop");
+
+  gst_droidjpegdec_release_component (dec);
+
+  if (dec->in_state) {
+    gst_video_codec_state_unref (dec->in_state);
+    dec->in_state = NULL;
+  }
+
+  if (dec->out_state) {
+    gst_video_codec_state_unref (dec->out_state);
+    dec->out_state = NULL;
+  }
+
+  return TRUE;
+}
+
+static gboolean
+gst_droidjpegdec_set_format (GstVideoDecoder * decoder,
+    GstVideoCodecState * state)
+{
+  const gchar *type;
+  GstDroidJpegDec *dec = GST_DROIDJPEGDEC (decoder);
+  guint downscale;
+
+  GST_DEBUG_OBJECT (dec, "set format %" GST_PTR_FORMAT, state->caps);
+
+  if (state->info.width == 0 || state->info.height == 0) {
+    GST_ERROR_OBJECT (dec, "image size is unknown. jpegparse can tell us");
+    return FALSE;
+  }
+
+  /* Every image size needs its own component configuration */
+  gst_droidjpegdec_release_component (dec);
+
+  type = gst_droid_codec_type_from_caps (state->caps,
+      GST_DROID_CODEC_DECODER_IMAGE);
+  if (!type) {
+    return FALSE;
+  }
+
+  dec->comp =
+      gst_droid_codec_get_component_full (dec->codec, type, GST_ELEMENT (dec),
+      dec->priority, dec->admission_timeout);
+  if (!dec->comp) {
+    return FALSE;
+  }
+
+  if (dec->in_state) {
+    gst_video_codec_state_unref (dec->in_state);
+  }
+
+  dec->in_state = gst_video_codec_state_ref (state);
+
+  GST_OBJECT_LOCK (dec);
+  downscale = dec->downscale;
+  GST_OBJECT_UNLOCK (dec);
+
+  if (!gst_droid_codec_configure_image_decoder (dec->comp, state->info.width,
+          state->info.height, downscale)) {
+    return FALSE;
+  }
+
+  gst_droidjpegdec_configure_state (dec);
+
+  if (!gst_droid_codec_start_component (dec->comp, dec->in_state->caps,
+          dec->out_state->caps)) {
+    return FALSE;
+  }
+
+  if (!gst_video_decoder_negotiate (decoder)) {
+    return FALSE;
+  }
+
+  return gst_droidjpegdec_start_loop (dec);
+}
+
+/* the component wants other output buffers than we gave it */
+static gboolean
+gst_droidjpegdec_reconfigure (GstDroidJpegDec * dec)
+{
+  GstVideoDecoder *decoder = GST_VIDEO_DECODER (dec);
+  GstDroidComponentPort *port = dec->comp->out_port;
+  GstStructure *config;
+
+  gst_droidjpegdec_stop_loop (decoder);
+
+  if (!gst_droid_codec_reconfigure_output_port (dec->comp)) {
+    return FALSE;
+  }
+
+  gst_droid_codec_unset_needs_reconfigure (dec->comp);
+
+  gst_droidjpegdec_configure_state (dec);
+
+  config = gst_buffer_pool_get_config (port->buffers);
+  gst_buffer_pool_config_set_params (config, dec->out_state->caps,
+      port->def.nBufferSize, port->def.nBufferCountActual,
+      port->def.nBufferCountActual);
+  gst_buffer_pool_config_set_allocator (config, port->allocator, NULL);
+
+  if (!gst_buffer_pool_set_config (port->buffers, config)) {
+    GST_ERROR_OBJECT (dec, "failed to set buffer pool configuration");
+    return FALSE;
+  }
+
+  if (!gst_video_decoder_negotiate (decoder)) {
+    return FALSE;
+  }
+
+  if (!gst_buffer_pool_set_active (port->buffers, TRUE)) {
+    GST_ERROR_OBJECT (dec, "failed to activate buffer pool");
+    return FALSE;
+  }
+
+  gst_droid_codec_set_running (dec->comp, TRUE);
+
+  return gst_droidjpegdec_start_loop (dec);
+}
+
+static gboolean
+gst_droidjpegdec_do_handle_frame (GstVideoDecoder * decoder,
+    GstVideoCodecFrame * frame)
+{
+  GstDroidJpegDec *dec = GST_DROIDJPEGDEC (decoder);
+  gboolean ret;
+
+  /* _loop () needs the stream lock to finish frames while we wait for
+   * an input buffer */
+  GST_VIDEO_DECODER_STREAM_UNLOCK (decoder);
+  ret = gst_droid_codec_consume_frame (dec->comp, frame);
+  GST_VIDEO_DECODER_STREAM_LOCK (decoder);
+
+  return ret;
+}
+
+static GstFlowReturn
+gst_droidjpegdec_handle_frame (GstVideoDecoder * decoder,
+    GstVideoCodecFrame * frame)
+{
+  GstDroidJpegDec *dec = GST_DROIDJPEGDEC (decoder);
+
+  GST_DEBUG_OBJECT (dec, "handle frame");
+
+  if (!dec->comp) {
+    GST_ERROR_OBJECT (dec, "component not initialized");
+    goto error;
+  }
+
+  if (gst_droid_codec_has_error (dec->comp)) {
+    GST_ERROR_OBJECT (dec, "not handling frame while omx is in error state");
+    goto error;
+  }
+
+  /* if we have been flushed then we need to start accepting data again */
+  if (!gst_droid_codec_is_running (dec->comp)) {
+    if (!gst_droid_codec_flush (dec->comp, FALSE)) {
+      goto error;
+    }
+
+    gst_droid_codec_empty_full (dec->comp);
+
+    if (!gst_droidjpegdec_start_loop (dec)) {
+      goto error;
+    }
+  }
+
+  if (gst_droidjpegdec_do_handle_frame (decoder, frame)) {
+    return GST_FLOW_OK;
+  }
+
+  if (!gst_droid_codec_is_running (dec->comp)) {
+    /* don't leak the frame */
+    gst_video_decoder_release_frame (decoder, frame);
+    return GST_FLOW_FLUSHING;
+  }
+
+  if (!gst_droid_codec_needs_reconfigure (dec->comp)) {
+    GST_ERROR_OBJECT (dec, "failed to hand image to the component");
+    goto error;
+  }
+
+  if (!gst_droidjpegdec_reconfigure (dec)) {
+    goto error;
+  }
+
+  if (gst_droidjpegdec_do_handle_frame (decoder, frame)) {
+    return GST_FLOW_OK;
+  }
+
+error:
+  /* don't leak the frame */
+  gst_video_decoder_release_frame (decoder, frame);
+
+  return GST_FLOW_ERROR;
+}
+
+static GstFlowReturn
+gst_droidjpegdec_finish (GstVideoDecoder * decoder)
+{
+  GstDroidJpegDec *dec = GST_DROIDJPEGDEC (decoder);
+
+  GST_DEBUG_OBJECT (dec, "finish");
+
+  gst_droidjpegdec_stop_loop (decoder);
+
+  return GST_FLOW_OK;
+}
+
+static gboolean
+gst_droidjpegdec_decide_allocation (GstVideoDecoder * decoder,
+    GstQuery * query)
+{
+  gsize size;
+  GstStructure *conf;
+  GstDroidJpegDec *dec = GST_DROIDJPEGDEC (decoder);
+
+  GST_DEBUG_OBJECT (dec, "decide allocation %" GST_PTR_FORMAT, query);
+
+  conf = gst_buffer_pool_get_config (dec->comp->out_port->buffers);
+
+  if (!gst_buffer_pool_config_get_params (conf, NULL, &size, NULL, NULL)) {
+    GST_ERROR_OBJECT (dec, "failed to get buffer pool configuration");
+    gst_structure_free (conf);
+    return FALSE;
+  }
+
+  gst_structure_free (conf);
+
+  if (gst_query_get_n_allocation_pools (query) > 0) {
+    gst_query_set_nth_allocation_pool (query, 0, dec->comp->out_port->buffers,
+        size, size, size);
+  } else {
+    gst_query_add_allocation_pool (query, dec->comp->out_port->buffers, size,
+        size, size);
+  }
+
+  return TRUE;
+}
+
+static gboolean
+gst_droidjpegdec_flush (GstVideoDecoder * decoder)
+{
+  GstDroidJpegDec *dec = GST_DROIDJPEGDEC (decoder);
+
+  GST_DEBUG_OBJECT (dec, "flush");
+
+  if (!dec->comp) {
+    GST_DEBUG_OBJECT (dec, "no component to flush");
+    return TRUE;
+  }
+
+  gst_droidjpegdec_stop_loop (decoder);
+
+  if (!gst_droid_codec_flush (dec->comp, TRUE)) {
+    return FALSE;
+  }
+
+  GST_DEBUG_OBJECT (dec, "Flushed");
+
+  return TRUE;
+}
+
+static gboolean
+gst_droidjpegdec_negotiate (GstVideoDecoder * decoder)
+{
+  GstDroidJpegDec *dec = GST_DROIDJPEGDEC (decoder);
+  GstPad *pad = GST_VIDEO_DECODER_SRC_PAD (decoder);
+  GstCaps *caps = NULL;
+  gboolean ret = FALSE;
+
+  GST_DEBUG_OBJECT (dec, "negotiate with caps %" GST_PTR_FORMAT,
+      dec->out_state->caps);
+
+  if (!GST_VIDEO_DECODER_CLASS (parent_class)->negotiate (decoder)) {
+    return FALSE;
+  }
+
+  /* As in droiddec we either use our caps or fail */
+  caps = gst_pad_peer_query_caps (pad, dec->out_state->caps);
+
+  GST_DEBUG_OBJECT (dec, "intersection %" GST_PTR_FORMAT, caps);
+
+  if (gst_caps_is_empty (caps)) {
+    goto error;
+  }
+
+  if (!gst_caps_is_equal (caps, dec->out_state->caps)) {
+    goto error;
+  }
+
+  if (!gst_pad_set_caps (pad, caps)) {
+    goto error;
+  }
+
+  ret = TRUE;
+  goto out;
+
+error:
+  GST_ELEMENT_ERROR (dec, STREAM, FORMAT, (NULL),
+      ("failed to negotiate output format"));
+
+out:
+  if (caps) {
+    gst_caps_unref (caps);
+  }
+
+  return ret;
+}
+
+static void
+gst_droidjpegdec_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstDroidJpegDec *dec = GST_DROIDJPEGDEC (object);
+
+  switch (prop_id) {
+    case PROP_PRIORITY:
+      dec->priority = g_value_get_int (value);
+      break;
+    case PROP_ADMISSION_TIMEOUT:
+      dec->admission_timeout = g_value_get_int (value);
+      break;
+    case PROP_DOWNSCALE:
+      GST_OBJECT_LOCK (dec);
+      dec->downscale = g_value_get_uint (value);
+      GST_OBJECT_UNLOCK (dec);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_droidjpegdec_get_property (GObject * object, guint prop_id,
+    GValue * value, GParamSpec * pspec)
+{
+  GstDroidJpegDec *dec = GST_DROIDJPEGDEC (object);
+
+  switch (prop_id) {
+    case PROP_PRIORITY:
+      g_value_set_int (value, dec->priority);
+      break;
+    case PROP_ADMISSION_TIMEOUT:
+      g_value_set_int (value, dec->admission_timeout);
+      break;
+    case PROP_DOWNSCALE:
+      GST_OBJECT_LOCK (dec);
+      g_value_set_uint (value, dec->downscale);
+      GST_OBJECT_UNLOCK (dec);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_droidjpegdec_init (GstDroidJpegDec * dec)
+{
+  dec->codec = gst_droid_codec_get ();
+  dec->comp = NULL;
+  dec->in_state = NULL;
+  dec->out_state = NULL;
+  dec->priority = GST_DROID_CODEC_PRIORITY_DEFAULT;
+  dec->admission_timeout = GST_DROID_CODEC_ADMISSION_TIMEOUT_DEFAULT;
+  dec->downscale = DEFAULT_DOWNSCALE;
+
+  /* every buffer is a complete image */
+  gst_video_decoder_set_packetized (GST_VIDEO_DECODER (dec), TRUE);
+}
+
+static GstStateChangeReturn
+gst_droidjpegdec_change_state (GstElement * element,
+    GstStateChange transition)
+{
+  GstVideoDecoder *decoder = GST_VIDEO_DECODER (element);
+
+  GST_DEBUG_OBJECT (element, "change state");
+
+  if (transition == GST_STATE_CHANGE_PAUSED_TO_READY) {
+    GST_VIDEO_DECODER_STREAM_LOCK (decoder);
+    gst_droidjpegdec_stop_loop (decoder);
+    GST_VIDEO_DECODER_STREAM_UNLOCK (decoder);
+  }
+
+  return GST_ELEMENT_CLASS (parent_class)->change_state (element, transition);
+}
+
+static void
+gst_droidjpegdec_class_init (GstDroidJpegDecClass * klass)
+{
+  GObjectClass *gobject_class;
+  GstElementClass *gstelement_class;
+  GstVideoDecoderClass *gstvideodecoder_class;
+  GstCaps *caps;
+  GstPadTemplate *tpl;
+
+  gobject_class = (GObjectClass *) klass;
+  gstelement_class = (GstElementClass *) klass;
+  gstvideodecoder_class = (GstVideoDecoderClass *) klass;
+
+  gst_element_class_set_static_metadata (gstelement_class,
+      "JPEG decoder", "Codec/Decoder/Image/Device",
+      "Android HAL JPEG decoder", "Mohammed Sameer <msameer@foolab.org>");
+
+  caps = gst_droid_codec_type_all_caps (GST_DROID_CODEC_DECODER_IMAGE);
+  tpl = gst_pad_template_new (GST_VIDEO_DECODER_SINK_NAME,
+      GST_PAD_SINK, GST_PAD_ALWAYS, caps);
+  gst_element_class_add_pad_template (gstelement_class, tpl);
+
+  gst_element_class_add_pad_template (gstelement_class,
+      gst_static_pad_template_get (&gst_droidjpegdec_src_template_factory));
+
+  gobject_class->finalize = gst_droidjpegdec_finalize;
+  gobject_class->set_property = gst_droidjpegdec_set_property;
+  gobject_class->get_property = gst_droidjpegdec_get_property;
+  gstelement_class->change_state =
+      GST_DEBUG_FUNCPTR (gst_droidjpegdec_change_state);
+  gstvideodecoder_class->start = GST_DEBUG_FUNCPTR (gst_droidjpegdec_start);
+  gstvideodecoder_class->stop = GST_DEBUG_FUNCPTR (gst_droidjpegdec_stop);
+  gstvideodecoder_class->set_format =
+      GST_DEBUG_FUNCPTR (gst_droidjpegdec_set_format);
+  gstvideodecoder_class->finish = GST_DEBUG_FUNCPTR (gst_droidjpegdec_finish);
+  gstvideodecoder_class->handle_frame =
+      GST_DEBUG_FUNCPTR (gst_droidjpegdec_handle_frame);
+  gstvideodecoder_class->decide_allocation =
+      GST_DEBUG_FUNCPTR (gst_droidjpegdec_decide_allocation);
+  gstvideodecoder_class->flush = GST_DEBUG_FUNCPTR (gst_droidjpegdec_flush);
+  gstvideodecoder_class->negotiate =
+      GST_DEBUG_FUNCPTR (gst_droidjpegdec_negotiate);
+
+  g_object_class_install_property (gobject_class, PROP_PRIORITY,
+      g_param_spec_int ("priority", "Priority",
+          "Priority when waiting for a hardware codec instance. "
+          "Higher values are served first", G_MININT, G_MAXINT,
+          GST_DROID_CODEC_PRIORITY_DEFAULT,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_ADMISSION_TIMEOUT,
+      g_param_spec_int ("admission-timeout", "Admission timeout",
+          "Milliseconds to wait for a hardware codec instance when all are "
+          "in use (-1=forever, 0=fail immediately)", -1, G_MAXINT,
+          GST_DROID_CODEC_ADMISSION_TIMEOUT_DEFAULT,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_DOWNSCALE,
+      g_param_spec_uint ("downscale", "Downscale",
+          "Divide the width and height by this while decoding. "
+          "Components usually support 1, 2, 4 and 8", 1, 8,
+          DEFAULT_DOWNSCALE, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+}
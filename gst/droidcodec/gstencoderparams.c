@@ -24,6 +24,7 @@
 #endif
 
 #include "gstencoderparams.h"
+#include <gst/gst.h>
 
 typedef struct
 {
@@ -91,11 +92,18 @@ Entry AvcLevels[] = {
   {"5.1", OMX_VIDEO_AVCLevel51},
 };
 
-int
-find_in_array (Entry entries[], const gchar * str)
+/* The VP8 caps profile is the bitstream version. OMX calls it level */
+Entry Vp8Levels[] = {
+  {"0", OMX_VIDEO_VP8Level_Version0},
+  {"1", OMX_VIDEO_VP8Level_Version1},
+  {"2", OMX_VIDEO_VP8Level_Version2},
+  {"3", OMX_VIDEO_VP8Level_Version3},
+};
+
+static int
+find_in_array (Entry entries[], int len, const gchar * str)
 {
   int x;
-  int len = sizeof (entries) / sizeof (entries[0]);
 
   if (!str) {
     return -1;
@@ -110,26 +118,92 @@ find_in_array (Entry entries[], const gchar * str)
   return -1;
 }
 
+static const gchar *
+find_value_in_array (Entry entries[], int len, int omx)
+{
+  int x;
+
+  for (x = 0; x < len; x++) {
+    if (entries[x].omx == omx) {
+      return entries[x].str;
+    }
+  }
+
+  return NULL;
+}
+
+/* levels are bit flags so anything lower than max is supported too */
+static void
+levels_to_list (Entry entries[], int len, int max, GValue * list)
+{
+  int x;
+
+  for (x = 0; x < len; x++) {
+    GValue val = G_VALUE_INIT;
+
+    if (entries[x].omx > max) {
+      continue;
+    }
+
+    g_value_init (&val, G_TYPE_STRING);
+    g_value_set_string (&val, entries[x].str);
+    gst_value_list_append_value (list, &val);
+    g_value_unset (&val);
+  }
+}
+
 OMX_VIDEO_MPEG4PROFILETYPE
 gst_encoder_params_get_mpeg4_profile (const gchar * profile)
 {
-  return find_in_array (Mpeg4Profiles, profile);
+  return find_in_array (Mpeg4Profiles, G_N_ELEMENTS (Mpeg4Profiles), profile);
 }
 
 OMX_VIDEO_MPEG4LEVELTYPE
 gst_encoder_params_get_mpeg4_level (const gchar * level)
 {
-  return find_in_array (Mpeg4Levels, level);
+  return find_in_array (Mpeg4Levels, G_N_ELEMENTS (Mpeg4Levels), level);
 }
 
 OMX_VIDEO_AVCPROFILETYPE
 gst_encoder_params_get_avc_profile (const gchar * profile)
 {
-  return find_in_array (AvcProfiles, profile);
+  return find_in_array (AvcProfiles, G_N_ELEMENTS (AvcProfiles), profile);
 }
 
 OMX_VIDEO_AVCLEVELTYPE
 gst_encoder_params_get_avc_level (const gchar * level)
 {
-  return find_in_array (AvcLevels, level);
+  return find_in_array (AvcLevels, G_N_ELEMENTS (AvcLevels), level);
+}
+
+OMX_VIDEO_VP8LEVELTYPE
+gst_encoder_params_get_vp8_level (const gchar * profile)
+{
+  return find_in_array (Vp8Levels, G_N_ELEMENTS (Vp8Levels), profile);
+}
+
+const gchar *
+gst_encoder_params_mpeg4_profile_to_string (int profile)
+{
+  return find_value_in_array (Mpeg4Profiles, G_N_ELEMENTS (Mpeg4Profiles),
+      profile);
+}
+
+void
+gst_encoder_params_mpeg4_levels_to_list (int max, GValue * list)
+{
+  levels_to_list (Mpeg4Levels, G_N_ELEMENTS (Mpeg4Levels), max, list);
+}
+
+const gchar *
+gst_encoder_params_avc_profile_to_string (int profile)
+{
+  return find_value_in_array (AvcProfiles, G_N_ELEMENTS (AvcProfiles),
+      profile);
+}
+
+void
+gst_encoder_params_avc_levels_to_list (int max, GValue * list)
+{
+  levels_to_list (AvcLevels, G_N_ELEMENTS (AvcLevels), max, list);
 }
@@ -23,11 +23,19 @@
 #define __ENCODER_PARAMS_H__
 
 #include <glib.h>
+#include <glib-object.h>
 #include "OMX_Video.h"
+#include "OMX_VideoExt.h"
 
 OMX_VIDEO_MPEG4PROFILETYPE gst_encoder_params_get_mpeg4_profile (const gchar * profile);
 OMX_VIDEO_MPEG4LEVELTYPE gst_encoder_params_get_mpeg4_level (const gchar * level);
 OMX_VIDEO_AVCPROFILETYPE gst_encoder_params_get_avc_profile (const gchar * profile);
 OMX_VIDEO_AVCLEVELTYPE gst_encoder_params_get_avc_level (const gchar * level);
+OMX_VIDEO_VP8LEVELTYPE gst_encoder_params_get_vp8_level (const gchar * profile);
+
+const gchar *gst_encoder_params_mpeg4_profile_to_string (int profile);
+void gst_encoder_params_mpeg4_levels_to_list (int max, GValue * list);
+const gchar *gst_encoder_params_avc_profile_to_string (int profile);
+void gst_encoder_params_avc_levels_to_list (int max, GValue * list);
 
 #endif /* __ENCODER_PARAMS_H__ */
@@ -28,11 +28,18 @@
 #include "gstdroidcamsrc.h"
 #include "gstdroideglsink.h"
 #include "gstdroiddec.h"
+#include "gstdroidadec.h"
+#include "gstdroidjpegdec.h"
 #include "gstdroidenc.h"
+#include "gstdroidaenc.h"
+#include "gstdroidcodecregistry.h"
 
 GST_DEBUG_CATEGORY (gst_droid_camsrc_debug);
 GST_DEBUG_CATEGORY (gst_droid_dec_debug);
+GST_DEBUG_CATEGORY (gst_droid_adec_debug);
+GST_DEBUG_CATEGORY (gst_droid_jpegdec_debug);
 GST_DEBUG_CATEGORY (gst_droid_enc_debug);
+GST_DEBUG_CATEGORY (gst_droid_aenc_debug);
 GST_DEBUG_CATEGORY (gst_droid_codec_debug);
 GST_DEBUG_CATEGORY (gst_droid_eglsink_debug);
 
@@ -50,12 +57,24 @@ plugin_init (GstPlugin * plugin)
   GST_DEBUG_CATEGORY_INIT (gst_droid_dec_debug, "droiddec",
       0, "Android HAL decoder");
 
+  GST_DEBUG_CATEGORY_INIT (gst_droid_adec_debug, "droidadec",
+      0, "Android HAL audio decoder");
+
+  GST_DEBUG_CATEGORY_INIT (gst_droid_jpegdec_debug, "droidjpegdec",
+      0, "Android HAL JPEG decoder");
+
   GST_DEBUG_CATEGORY_INIT (gst_droid_enc_debug, "droidenc",
       0, "Android HAL encoder");
 
+  GST_DEBUG_CATEGORY_INIT (gst_droid_aenc_debug, "droidaenc",
+      0, "Android HAL audio encoder");
+
   GST_DEBUG_CATEGORY_INIT (gst_droid_codec_debug, "droidcodec",
       0, "Android HAL codec");
 
+  /* before the codec elements register their pad templates */
+  gst_droid_codec_registry_init ();
+
   ok &= gst_element_register (plugin, "droidcamsrc", GST_RANK_PRIMARY,
       GST_TYPE_DROIDCAMSRC);
   ok &= gst_element_register (plugin, "droideglsink", GST_RANK_PRIMARY,
@@ -63,8 +82,14 @@ plugin_init (GstPlugin * plugin)
 
   ok &= gst_element_register (plugin, "droiddec", GST_RANK_PRIMARY + 1,
       GST_TYPE_DROIDDEC);
+  ok &= gst_element_register (plugin, "droidadec", GST_RANK_PRIMARY + 1,
+      GST_TYPE_DROIDADEC);
+  ok &= gst_element_register (plugin, "droidjpegdec", GST_RANK_PRIMARY + 1,
+      GST_TYPE_DROIDJPEGDEC);
   ok &= gst_element_register (plugin, "droidenc", GST_RANK_PRIMARY + 1,
       GST_TYPE_DROIDENC);
+  ok &= gst_element_register (plugin, "droidaenc", GST_RANK_PRIMARY + 1,
+      GST_TYPE_DROIDAENC);
 
   return ok;
 }
@@ -28,7 +28,10 @@ G_BEGIN_DECLS
 
 GST_DEBUG_CATEGORY_EXTERN (gst_droid_camsrc_debug);
 GST_DEBUG_CATEGORY_EXTERN (gst_droid_dec_debug);
+GST_DEBUG_CATEGORY_EXTERN (gst_droid_adec_debug);
+GST_DEBUG_CATEGORY_EXTERN (gst_droid_jpegdec_debug);
 GST_DEBUG_CATEGORY_EXTERN (gst_droid_enc_debug);
+GST_DEBUG_CATEGORY_EXTERN (gst_droid_aenc_debug);
 GST_DEBUG_CATEGORY_EXTERN (gst_droid_codec_debug);
 GST_DEBUG_CATEGORY_EXTERN (gst_droid_eglsink_debug);
 
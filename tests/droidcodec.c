@@ -0,0 +1,455 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+#include <gst/gst.h>
+#include <gst/check/gstcheck.h>
+#include "gstgralloc.h"
+
+/* droiddec and droidenc on top of the mock OMX core (mockomx.c) using the
+ * configurations in droidcodec.d */
+
+#define WIDTH 320
+#define HEIGHT 240
+#define FRAMES 300
+#define FRAME_DURATION (GST_SECOND / 30)
+/* us */
+#define OUTPUT_TIMEOUT (20 * G_USEC_PER_SEC)
+
+#define DECODER_PIPELINE \
+  "appsrc name=src format=time caps=\"video/x-h264, " \
+  "stream-format=byte-stream, alignment=au, width=320, height=240, " \
+  "framerate=30/1\" ! droiddec name=codec ! " \
+  "fakesink name=sink signal-handoffs=true sync=false"
+
+#define ENCODER_PIPELINE \
+  "appsrc name=src format=time caps=\"video/x-raw(memory:DroidVideoMetaData), " \
+  "format=YV12, width=320, height=240, framerate=30/1\" ! " \
+  "droidenc name=codec ! video/x-h264, stream-format=byte-stream, " \
+  "alignment=au ! fakesink name=sink signal-handoffs=true sync=false"
+
+/* an IDR slice header is all droiddec looks at */
+static const guint8 h264_frame[] = {
+  0x00, 0x00, 0x00, 0x01, 0x65, 0x88, 0x84, 0x00, 0x33, 0xff
+};
+
+/* what the camera stores in meta data buffers */
+static const guint8 meta_data_frame[8] = { 0 };
+
+/* mock core settings, see mockomx.c */
+typedef struct
+{
+  const gchar *name;
+  /* us */
+  guint latency;
+  guint buffers;
+  guint port_change;
+  guint drop;
+} BenchConfig;
+
+typedef struct
+{
+  GMutex lock;
+  GCond cond;
+  guint frames;
+  /* input buffers finalized. A frame that is never released keeps its
+   * input buffer */
+  guint released;
+  /* monotonic time in us */
+  gint64 pushed[FRAMES];
+  gint64 first_pushed;
+  gint64 last_output;
+  gint64 latency_total;
+  gint64 latency_max;
+} Bench;
+
+static void
+bench_handoff (GstElement * sink, GstBuffer * buffer, GstPad * pad,
+    Bench * bench)
+{
+  gint64 now = g_get_monotonic_time ();
+  gint64 latency;
+  guint x;
+
+  /* stream headers are not frames */
+  if (GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_HEADER)
+      || !GST_BUFFER_PTS_IS_VALID (buffer)) {
+    return;
+  }
+
+  x = GST_BUFFER_PTS (buffer) / FRAME_DURATION;
+  fail_unless (x < FRAMES);
+
+  g_mutex_lock (&bench->lock);
+
+  latency = now - bench->pushed[x];
+  bench->latency_total += latency;
+  bench->latency_max = MAX (bench->latency_max, latency);
+  bench->last_output = now;
+  bench->frames++;
+
+  g_cond_signal (&bench->cond);
+  g_mutex_unlock (&bench->lock);
+}
+
+static void
+bench_input_released (Bench * bench, GstMiniObject * obj)
+{
+  g_mutex_lock (&bench->lock);
+  bench->released++;
+  g_cond_signal (&bench->cond);
+  g_mutex_unlock (&bench->lock);
+}
+
+/* the frames the mock does not drop, see mockomx.c */
+static guint
+bench_expected_frames (const BenchConfig * config)
+{
+  guint frames = 0;
+  guint x;
+
+  for (x = 0; x < FRAMES; x++) {
+    if (config->drop == 0 || x % config->drop != 1) {
+      frames++;
+    }
+  }
+
+  return frames;
+}
+
+static void
+bench_set_env (const BenchConfig * config)
+{
+  gchar *value;
+
+  value = g_strdup_printf ("%u", config->latency);
+  g_setenv ("DROID_MOCK_OMX_LATENCY", value, TRUE);
+  g_free (value);
+
+  value = g_strdup_printf ("%u", config->buffers);
+  g_setenv ("DROID_MOCK_OMX_BUFFERS", value, TRUE);
+  g_free (value);
+
+  value = g_strdup_printf ("%u", config->port_change);
+  g_setenv ("DROID_MOCK_OMX_PORT_CHANGE", value, TRUE);
+  g_free (value);
+
+  value = g_strdup_printf ("%u", config->drop);
+  g_setenv ("DROID_MOCK_OMX_DROP", value, TRUE);
+  g_free (value);
+}
+
+static void
+bench_print (const gchar * element, const BenchConfig * config, Bench * bench,
+    const GstStructure * stats)
+{
+  const GValue *histogram;
+  GString *buckets = g_string_new (NULL);
+  gint64 elapsed = bench->last_output - bench->first_pushed;
+  guint x;
+
+  histogram = gst_structure_get_value (stats, "latency-histogram");
+  for (x = 0; histogram && x < gst_value_array_get_size (histogram); x++) {
+    g_string_append_printf (buckets, " %" G_GUINT64_FORMAT,
+        g_value_get_uint64 (gst_value_array_get_value (histogram, x)));
+  }
+
+  g_print ("%-8s %-14s %3u frames in %8" G_GINT64_FORMAT " us: %8.1f fps, "
+      "latency avg %6" G_GINT64_FORMAT " us max %6" G_GINT64_FORMAT " us, "
+      "histogram%s\n", element, config->name, bench->frames, elapsed,
+      elapsed > 0 ? bench->frames * (gdouble) G_USEC_PER_SEC / elapsed : 0,
+      bench->frames ? bench->latency_total / bench->frames : 0,
+      bench->latency_max, buckets->str);
+
+  g_string_free (buckets, TRUE);
+}
+
+/* Pushes FRAMES frames of data through the codec element in pipeline and
+ * waits for all of them, less those the mock drops, to come out and for all
+ * the input buffers to be released. Returns the element statistics */
+static GstStructure *
+bench_run (const gchar * element, const gchar * pipeline_desc,
+    const BenchConfig * config, const guint8 * data, gsize size)
+{
+  GstElement *pipeline, *src, *codec, *sink;
+  GstStructure *stats = NULL;
+  GstMessage *msg;
+  GstFlowReturn ret;
+  GError *error = NULL;
+  Bench bench;
+  gint64 end_time;
+  guint expected = bench_expected_frames (config);
+  guint pushed = 0;
+  guint released;
+  guint x;
+
+  memset (&bench, 0, sizeof (bench));
+  g_mutex_init (&bench.lock);
+  g_cond_init (&bench.cond);
+
+  bench_set_env (config);
+
+  pipeline = gst_parse_launch (pipeline_desc, &error);
+  fail_unless (pipeline != NULL, "failed to create pipeline: %s",
+      error ? error->message : "unknown error");
+
+  src = gst_bin_get_by_name (GST_BIN (pipeline), "src");
+  codec = gst_bin_get_by_name (GST_BIN (pipeline), "codec");
+  sink = gst_bin_get_by_name (GST_BIN (pipeline), "sink");
+
+  /* block once a frame is waiting so we measure the codec, not appsrc */
+  g_object_set (src, "block", TRUE, "max-bytes", (guint64) 1, NULL);
+  g_signal_connect (sink, "handoff", G_CALLBACK (bench_handoff), &bench);
+
+  fail_unless (gst_element_set_state (pipeline,
+          GST_STATE_PLAYING) != GST_STATE_CHANGE_FAILURE);
+
+  for (x = 0; x < FRAMES; x++) {
+    GstBuffer *buffer = gst_buffer_new_allocate (NULL, size, NULL);
+
+    gst_buffer_fill (buffer, 0, data, size);
+    GST_BUFFER_PTS (buffer) = x * FRAME_DURATION;
+    GST_BUFFER_DURATION (buffer) = FRAME_DURATION;
+    gst_mini_object_weak_ref (GST_MINI_OBJECT_CAST (buffer),
+        (GstMiniObjectNotify) bench_input_released, &bench);
+
+    g_mutex_lock (&bench.lock);
+    bench.pushed[x] = g_get_monotonic_time ();
+    if (x == 0) {
+      bench.first_pushed = bench.pushed[x];
+    }
+    g_mutex_unlock (&bench.lock);
+
+    g_signal_emit_by_name (src, "push-buffer", buffer, &ret);
+    gst_buffer_unref (buffer);
+
+    if (ret != GST_FLOW_OK) {
+      break;
+    }
+
+    pushed++;
+  }
+
+  end_time = g_get_monotonic_time () + OUTPUT_TIMEOUT;
+
+  g_mutex_lock (&bench.lock);
+  while (bench.frames < expected || bench.released < pushed) {
+    if (!g_cond_wait_until (&bench.cond, &bench.lock, end_time)) {
+      break;
+    }
+  }
+  /* stopping the element frees whatever frames it still has */
+  released = bench.released;
+  g_mutex_unlock (&bench.lock);
+
+  msg = gst_bus_pop_filtered (GST_ELEMENT_BUS (pipeline), GST_MESSAGE_ERROR);
+  if (msg) {
+    gst_message_parse_error (msg, &error, NULL);
+    fail ("%s: %s", element, error->message);
+  }
+
+  g_object_get (codec, "stats", &stats, NULL);
+  fail_unless (stats != NULL);
+
+  g_signal_emit_by_name (src, "end-of-stream", &ret);
+
+  fail_unless (gst_element_set_state (pipeline,
+          GST_STATE_NULL) == GST_STATE_CHANGE_SUCCESS);
+
+  bench_print (element, config, &bench, stats);
+
+  fail_unless_equals_int (bench.frames, expected);
+  fail_unless_equals_int (released, pushed);
+
+  gst_object_unref (src);
+  gst_object_unref (codec);
+  gst_object_unref (sink);
+  gst_object_unref (pipeline);
+
+  g_mutex_clear (&bench.lock);
+  g_cond_clear (&bench.cond);
+
+  return stats;
+}
+
+static guint64
+bench_get_stat (const GstStructure * stats, const gchar * field)
+{
+  guint64 value = 0;
+
+  fail_unless (gst_structure_get_uint64 (stats, field, &value),
+      "no %s in %" GST_PTR_FORMAT, field, stats);
+
+  return value;
+}
+
+/* decoders output to gralloc memory which needs the android gralloc HAL */
+static gboolean
+have_gralloc (void)
+{
+  GstAllocator *allocator = gst_gralloc_allocator_new ();
+  GstMemory *mem;
+
+  if (!allocator) {
+    return FALSE;
+  }
+
+  mem = gst_gralloc_allocator_alloc (allocator, 64, 64, 0x32315659,
+      GST_GRALLOC_USAGE_SW_READ_MASK | GST_GRALLOC_USAGE_SW_WRITE_MASK);
+  if (mem) {
+    gst_memory_unref (mem);
+  }
+
+  gst_object_unref (allocator);
+
+  return mem != NULL;
+}
+
+static const BenchConfig throughput_configs[] = {
+  {"burst", 0, 4, 0, 0},
+  {"burst-2bufs", 0, 2, 0, 0},
+  {"burst-8bufs", 0, 8, 0, 0},
+  {"2ms", 2000, 4, 0, 0},
+  {"10ms", 10000, 4, 0, 0},
+};
+
+GST_START_TEST (test_encoder_throughput)
+{
+  guint x;
+
+  for (x = 0; x < G_N_ELEMENTS (throughput_configs); x++) {
+    GstStructure *stats = bench_run ("droidenc", ENCODER_PIPELINE,
+        &throughput_configs[x], meta_data_frame, sizeof (meta_data_frame));
+
+    fail_unless_equals_uint64 (bench_get_stat (stats, "frames-submitted"),
+        FRAMES);
+    fail_unless_equals_uint64 (bench_get_stat (stats, "frames-finished"),
+        FRAMES);
+    fail_unless_equals_uint64 (bench_get_stat (stats, "errors"), 0);
+
+    gst_structure_free (stats);
+  }
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_decoder_throughput)
+{
+  guint x;
+
+  if (!have_gralloc ()) {
+    g_print ("no gralloc, skipping %s\n", __FUNCTION__);
+    return;
+  }
+
+  for (x = 0; x < G_N_ELEMENTS (throughput_configs); x++) {
+    GstStructure *stats = bench_run ("droiddec", DECODER_PIPELINE,
+        &throughput_configs[x], h264_frame, sizeof (h264_frame));
+
+    fail_unless_equals_uint64 (bench_get_stat (stats, "frames-decoded"),
+        FRAMES);
+    fail_unless_equals_uint64 (bench_get_stat (stats, "frames-finished"),
+        FRAMES);
+    fail_unless_equals_uint64 (bench_get_stat (stats, "errors"), 0);
+
+    gst_structure_free (stats);
+  }
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_decoder_port_settings_changed)
+{
+  BenchConfig config = { "port-change", 0, 4, FRAMES / 4, 0 };
+  GstStructure *stats;
+
+  if (!have_gralloc ()) {
+    g_print ("no gralloc, skipping %s\n", __FUNCTION__);
+    return;
+  }
+
+  stats = bench_run ("droiddec", DECODER_PIPELINE, &config, h264_frame,
+      sizeof (h264_frame));
+
+  /* the last one comes after the last frame */
+  fail_unless (bench_get_stat (stats, "reconfigurations") >= 3);
+  fail_unless_equals_uint64 (bench_get_stat (stats, "frames-finished"),
+      FRAMES);
+
+  gst_structure_free (stats);
+}
+
+GST_END_TEST;
+
+/* frames the component drops never come back. They must still be released
+ * or they keep their input buffers forever */
+static const BenchConfig drop_config = { "drop", 0, 4, 0, 10 };
+
+GST_START_TEST (test_encoder_skipped_frames)
+{
+  GstStructure *stats = bench_run ("droidenc", ENCODER_PIPELINE, &drop_config,
+      meta_data_frame, sizeof (meta_data_frame));
+
+  fail_unless_equals_uint64 (bench_get_stat (stats, "frames-submitted"),
+      FRAMES);
+  fail_unless_equals_uint64 (bench_get_stat (stats, "frames-finished"),
+      bench_expected_frames (&drop_config));
+
+  gst_structure_free (stats);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_decoder_dropped_frames)
+{
+  GstStructure *stats;
+
+  if (!have_gralloc ()) {
+    g_print ("no gralloc, skipping %s\n", __FUNCTION__);
+    return;
+  }
+
+  stats = bench_run ("droiddec", DECODER_PIPELINE, &drop_config, h264_frame,
+      sizeof (h264_frame));
+
+  fail_unless_equals_uint64 (bench_get_stat (stats, "frames-finished"),
+      bench_expected_frames (&drop_config));
+
+  gst_structure_free (stats);
+}
+
+GST_END_TEST;
+
+static Suite *
+droidcodec_suite (void)
+{
+  Suite *s = suite_create ("droid codec");
+  TCase *tc_chain = tcase_create ("general");
+
+  suite_add_tcase (s, tc_chain);
+
+  tcase_set_timeout (tc_chain, 120);
+  tcase_add_test (tc_chain, test_encoder_throughput);
+  tcase_add_test (tc_chain, test_decoder_throughput);
+  tcase_add_test (tc_chain, test_decoder_port_settings_changed);
+  tcase_add_test (tc_chain, test_encoder_skipped_frames);
+  tcase_add_test (tc_chain, test_decoder_dropped_frames);
+
+  return s;
+}
+
+int
+main (int argc, char **argv)
+{
+  /* before gstreamer scans for plugins and droidcodec reads its
+   * configuration. The probe results of the mock should not end up in the
+   * cache of the real components */
+  g_setenv ("GST_PLUGIN_PATH", PLUGIN_DIR, TRUE);
+  g_setenv ("GST_DROID_CODEC_CONFIG_DIR", CONFIG_DIR, TRUE);
+  g_setenv ("XDG_CACHE_HOME", CACHE_DIR, TRUE);
+
+  gst_check_init (&argc, &argv);
+
+  return gst_check_run_suite (droidcodec_suite (), "droidcodec", __FILE__);
+}
@@ -0,0 +1,1039 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+/* A software stand in for a vendor OpenMAX IL core so droiddec and droidenc
+ * can be exercised without the hardware. A configuration with host-core=true
+ * makes droidcodec load it with dlopen ().
+ *
+ * The components are passthrough "codecs": every complete input frame is
+ * copied to an output buffer, keeping timestamp and sync flag. Output going
+ * to android native buffers is not written at all. Names are
+ * OMX.gstdroid.mock.decoder and OMX.gstdroid.mock.encoder.
+ *
+ * Components read these when they are created:
+ * DROID_MOCK_OMX_LATENCY: us spent on every frame. Frames are processed one
+ *   at a time so this limits the frame rate as well.
+ * DROID_MOCK_OMX_BUFFERS: buffer count of both ports.
+ * DROID_MOCK_OMX_PORT_CHANGE: announce changed output port settings after
+ *   every that many frames and hold back the input until the output port has
+ *   been disabled and enabled again. 0 to never do it.
+ * DROID_MOCK_OMX_DROP: consume every that many frames, starting with the
+ *   second one, without producing any output like a decoder skipping a
+ *   corrupt frame or an encoder rate control would. 0 to never do it.
+ *
+ * Commands complete before OMX_SendCommand () returns. */
+
+#include <glib.h>
+#include <string.h>
+#include <OMX_Core.h>
+#include <OMX_Component.h>
+#include <OMX_Video.h>
+#include "HardwareAPI.h"
+
+#define MOCK_NAME_PREFIX "OMX.gstdroid.mock."
+#define MOCK_DECODER_NAME MOCK_NAME_PREFIX "decoder"
+#define MOCK_ENCODER_NAME MOCK_NAME_PREFIX "encoder"
+
+#define MOCK_IN_PORT 0
+#define MOCK_OUT_PORT 1
+
+#define MOCK_DEFAULT_BUFFERS 4
+#define MOCK_DEFAULT_WIDTH 176
+#define MOCK_DEFAULT_HEIGHT 144
+#define MOCK_MIN_INPUT_SIZE 4096
+/* HAL_PIXEL_FORMAT_YV12 */
+#define MOCK_HAL_YV12 0x32315659
+/* all the encoder needs when the camera stores meta data in buffers */
+#define MOCK_META_DATA_SIZE 8
+
+enum
+{
+  MOCK_INDEX_ENABLE_NATIVE_BUFFERS = OMX_IndexVendorStartUnused + 0x1000,
+  MOCK_INDEX_NATIVE_BUFFER_USAGE,
+  MOCK_INDEX_STORE_META_DATA,
+};
+
+static const struct
+{
+  const gchar *name;
+  OMX_INDEXTYPE index;
+} extensions[] = {
+  {"OMX.google.android.index.enableAndroidNativeBuffers2",
+      MOCK_INDEX_ENABLE_NATIVE_BUFFERS},
+  {"OMX.google.android.index.getAndroidNativeBufferUsage",
+      MOCK_INDEX_NATIVE_BUFFER_USAGE},
+  {"OMX.google.android.index.storeMetaDataInBuffers",
+      MOCK_INDEX_STORE_META_DATA},
+};
+
+static const OMX_VIDEO_AVCPROFILETYPE profiles[] = {
+  OMX_VIDEO_AVCProfileBaseline,
+  OMX_VIDEO_AVCProfileMain,
+  OMX_VIDEO_AVCProfileHigh,
+};
+
+/* SPS and PPS for the encoder to hand out as codec config */
+static const guint8 codec_config[] = {
+  0x00, 0x00, 0x00, 0x01, 0x67, 0x42, 0xc0, 0x1e, 0xda, 0x02, 0x80, 0xbf,
+  0x00, 0x00, 0x00, 0x01, 0x68, 0xce, 0x3c, 0x80
+};
+
+typedef struct
+{
+  OMX_COMPONENTTYPE *omx;
+  gboolean encoder;
+
+  OMX_CALLBACKTYPE callbacks;
+  OMX_PTR app_data;
+
+  /* from the environment */
+  gulong latency;
+  guint buffers;
+  guint port_change;
+  guint drop;
+
+  /* protects everything below */
+  GMutex lock;
+  GCond cond;
+  GThread *thread;
+  gboolean quit;
+
+  OMX_STATETYPE state;
+  OMX_PARAM_PORTDEFINITIONTYPE ports[2];
+  /* OMX_BUFFERHEADERTYPE * we have been given and did not return yet */
+  GQueue held[2];
+  /* the worker took buffers out of held and is processing them */
+  gboolean busy;
+
+  /* OMX_INDEXTYPE to a copy of the last structure set. Returned as it is by
+   * GetParameter () and GetConfig () */
+  GHashTable *params;
+
+  gboolean native_buffers;
+  gboolean meta_data;
+  gboolean config_sent;
+  /* port settings changed has been sent and the output port not enabled
+   * again yet */
+  gboolean reconfiguring;
+  /* the output port has an extra buffer since the last port change */
+  gboolean grown;
+  guint frames;
+  /* frames processed or dropped */
+  guint inputs;
+} MockComponent;
+
+#define MOCK(handle) \
+  ((MockComponent *) ((OMX_COMPONENTTYPE *) (handle))->pComponentPrivate)
+
+/* the part all indexed structures share */
+typedef struct
+{
+  OMX_U32 nSize;
+  OMX_VERSIONTYPE nVersion;
+  OMX_U32 nPortIndex;
+} MockParamHeader;
+
+static guint
+mock_get_env_uint (const gchar * name, guint def)
+{
+  const gchar *value = g_getenv (name);
+
+  if (!value || !value[0]) {
+    return def;
+  }
+
+  return (guint) g_ascii_strtoull (value, NULL, 10);
+}
+
+static gboolean
+mock_port_matches (OMX_U32 param, OMX_U32 port)
+{
+  return param == port || param == OMX_ALL || param == (OMX_U32) - 1;
+}
+
+static void
+mock_init_struct (MockParamHeader * header, gsize size)
+{
+  memset (header, 0, size);
+  header->nSize = size;
+  header->nVersion.s.nVersionMajor = 1;
+  header->nVersion.s.nVersionMinor = 1;
+}
+
+static void
+mock_init_port (MockComponent * mock, OMX_U32 index)
+{
+  OMX_PARAM_PORTDEFINITIONTYPE *def = &mock->ports[index];
+  /* decoders take and encoders produce the compressed stream */
+  gboolean compressed = (index == MOCK_IN_PORT) != mock->encoder;
+
+  mock_init_struct ((MockParamHeader *) def, sizeof (*def));
+  def->nPortIndex = index;
+  def->eDir = index == MOCK_IN_PORT ? OMX_DirInput : OMX_DirOutput;
+  def->nBufferCountMin = mock->buffers;
+  def->nBufferCountActual = mock->buffers;
+  def->nBufferSize = MOCK_MIN_INPUT_SIZE;
+  def->bEnabled = OMX_TRUE;
+  def->eDomain = OMX_PortDomainVideo;
+  def->format.video.nFrameWidth = MOCK_DEFAULT_WIDTH;
+  def->format.video.nFrameHeight = MOCK_DEFAULT_HEIGHT;
+
+  if (compressed) {
+    def->format.video.eCompressionFormat = OMX_VIDEO_CodingAVC;
+    def->format.video.eColorFormat = OMX_COLOR_FormatUnused;
+  } else {
+    def->format.video.eCompressionFormat = OMX_VIDEO_CodingUnused;
+    def->format.video.eColorFormat = mock->encoder ?
+        OMX_COLOR_FormatYUV420Planar : (OMX_COLOR_FORMATTYPE) MOCK_HAL_YV12;
+  }
+}
+
+/* The output follows the input. Sizes follow the frame size */
+static void
+mock_update_ports (MockComponent * mock)
+{
+  OMX_VIDEO_PORTDEFINITIONTYPE *in = &mock->ports[MOCK_IN_PORT].format.video;
+  OMX_VIDEO_PORTDEFINITIONTYPE *out =
+      &mock->ports[MOCK_OUT_PORT].format.video;
+  OMX_U32 frame;
+
+  in->nStride = in->nFrameWidth;
+  in->nSliceHeight = in->nFrameHeight;
+  out->nFrameWidth = in->nFrameWidth;
+  out->nFrameHeight = in->nFrameHeight;
+  out->nStride = in->nFrameWidth;
+  out->nSliceHeight = in->nFrameHeight;
+  out->xFramerate = in->xFramerate;
+
+  frame = in->nFrameWidth * in->nFrameHeight * 3 / 2;
+
+  mock->ports[MOCK_OUT_PORT].nBufferSize = MAX (frame, MOCK_MIN_INPUT_SIZE);
+
+  if (mock->encoder) {
+    mock->ports[MOCK_IN_PORT].nBufferSize =
+        mock->meta_data ? MOCK_META_DATA_SIZE : frame;
+  }
+}
+
+static void
+mock_event (MockComponent * mock, OMX_EVENTTYPE event, OMX_U32 data1,
+    OMX_U32 data2)
+{
+  mock->callbacks.EventHandler (mock->omx, mock->app_data, event, data1, data2,
+      NULL);
+}
+
+static void
+mock_take_held (MockComponent * mock, OMX_U32 port, GQueue * queue)
+{
+  gpointer buf;
+
+  while ((buf = g_queue_pop_head (&mock->held[port]))) {
+    g_queue_push_tail (queue, buf);
+  }
+}
+
+/* must be called without the lock */
+static void
+mock_return_buffers (MockComponent * mock, GQueue * in, GQueue * out)
+{
+  OMX_BUFFERHEADERTYPE *buf;
+
+  while ((buf = g_queue_pop_head (in))) {
+    mock->callbacks.EmptyBufferDone (mock->omx, mock->app_data, buf);
+  }
+
+  while ((buf = g_queue_pop_head (out))) {
+    buf->nFilledLen = 0;
+    buf->nFlags = 0;
+    mock->callbacks.FillBufferDone (mock->omx, mock->app_data, buf);
+  }
+}
+
+static gboolean
+mock_can_process (MockComponent * mock)
+{
+  return mock->state == OMX_StateExecuting && !mock->reconfiguring
+      && mock->ports[MOCK_IN_PORT].bEnabled
+      && mock->ports[MOCK_OUT_PORT].bEnabled
+      && !g_queue_is_empty (&mock->held[MOCK_IN_PORT]);
+}
+
+/* called with the lock */
+static void
+mock_change_output_port (MockComponent * mock)
+{
+  OMX_PARAM_PORTDEFINITIONTYPE *def = &mock->ports[MOCK_OUT_PORT];
+
+  /* something the client can see */
+  if (mock->grown) {
+    def->nBufferCountActual--;
+  } else {
+    def->nBufferCountActual++;
+  }
+
+  mock->grown = !mock->grown;
+  mock->reconfiguring = TRUE;
+}
+
+static void
+mock_process (MockComponent * mock, OMX_BUFFERHEADERTYPE * in,
+    OMX_BUFFERHEADERTYPE * out, gboolean write, gboolean first)
+{
+  if (mock->latency) {
+    g_usleep (mock->latency);
+  }
+
+  out->nOffset = 0;
+
+  if (write) {
+    out->nFilledLen = MIN (in->nFilledLen, out->nAllocLen);
+    memcpy (out->pBuffer, in->pBuffer + in->nOffset, out->nFilledLen);
+  } else {
+    /* a native buffer. There is nothing we could write */
+    out->nFilledLen = out->nAllocLen;
+  }
+
+  out->nTimeStamp = in->nTimeStamp;
+  out->nFlags = OMX_BUFFERFLAG_ENDOFFRAME
+      | (in->nFlags & (OMX_BUFFERFLAG_SYNCFRAME | OMX_BUFFERFLAG_EOS));
+
+  /* encoders start with a key frame */
+  if (first) {
+    out->nFlags |= OMX_BUFFERFLAG_SYNCFRAME;
+  }
+}
+
+/* call with the lock held for a complete input frame */
+static gboolean
+mock_drop_frame (MockComponent * mock)
+{
+  if (mock->drop == 0 || mock->inputs % mock->drop != 1) {
+    return FALSE;
+  }
+
+  mock->inputs++;
+
+  return TRUE;
+}
+
+static gpointer
+mock_worker (MockComponent * mock)
+{
+  OMX_BUFFERHEADERTYPE *in, *out;
+  gboolean write, first, port_changed;
+
+  g_mutex_lock (&mock->lock);
+
+  while (!mock->quit) {
+    if (!mock_can_process (mock)) {
+      g_cond_wait (&mock->cond, &mock->lock);
+      continue;
+    }
+
+    if (mock->encoder && !mock->config_sent) {
+      out = g_queue_pop_head (&mock->held[MOCK_OUT_PORT]);
+      if (!out) {
+        g_cond_wait (&mock->cond, &mock->lock);
+        continue;
+      }
+
+      mock->config_sent = TRUE;
+      mock->busy = TRUE;
+      g_mutex_unlock (&mock->lock);
+
+      out->nOffset = 0;
+      out->nFilledLen = MIN (sizeof (codec_config), out->nAllocLen);
+      memcpy (out->pBuffer, codec_config, out->nFilledLen);
+      out->nTimeStamp = 0;
+      out->nFlags = OMX_BUFFERFLAG_CODECCONFIG | OMX_BUFFERFLAG_ENDOFFRAME;
+      mock->callbacks.FillBufferDone (mock->omx, mock->app_data, out);
+
+      g_mutex_lock (&mock->lock);
+      mock->busy = FALSE;
+      g_cond_broadcast (&mock->cond);
+      continue;
+    }
+
+    in = g_queue_pop_head (&mock->held[MOCK_IN_PORT]);
+
+    if ((in->nFlags & OMX_BUFFERFLAG_CODECCONFIG)
+        || !(in->nFlags & OMX_BUFFERFLAG_ENDOFFRAME)
+        || mock_drop_frame (mock)) {
+      /* nothing to output (yet) */
+      mock->busy = TRUE;
+      g_mutex_unlock (&mock->lock);
+
+      mock->callbacks.EmptyBufferDone (mock->omx, mock->app_data, in);
+
+      g_mutex_lock (&mock->lock);
+      mock->busy = FALSE;
+      g_cond_broadcast (&mock->cond);
+      continue;
+    }
+
+    out = g_queue_pop_head (&mock->held[MOCK_OUT_PORT]);
+    if (!out) {
+      g_queue_push_head (&mock->held[MOCK_IN_PORT], in);
+      g_cond_wait (&mock->cond, &mock->lock);
+      continue;
+    }
+
+    write = !mock->native_buffers;
+    first = mock->encoder && mock->frames == 0;
+    mock->busy = TRUE;
+    g_mutex_unlock (&mock->lock);
+
+    mock_process (mock, in, out, write, first);
+
+    mock->callbacks.EmptyBufferDone (mock->omx, mock->app_data, in);
+    mock->callbacks.FillBufferDone (mock->omx, mock->app_data, out);
+
+    g_mutex_lock (&mock->lock);
+    mock->busy = FALSE;
+    mock->frames++;
+    mock->inputs++;
+
+    port_changed = mock->port_change > 0
+        && mock->frames % mock->port_change == 0;
+    if (port_changed) {
+      mock_change_output_port (mock);
+    }
+
+    g_cond_broadcast (&mock->cond);
+
+    if (port_changed) {
+      g_mutex_unlock (&mock->lock);
+      mock_event (mock, OMX_EventPortSettingsChanged, MOCK_OUT_PORT,
+          OMX_IndexParamPortDefinition);
+      g_mutex_lock (&mock->lock);
+    }
+  }
+
+  g_mutex_unlock (&mock->lock);
+
+  return NULL;
+}
+
+static OMX_ERRORTYPE
+mock_get_component_version (OMX_HANDLETYPE handle, OMX_STRING name,
+    OMX_VERSIONTYPE * component_version, OMX_VERSIONTYPE * spec_version,
+    OMX_UUIDTYPE * uuid)
+{
+  MockComponent *mock = MOCK (handle);
+
+  g_strlcpy (name, mock->encoder ? MOCK_ENCODER_NAME : MOCK_DECODER_NAME,
+      OMX_MAX_STRINGNAME_SIZE);
+
+  component_version->nVersion = 0;
+  component_version->s.nVersionMajor = 1;
+  spec_version->nVersion = 0;
+  spec_version->s.nVersionMajor = 1;
+  spec_version->s.nVersionMinor = 1;
+
+  if (uuid) {
+    memset (uuid, 0, sizeof (OMX_UUIDTYPE));
+  }
+
+  return OMX_ErrorNone;
+}
+
+static OMX_ERRORTYPE
+mock_send_command (OMX_HANDLETYPE handle, OMX_COMMANDTYPE cmd,
+    OMX_U32 param, OMX_PTR data)
+{
+  MockComponent *mock = MOCK (handle);
+  GQueue in = G_QUEUE_INIT;
+  GQueue out = G_QUEUE_INIT;
+  OMX_U32 port;
+
+  if (cmd != OMX_CommandStateSet && !mock_port_matches (param, MOCK_IN_PORT)
+      && !mock_port_matches (param, MOCK_OUT_PORT)) {
+    return OMX_ErrorBadPortIndex;
+  }
+
+  g_mutex_lock (&mock->lock);
+
+  /* let the worker finish the frame it is on */
+  while (mock->busy) {
+    g_cond_wait (&mock->cond, &mock->lock);
+  }
+
+  switch (cmd) {
+    case OMX_CommandStateSet:
+      if (param == OMX_StateIdle || param == OMX_StateLoaded) {
+        mock_take_held (mock, MOCK_IN_PORT, &in);
+        mock_take_held (mock, MOCK_OUT_PORT, &out);
+      }
+
+      if (param == OMX_StateLoaded) {
+        mock->config_sent = FALSE;
+        mock->frames = 0;
+        mock->inputs = 0;
+      }
+
+      mock->state = param;
+      break;
+
+    case OMX_CommandFlush:
+    case OMX_CommandPortDisable:
+    case OMX_CommandPortEnable:
+      for (port = MOCK_IN_PORT; port <= MOCK_OUT_PORT; port++) {
+        if (!mock_port_matches (param, port)) {
+          continue;
+        }
+
+        if (cmd != OMX_CommandPortEnable) {
+          mock_take_held (mock, port, port == MOCK_IN_PORT ? &in : &out);
+        }
+
+        if (cmd == OMX_CommandPortDisable) {
+          mock->ports[port].bEnabled = OMX_FALSE;
+        } else if (cmd == OMX_CommandPortEnable) {
+          mock->ports[port].bEnabled = OMX_TRUE;
+
+          if (port == MOCK_OUT_PORT) {
+            mock->reconfiguring = FALSE;
+          }
+        }
+      }
+
+      break;
+
+    default:
+      g_mutex_unlock (&mock->lock);
+      return OMX_ErrorUnsupportedSetting;
+  }
+
+  g_cond_broadcast (&mock->cond);
+  g_mutex_unlock (&mock->lock);
+
+  mock_return_buffers (mock, &in, &out);
+
+  if (cmd == OMX_CommandStateSet) {
+    mock_event (mock, OMX_EventCmdComplete, cmd, param);
+  } else {
+    for (port = MOCK_IN_PORT; port <= MOCK_OUT_PORT; port++) {
+      if (mock_port_matches (param, port)) {
+        mock_event (mock, OMX_EventCmdComplete, cmd, port);
+      }
+    }
+  }
+
+  return OMX_ErrorNone;
+}
+
+/* called with the lock */
+static OMX_ERRORTYPE
+mock_get_stored (MockComponent * mock, OMX_INDEXTYPE index, OMX_PTR data)
+{
+  MockParamHeader *header = data;
+  MockParamHeader *stored =
+      g_hash_table_lookup (mock->params, GINT_TO_POINTER (index));
+  OMX_U32 size = header->nSize;
+
+  if (size < sizeof (MockParamHeader)) {
+    return OMX_ErrorBadParameter;
+  }
+
+  if (stored) {
+    memcpy ((guint8 *) data + sizeof (MockParamHeader),
+        (guint8 *) stored + sizeof (MockParamHeader),
+        MIN (size, stored->nSize) - sizeof (MockParamHeader));
+  } else {
+    /* anything we were never told is all zeros */
+    memset ((guint8 *) data + sizeof (MockParamHeader), 0,
+        size - sizeof (MockParamHeader));
+  }
+
+  return OMX_ErrorNone;
+}
+
+/* called with the lock */
+static void
+mock_store (MockComponent * mock, OMX_INDEXTYPE index, OMX_PTR data)
+{
+  MockParamHeader *header = data;
+
+  g_hash_table_insert (mock->params, GINT_TO_POINTER (index),
+      g_memdup (data, header->nSize));
+}
+
+static OMX_ERRORTYPE
+mock_get_parameter (OMX_HANDLETYPE handle, OMX_INDEXTYPE index, OMX_PTR data)
+{
+  MockComponent *mock = MOCK (handle);
+  MockParamHeader *header = data;
+  OMX_ERRORTYPE err = OMX_ErrorNone;
+
+  if (header->nPortIndex != MOCK_IN_PORT && header->nPortIndex != MOCK_OUT_PORT
+      && index != OMX_IndexParamStandardComponentRole) {
+    return OMX_ErrorBadPortIndex;
+  }
+
+  g_mutex_lock (&mock->lock);
+
+  switch ((gint) index) {
+    case OMX_IndexParamPortDefinition:
+      memcpy (data, &mock->ports[header->nPortIndex],
+          MIN (header->nSize, sizeof (OMX_PARAM_PORTDEFINITIONTYPE)));
+      break;
+
+    case OMX_IndexParamVideoProfileLevelQuerySupported:{
+      OMX_VIDEO_PARAM_PROFILELEVELTYPE *param = data;
+
+      if (param->nProfileIndex >= G_N_ELEMENTS (profiles)) {
+        err = OMX_ErrorNoMore;
+        break;
+      }
+
+      param->eProfile = profiles[param->nProfileIndex];
+      param->eLevel = OMX_VIDEO_AVCLevel51;
+      break;
+    }
+
+    case OMX_IndexParamVideoPortFormat:{
+      OMX_VIDEO_PARAM_PORTFORMATTYPE *param = data;
+      OMX_VIDEO_PORTDEFINITIONTYPE *video =
+          &mock->ports[param->nPortIndex].format.video;
+
+      if (param->nIndex > 0) {
+        err = OMX_ErrorNoMore;
+        break;
+      }
+
+      param->eCompressionFormat = video->eCompressionFormat;
+      param->eColorFormat = video->eColorFormat;
+      param->xFramerate = video->xFramerate;
+      break;
+    }
+
+    default:
+      err = mock_get_stored (mock, index, data);
+      break;
+  }
+
+  g_mutex_unlock (&mock->lock);
+
+  return err;
+}
+
+static OMX_ERRORTYPE
+mock_set_parameter (OMX_HANDLETYPE handle, OMX_INDEXTYPE index, OMX_PTR data)
+{
+  MockComponent *mock = MOCK (handle);
+  MockParamHeader *header = data;
+  OMX_ERRORTYPE err = OMX_ErrorNone;
+
+  if (header->nSize < sizeof (MockParamHeader)) {
+    return OMX_ErrorBadParameter;
+  }
+
+  if (header->nPortIndex != MOCK_IN_PORT && header->nPortIndex != MOCK_OUT_PORT
+      && index != OMX_IndexParamStandardComponentRole) {
+    return OMX_ErrorBadPortIndex;
+  }
+
+  g_mutex_lock (&mock->lock);
+
+  switch ((gint) index) {
+    case OMX_IndexParamPortDefinition:{
+      OMX_PARAM_PORTDEFINITIONTYPE *def = data;
+      OMX_PARAM_PORTDEFINITIONTYPE *port = &mock->ports[def->nPortIndex];
+
+      if (def->nBufferCountActual < port->nBufferCountMin) {
+        err = OMX_ErrorBadParameter;
+        break;
+      }
+
+      port->nBufferCountActual = def->nBufferCountActual;
+
+      if (def->nPortIndex == MOCK_IN_PORT) {
+        port->format.video.nFrameWidth = def->format.video.nFrameWidth;
+        port->format.video.nFrameHeight = def->format.video.nFrameHeight;
+        port->format.video.xFramerate = def->format.video.xFramerate;
+
+        /* decoders take whatever input buffer size they are asked for */
+        if (!mock->encoder) {
+          port->nBufferSize = MAX (def->nBufferSize, MOCK_MIN_INPUT_SIZE);
+        }
+      }
+
+      mock_update_ports (mock);
+      break;
+    }
+
+    case MOCK_INDEX_ENABLE_NATIVE_BUFFERS:
+      if (header->nPortIndex != MOCK_OUT_PORT || mock->encoder) {
+        err = OMX_ErrorUnsupportedSetting;
+        break;
+      }
+
+      mock->native_buffers =
+          ((struct EnableAndroidNativeBuffersParams *) data)->enable;
+      break;
+
+    case MOCK_INDEX_STORE_META_DATA:
+      if (header->nPortIndex != MOCK_IN_PORT || !mock->encoder) {
+        err = OMX_ErrorUnsupportedSetting;
+        break;
+      }
+
+      mock->meta_data =
+          ((struct StoreMetaDataInBuffersParams *) data)->bStoreMetaData;
+      mock_update_ports (mock);
+      break;
+
+    default:
+      mock_store (mock, index, data);
+      break;
+  }
+
+  g_mutex_unlock (&mock->lock);
+
+  return err;
+}
+
+static OMX_ERRORTYPE
+mock_get_config (OMX_HANDLETYPE handle, OMX_INDEXTYPE index, OMX_PTR data)
+{
+  MockComponent *mock = MOCK (handle);
+  OMX_ERRORTYPE err = OMX_ErrorNone;
+
+  g_mutex_lock (&mock->lock);
+
+  if (index == OMX_IndexConfigCommonOutputCrop) {
+    OMX_CONFIG_RECTTYPE *crop = data;
+    OMX_VIDEO_PORTDEFINITIONTYPE *video =
+        &mock->ports[MOCK_OUT_PORT].format.video;
+
+    /* never cropped */
+    crop->nLeft = 0;
+    crop->nTop = 0;
+    crop->nWidth = video->nFrameWidth;
+    crop->nHeight = video->nFrameHeight;
+  } else {
+    err = mock_get_stored (mock, index, data);
+  }
+
+  g_mutex_unlock (&mock->lock);
+
+  return err;
+}
+
+static OMX_ERRORTYPE
+mock_set_config (OMX_HANDLETYPE handle, OMX_INDEXTYPE index, OMX_PTR data)
+{
+  MockComponent *mock = MOCK (handle);
+
+  if (((MockParamHeader *) data)->nSize < sizeof (MockParamHeader)) {
+    return OMX_ErrorBadParameter;
+  }
+
+  g_mutex_lock (&mock->lock);
+  mock_store (mock, index, data);
+  g_mutex_unlock (&mock->lock);
+
+  return OMX_ErrorNone;
+}
+
+static OMX_ERRORTYPE
+mock_get_extension_index (OMX_HANDLETYPE handle, OMX_STRING name,
+    OMX_INDEXTYPE * index)
+{
+  guint x;
+
+  for (x = 0; x < G_N_ELEMENTS (extensions); x++) {
+    if (!g_strcmp0 (extensions[x].name, name)) {
+      *index = extensions[x].index;
+      return OMX_ErrorNone;
+    }
+  }
+
+  return OMX_ErrorUnsupportedIndex;
+}
+
+static OMX_ERRORTYPE
+mock_get_state (OMX_HANDLETYPE handle, OMX_STATETYPE * state)
+{
+  MockComponent *mock = MOCK (handle);
+
+  g_mutex_lock (&mock->lock);
+  *state = mock->state;
+  g_mutex_unlock (&mock->lock);
+
+  return OMX_ErrorNone;
+}
+
+static OMX_ERRORTYPE
+mock_tunnel_request (OMX_HANDLETYPE handle, OMX_U32 port,
+    OMX_HANDLETYPE tunneled, OMX_U32 tunneled_port,
+    OMX_TUNNELSETUPTYPE * setup)
+{
+  return OMX_ErrorTunnelingUnsupported;
+}
+
+static OMX_BUFFERHEADERTYPE *
+mock_new_buffer_header (OMX_U32 port, OMX_PTR app_private, OMX_U32 size,
+    OMX_U8 * data)
+{
+  OMX_BUFFERHEADERTYPE *buf = g_slice_new0 (OMX_BUFFERHEADERTYPE);
+
+  buf->nSize = sizeof (OMX_BUFFERHEADERTYPE);
+  buf->nVersion.s.nVersionMajor = 1;
+  buf->nVersion.s.nVersionMinor = 1;
+  buf->pBuffer = data;
+  buf->nAllocLen = size;
+  buf->pAppPrivate = app_private;
+  buf->nInputPortIndex = port == MOCK_IN_PORT ? MOCK_IN_PORT : OMX_ALL;
+  buf->nOutputPortIndex = port == MOCK_OUT_PORT ? MOCK_OUT_PORT : OMX_ALL;
+
+  return buf;
+}
+
+static OMX_ERRORTYPE
+mock_use_buffer (OMX_HANDLETYPE handle, OMX_BUFFERHEADERTYPE ** buf,
+    OMX_U32 port, OMX_PTR app_private, OMX_U32 size, OMX_U8 * data)
+{
+  if (port != MOCK_IN_PORT && port != MOCK_OUT_PORT) {
+    return OMX_ErrorBadPortIndex;
+  }
+
+  *buf = mock_new_buffer_header (port, app_private, size, data);
+
+  return OMX_ErrorNone;
+}
+
+static OMX_ERRORTYPE
+mock_allocate_buffer (OMX_HANDLETYPE handle, OMX_BUFFERHEADERTYPE ** buf,
+    OMX_U32 port, OMX_PTR app_private, OMX_U32 size)
+{
+  OMX_U8 *data;
+
+  if (port != MOCK_IN_PORT && port != MOCK_OUT_PORT) {
+    return OMX_ErrorBadPortIndex;
+  }
+
+  data = g_malloc0 (size);
+
+  *buf = mock_new_buffer_header (port, app_private, size, data);
+  /* we own the memory */
+  (*buf)->pPlatformPrivate = data;
+
+  return OMX_ErrorNone;
+}
+
+static OMX_ERRORTYPE
+mock_free_buffer (OMX_HANDLETYPE handle, OMX_U32 port,
+    OMX_BUFFERHEADERTYPE * buf)
+{
+  MockComponent *mock = MOCK (handle);
+
+  if (port != MOCK_IN_PORT && port != MOCK_OUT_PORT) {
+    return OMX_ErrorBadPortIndex;
+  }
+
+  /* no waiting for the worker. This can be called from our own callbacks */
+  g_mutex_lock (&mock->lock);
+  g_queue_remove (&mock->held[port], buf);
+
+  g_mutex_unlock (&mock->lock);
+
+  g_free (buf->pPlatformPrivate);
+  g_slice_free (OMX_BUFFERHEADERTYPE, buf);
+
+  return OMX_ErrorNone;
+}
+
+static OMX_ERRORTYPE
+mock_queue_buffer (MockComponent * mock, OMX_U32 port,
+    OMX_BUFFERHEADERTYPE * buf)
+{
+  g_mutex_lock (&mock->lock);
+
+  if (mock->state == OMX_StateLoaded || mock->state == OMX_StateInvalid) {
+    g_mutex_unlock (&mock->lock);
+    return OMX_ErrorIncorrectStateOperation;
+  }
+
+  g_queue_push_tail (&mock->held[port], buf);
+  g_cond_broadcast (&mock->cond);
+
+  g_mutex_unlock (&mock->lock);
+
+  return OMX_ErrorNone;
+}
+
+static OMX_ERRORTYPE
+mock_empty_this_buffer (OMX_HANDLETYPE handle, OMX_BUFFERHEADERTYPE * buf)
+{
+  return mock_queue_buffer (MOCK (handle), MOCK_IN_PORT, buf);
+}
+
+static OMX_ERRORTYPE
+mock_fill_this_buffer (OMX_HANDLETYPE handle, OMX_BUFFERHEADERTYPE * buf)
+{
+  return mock_queue_buffer (MOCK (handle), MOCK_OUT_PORT, buf);
+}
+
+static OMX_ERRORTYPE
+mock_set_callbacks (OMX_HANDLETYPE handle, OMX_CALLBACKTYPE * callbacks,
+    OMX_PTR app_data)
+{
+  MockComponent *mock = MOCK (handle);
+
+  mock->callbacks = *callbacks;
+  mock->app_data = app_data;
+
+  return OMX_ErrorNone;
+}
+
+static OMX_ERRORTYPE
+mock_component_deinit (OMX_HANDLETYPE handle)
+{
+  MockComponent *mock = MOCK (handle);
+
+  g_mutex_lock (&mock->lock);
+  mock->quit = TRUE;
+  g_cond_broadcast (&mock->cond);
+  g_mutex_unlock (&mock->lock);
+
+  g_thread_join (mock->thread);
+
+  g_queue_clear (&mock->held[MOCK_IN_PORT]);
+  g_queue_clear (&mock->held[MOCK_OUT_PORT]);
+  g_hash_table_unref (mock->params);
+  g_mutex_clear (&mock->lock);
+  g_cond_clear (&mock->cond);
+
+  g_slice_free (MockComponent, mock);
+
+  return OMX_ErrorNone;
+}
+
+static OMX_ERRORTYPE
+mock_use_egl_image (OMX_HANDLETYPE handle, OMX_BUFFERHEADERTYPE ** buf,
+    OMX_U32 port, OMX_PTR app_private, void *image)
+{
+  return OMX_ErrorNotImplemented;
+}
+
+static OMX_ERRORTYPE
+mock_component_role_enum (OMX_HANDLETYPE handle, OMX_U8 * role,
+    OMX_U32 index)
+{
+  MockComponent *mock = MOCK (handle);
+
+  if (index > 0) {
+    return OMX_ErrorNoMore;
+  }
+
+  g_strlcpy ((gchar *) role,
+      mock->encoder ? "video_encoder.avc" : "video_decoder.avc",
+      OMX_MAX_STRINGNAME_SIZE);
+
+  return OMX_ErrorNone;
+}
+
+OMX_ERRORTYPE
+OMX_Init (void)
+{
+  return OMX_ErrorNone;
+}
+
+OMX_ERRORTYPE
+OMX_Deinit (void)
+{
+  return OMX_ErrorNone;
+}
+
+OMX_ERRORTYPE
+OMX_ComponentNameEnum (OMX_STRING name, OMX_U32 length, OMX_U32 index)
+{
+  const gchar *names[] = { MOCK_DECODER_NAME, MOCK_ENCODER_NAME };
+
+  if (index >= G_N_ELEMENTS (names)) {
+    return OMX_ErrorNoMore;
+  }
+
+  g_strlcpy (name, names[index], length);
+
+  return OMX_ErrorNone;
+}
+
+OMX_ERRORTYPE
+OMX_GetHandle (OMX_HANDLETYPE * handle, OMX_STRING name, OMX_PTR app_data,
+    OMX_CALLBACKTYPE * callbacks)
+{
+  OMX_COMPONENTTYPE *omx;
+  MockComponent *mock;
+
+  if (g_strcmp0 (name, MOCK_DECODER_NAME)
+      && g_strcmp0 (name, MOCK_ENCODER_NAME)) {
+    return OMX_ErrorComponentNotFound;
+  }
+
+  mock = g_slice_new0 (MockComponent);
+  mock->encoder = !g_strcmp0 (name, MOCK_ENCODER_NAME);
+  mock->callbacks = *callbacks;
+  mock->app_data = app_data;
+  mock->latency = mock_get_env_uint ("DROID_MOCK_OMX_LATENCY", 0);
+  mock->buffers = MAX (mock_get_env_uint ("DROID_MOCK_OMX_BUFFERS",
+          MOCK_DEFAULT_BUFFERS), 1);
+  mock->port_change = mock_get_env_uint ("DROID_MOCK_OMX_PORT_CHANGE", 0);
+  mock->drop = mock_get_env_uint ("DROID_MOCK_OMX_DROP", 0);
+  mock->state = OMX_StateLoaded;
+  mock->params = g_hash_table_new_full (NULL, NULL, NULL, g_free);
+  g_queue_init (&mock->held[MOCK_IN_PORT]);
+  g_queue_init (&mock->held[MOCK_OUT_PORT]);
+  g_mutex_init (&mock->lock);
+  g_cond_init (&mock->cond);
+
+  mock_init_port (mock, MOCK_IN_PORT);
+  mock_init_port (mock, MOCK_OUT_PORT);
+  mock_update_ports (mock);
+
+  omx = g_slice_new0 (OMX_COMPONENTTYPE);
+  omx->nSize = sizeof (OMX_COMPONENTTYPE);
+  omx->nVersion.s.nVersionMajor = 1;
+  omx->nVersion.s.nVersionMinor = 1;
+  omx->pComponentPrivate = mock;
+  omx->pApplicationPrivate = app_data;
+  omx->GetComponentVersion = mock_get_component_version;
+  omx->SendCommand = mock_send_command;
+  omx->GetParameter = mock_get_parameter;
+  omx->SetParameter = mock_set_parameter;
+  omx->GetConfig = mock_get_config;
+  omx->SetConfig = mock_set_config;
+  omx->GetExtensionIndex = mock_get_extension_index;
+  omx->GetState = mock_get_state;
+  omx->ComponentTunnelRequest = mock_tunnel_request;
+  omx->UseBuffer = mock_use_buffer;
+  omx->AllocateBuffer = mock_allocate_buffer;
+  omx->FreeBuffer = mock_free_buffer;
+  omx->EmptyThisBuffer = mock_empty_this_buffer;
+  omx->FillThisBuffer = mock_fill_this_buffer;
+  omx->SetCallbacks = mock_set_callbacks;
+  omx->ComponentDeInit = mock_component_deinit;
+  omx->UseEGLImage = mock_use_egl_image;
+  omx->ComponentRoleEnum = mock_component_role_enum;
+
+  mock->omx = omx;
+  mock->thread = g_thread_new ("mockomx", (GThreadFunc) mock_worker, mock);
+
+  *handle = omx;
+
+  return OMX_ErrorNone;
+}
+
+OMX_ERRORTYPE
+OMX_FreeHandle (OMX_HANDLETYPE handle)
+{
+  OMX_COMPONENTTYPE *omx = handle;
+
+  omx->ComponentDeInit (handle);
+  g_slice_free (OMX_COMPONENTTYPE, omx);
+
+  return OMX_ErrorNone;
+}
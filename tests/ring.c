@@ -0,0 +1,230 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/gst.h>
+#include <gst/check/gstcheck.h>
+#include "gstdroidcodecring.h"
+
+/* typical number of output buffers of a video decoder */
+#define RING_SIZE 8
+#define BURST_FRAMES 200000
+#define PACED_FRAMES 2000
+/* ~2000 fps */
+#define PACED_INTERVAL 500
+
+/* What we used to have: a GQueue protected by a mutex and a condition */
+typedef struct
+{
+  GMutex lock;
+  GCond cond;
+  GQueue *queue;
+} LockedQueue;
+
+typedef struct
+{
+  gboolean use_ring;
+  GstDroidCodecRing *ring;
+  LockedQueue locked;
+  guint frames;
+  gulong interval;
+  gint64 *pushed;
+} Bench;
+
+static void
+bench_push (Bench * bench, gpointer data)
+{
+  if (bench->use_ring) {
+    while (!gst_droid_codec_ring_push (bench->ring, data)) {
+      g_thread_yield ();
+    }
+  } else {
+    g_mutex_lock (&bench->locked.lock);
+    g_queue_push_tail (bench->locked.queue, data);
+    g_cond_signal (&bench->locked.cond);
+    g_mutex_unlock (&bench->locked.lock);
+  }
+}
+
+static gpointer
+bench_pop (Bench * bench)
+{
+  gpointer data;
+
+  if (bench->use_ring) {
+    return gst_droid_codec_ring_pop_wait (bench->ring);
+  }
+
+  g_mutex_lock (&bench->locked.lock);
+  while (!(data = g_queue_pop_head (bench->locked.queue))) {
+    g_cond_wait (&bench->locked.cond, &bench->locked.lock);
+  }
+  g_mutex_unlock (&bench->locked.lock);
+
+  return data;
+}
+
+static gpointer
+producer (Bench * bench)
+{
+  guint x;
+
+  for (x = 1; x <= bench->frames; x++) {
+    if (bench->interval) {
+      g_usleep (bench->interval);
+    }
+
+    bench->pushed[x - 1] = g_get_monotonic_time ();
+    bench_push (bench, GUINT_TO_POINTER (x));
+  }
+
+  return NULL;
+}
+
+static void
+run_bench (gboolean use_ring, guint frames, gulong interval)
+{
+  Bench bench;
+  GThread *thread;
+  guint x;
+  gint64 start, total, latency = 0, max_latency = 0;
+
+  bench.use_ring = use_ring;
+  bench.frames = frames;
+  bench.interval = interval;
+  bench.pushed = g_new0 (gint64, frames);
+
+  if (use_ring) {
+    bench.ring = gst_droid_codec_ring_new (RING_SIZE);
+    fail_unless (bench.ring != NULL);
+  } else {
+    g_mutex_init (&bench.locked.lock);
+    g_cond_init (&bench.locked.cond);
+    bench.locked.queue = g_queue_new ();
+  }
+
+  start = g_get_monotonic_time ();
+  thread = g_thread_new ("producer", (GThreadFunc) producer, &bench);
+
+  for (x = 1; x <= frames; x++) {
+    gint64 diff;
+    gpointer data = bench_pop (&bench);
+
+    diff = g_get_monotonic_time () - bench.pushed[x - 1];
+    latency += diff;
+    max_latency = MAX (max_latency, diff);
+
+    fail_unless_equals_int (GPOINTER_TO_UINT (data), x);
+  }
+
+  total = g_get_monotonic_time () - start;
+  g_thread_join (thread);
+
+  g_print ("%-6s %-5s %7u frames in %8" G_GINT64_FORMAT " us: %10.0f fps, "
+      "latency avg %6.1f us max %6" G_GINT64_FORMAT " us\n",
+      use_ring ? "ring" : "gqueue", interval ? "paced" : "burst", frames,
+      total, frames * (gdouble) G_USEC_PER_SEC / MAX (total, 1),
+      latency / (gdouble) frames, max_latency);
+
+  if (use_ring) {
+    fail_unless_equals_int (gst_droid_codec_ring_length (bench.ring), 0);
+    gst_droid_codec_ring_free (bench.ring);
+  } else {
+    g_queue_free (bench.locked.queue);
+    g_cond_clear (&bench.locked.cond);
+    g_mutex_clear (&bench.locked.lock);
+  }
+
+  g_free (bench.pushed);
+}
+
+GST_START_TEST (test_push_pop)
+{
+  GstDroidCodecRing *ring = gst_droid_codec_ring_new (5);
+  guint x;
+
+  fail_unless (ring != NULL);
+  fail_unless_equals_int (gst_droid_codec_ring_size (ring), 8);
+  fail_unless (gst_droid_codec_ring_pop (ring) == NULL);
+
+  for (x = 1; x <= 8; x++) {
+    fail_unless (gst_droid_codec_ring_push (ring, GUINT_TO_POINTER (x)));
+  }
+
+  /* full */
+  fail_unless (!gst_droid_codec_ring_push (ring, GUINT_TO_POINTER (9)));
+  fail_unless_equals_int (gst_droid_codec_ring_length (ring), 8);
+
+  for (x = 1; x <= 8; x++) {
+    fail_unless_equals_int (GPOINTER_TO_UINT (gst_droid_codec_ring_pop (ring)),
+        x);
+  }
+
+  fail_unless (gst_droid_codec_ring_pop (ring) == NULL);
+
+  gst_droid_codec_ring_free (ring);
+}
+
+GST_END_TEST;
+
+static gpointer
+flush_later (GstDroidCodecRing * ring)
+{
+  g_usleep (G_USEC_PER_SEC / 10);
+  gst_droid_codec_ring_set_flushing (ring, TRUE);
+
+  return NULL;
+}
+
+GST_START_TEST (test_flushing)
+{
+  GstDroidCodecRing *ring = gst_droid_codec_ring_new (RING_SIZE);
+  GThread *thread;
+
+  fail_unless (ring != NULL);
+
+  /* a waiting consumer gets woken up */
+  thread = g_thread_new ("flush", (GThreadFunc) flush_later, ring);
+  fail_unless (gst_droid_codec_ring_pop_wait (ring) == NULL);
+  g_thread_join (thread);
+
+  /* and does not wait while flushing */
+  fail_unless (gst_droid_codec_ring_push (ring, GUINT_TO_POINTER (1)));
+  fail_unless (gst_droid_codec_ring_pop_wait (ring) == NULL);
+
+  gst_droid_codec_ring_set_flushing (ring, FALSE);
+  fail_unless_equals_int (GPOINTER_TO_UINT (gst_droid_codec_ring_pop_wait
+          (ring)), 1);
+
+  gst_droid_codec_ring_free (ring);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_benchmark)
+{
+  run_bench (FALSE, BURST_FRAMES, 0);
+  run_bench (TRUE, BURST_FRAMES, 0);
+  run_bench (FALSE, PACED_FRAMES, PACED_INTERVAL);
+  run_bench (TRUE, PACED_FRAMES, PACED_INTERVAL);
+}
+
+GST_END_TEST;
+
+static Suite *
+ring_suite (void)
+{
+  Suite *s = suite_create ("droid codec ring");
+  TCase *tc_chain = tcase_create ("general");
+
+  suite_add_tcase (s, tc_chain);
+
+  tcase_set_timeout (tc_chain, 60);
+  tcase_add_test (tc_chain, test_push_pop);
+  tcase_add_test (tc_chain, test_flushing);
+  tcase_add_test (tc_chain, test_benchmark);
+
+  return s;
+}
+
+GST_CHECK_MAIN (ring);